@@ -22,6 +22,49 @@ hopscotch_new(void);
 void
 hopscotch_free(struct hopscotch *t);
 
+/* Clear the graph, so the handle can be used to build and solve a new
+ * one, as if it had just been returned by `hopscotch_new`. This keeps
+ * all of the handle's buffers (including those used by `hopscotch_solve`)
+ * for reuse, so repeatedly building, solving and resetting graphs of
+ * similar size does no allocation once they have grown to fit.
+ *
+ * Any solvers or shards created for T become invalid; solvers must be
+ * freed before resetting. */
+void
+hopscotch_reset(struct hopscotch *t);
+
+/* Limit how many bytes the handle can allocate, in total, for the graph
+ * (nodes, successor lists, names, etc.) and its solvers (their stacks,
+ * group buffers, and so on), along with the scratch space used while
+ * verifying or analyzing results. Anything that would go over the limit
+ * fails with HOPSCOTCH_ERROR_MEMORY, before allocating, leaving the
+ * handle as it was. Buffers returned to the caller, such as those in a
+ * `struct hopscotch_result`, aren't counted. Where there's a choice,
+ * as with `hopscotch_reduce`'s block size and `hopscotch_execute`'s
+ * thread count, less memory is used to stay under the limit.
+ *
+ * A limit of 0 (the default) means no limit. Returns false (and sets
+ * HOPSCOTCH_ERROR_MEMORY) if the handle is already using more. */
+bool
+hopscotch_set_memory_limit(struct hopscotch *t, size_t bytes);
+
+/* Also count T's allocations against OWNER's memory limit, so several
+ * handles (e.g. scratch handles used to load OWNER's graph on other
+ * threads) share one budget. What T is using now is counted right
+ * away, and freeing T gives it all back. OWNER must outlive T.
+ * Returns false (and sets T's error) if that would put OWNER over its
+ * limit, or if T already shares another handle's. */
+bool
+hopscotch_share_memory_limit(struct hopscotch *t, struct hopscotch *owner);
+
+/* Count a buffer the caller allocated alongside T against T's memory
+ * limit, as it changes size from OLD_BYTES to NEW_BYTES (which is 0
+ * once it's freed). This can be called from any thread. Growing
+ * returns false, counting nothing, if it would go over the limit. */
+bool
+hopscotch_charge_memory(struct hopscotch *t,
+    size_t old_bytes, size_t new_bytes);
+
 /* Add a node and a set of successors to it.
  * If succ_count is 0, then *successors can be NULL.
  * Return false on error (see hopscotch_error). */
@@ -29,17 +72,150 @@ bool
 hopscotch_add(struct hopscotch *t, uint32_t node_id,
     size_t succ_count, const uint32_t *successors);
 
+/* Edge labels are small bitmasks, which can be used to mark different
+ * kinds of edges (e.g. build vs. test dependencies) in the same graph.
+ * Edges added without a label get HOPSCOTCH_LABEL_DEFAULT. */
+#define HOPSCOTCH_LABEL_DEFAULT 0x01
+#define HOPSCOTCH_LABEL_ALL 0xff
+
+/* Like `hopscotch_add`, but with a label bitmask for each successor.
+ * If LABELS is NULL, every edge gets HOPSCOTCH_LABEL_DEFAULT.
+ * Return false on error (see hopscotch_error). */
+bool
+hopscotch_add_labeled(struct hopscotch *t, uint32_t node_id,
+    size_t succ_count, const uint32_t *successors, const uint8_t *labels);
+
+/* Get the node ID for the LEN-byte string NAME, from the handle's own
+ * string table. Names are given IDs in the order first seen, starting
+ * from 0, so named and numbered nodes shouldn't be mixed. This can be
+ * called before or after sealing, and NODE_ID can be NULL.
+ * Return false on error. */
+bool
+hopscotch_intern(struct hopscotch *t, const char *name, size_t len,
+    uint32_t *node_id);
+
+/* Like `hopscotch_add`, but with the node and its successors given by
+ * name (with NAMES[i] being LENS[i] bytes), which are interned as in
+ * `hopscotch_intern`. */
+bool
+hopscotch_add_named(struct hopscotch *t, const char *name, size_t len,
+    size_t succ_count, const char *const *names, const size_t *lens);
+
+/* Get the interned name for NODE_ID, NUL-terminated, and set *LEN (if
+ * non-NULL) to its length. Returns NULL if NODE_ID has no name. This is
+ * cheap enough to call from callbacks, but the pointer is only valid
+ * until the next name is interned. */
+const char *
+hopscotch_name(const struct hopscotch *t, uint32_t node_id, size_t *len);
+
+/* Opaque handle to a shard, used to add nodes / edges to a graph
+ * from multiple threads. Each producer thread gets its own shard,
+ * and all shards are merged into the graph (in parallel) by
+ * `hopscotch_seal`. */
+struct hopscotch_shard;
+
+/* Allocate a new shard for T. This can be called from any thread,
+ * but not after (or during) `hopscotch_seal`. Returns NULL on error.
+ * The shard is owned by T, and freed when it is sealed or freed. */
+struct hopscotch_shard *
+hopscotch_shard_new(struct hopscotch *t);
+
+/* Add a node and a set of successors to it, through shard S.
+ * This is like `hopscotch_add`, but a shard only needs to be used
+ * by one thread at a time, so different threads can add through
+ * different shards concurrently. The additions only appear in the
+ * graph once it has been sealed, and each node's successors are
+ * appended in order of shard creation.
+ * Return false on error. */
+bool
+hopscotch_shard_add(struct hopscotch_shard *s, uint32_t node_id,
+    size_t succ_count, const uint32_t *successors);
+
+/* Like `hopscotch_shard_add`, but with per-edge labels,
+ * as in `hopscotch_add_labeled`. */
+bool
+hopscotch_shard_add_labeled(struct hopscotch_shard *s,
+    uint32_t node_id, size_t succ_count, const uint32_t *successors,
+    const uint8_t *labels);
+
 /* Note that all nodes / edges have been added to the
- * graph. This must be called before `hopscotch_solve`. */
+ * graph. This must be called before `hopscotch_solve`.
+ * Any shards are merged into the graph at this point, so all
+ * threads must be done adding through them first. */
 bool
 hopscotch_seal(struct hopscotch *t);
 
 /* Get successors for a node.
- * Only usable after the graph has been sealed. */
+ * Only usable after the graph has been sealed. *SUCCESSORS points
+ * into the graph, and stays valid until T is reset or freed, unless
+ * the graph has been compressed or renumbered. Then they're decoded
+ * or mapped into a buffer owned by the handle's solver, which is only
+ * valid until the next call, so (as with the other functions using
+ * that solver) only one thread should call this; other threads can
+ * use `hopscotch_solver_get_successors`. */
 bool
 hopscotch_get_successors(struct hopscotch *t, uint32_t node_id,
     size_t *succ_count, const uint32_t **successors);
 
+/* Orderings for `hopscotch_renumber`. */
+enum hopscotch_node_order {
+    /* Breadth-first from each unvisited node, in ID order. */
+    HOPSCOTCH_ORDER_BFS,
+    /* Depth-first preorder, likewise. */
+    HOPSCOTCH_ORDER_DFS,
+    /* Reverse Cuthill-McKee: breadth-first, starting from and
+     * expanding to nodes with fewer successors first, then reversed. */
+    HOPSCOTCH_ORDER_RCM,
+    /* By number of successors, most first. */
+    HOPSCOTCH_ORDER_DEGREE,
+};
+
+/* Renumber the sealed graph's nodes internally, in the given order,
+ * so that nodes near each other in the graph are stored near each
+ * other in memory. This only changes the graph's storage: node IDs
+ * passed in and reported back are mapped, so results are the same
+ * groups (with sorted members), though groups may be found in a
+ * different (but still valid) order than before. This must be called
+ * before `hopscotch_compress`. */
+bool
+hopscotch_renumber(struct hopscotch *t, enum hopscotch_node_order order);
+
+/* Compress the sealed graph's successor lists, to save memory. Each
+ * list is sorted, duplicates are removed (merging their labels), and
+ * the IDs are stored as varint-encoded deltas, which are decoded while
+ * solving. Since successors end up sorted, groups may be found in a
+ * different (but still valid) order than before compressing.
+ *
+ * Once compressed, `hopscotch_get_successors` decodes into a buffer,
+ * which is only valid until its next call. */
+bool
+hopscotch_compress(struct hopscotch *t);
+
+/* Get the number of bytes allocated for the graph's nodes and
+ * successor lists, not counting solvers or the impact condensation. */
+size_t
+hopscotch_memory(const struct hopscotch *t);
+
+/* Set the size of each node's payload: caller data (such as a path or
+ * owner) stored in a dense array indexed by node ID, so it can be read
+ * without a separate lookup. If 0 or never set, payloads are pointer
+ * sized. This must be called before setting any payloads. */
+bool
+hopscotch_set_payload_size(struct hopscotch *t, size_t size);
+
+/* Copy a node's payload from PAYLOAD. This can be called before or
+ * after sealing. */
+bool
+hopscotch_set_payload(struct hopscotch *t, uint32_t node_id,
+    const void *payload);
+
+/* Get a pointer to a node's payload, which is all zero bytes until
+ * set. Returns NULL if no payload was ever set for NODE_ID or any
+ * higher ID. The pointer is only valid until payloads are set for
+ * higher IDs. */
+const void *
+hopscotch_payload(const struct hopscotch *t, uint32_t node_id);
+
 /* hopscotch_solve callback type -- it will be called with
  * a group ID (which increments for each group), the
  * group count, an array of members, and a void pointer
@@ -58,23 +234,380 @@ hopscotch_solve_cb(uint32_t group_id,
  *
  * On error, returns false and sets the handle's error state.
  *
- * MAX_DEPTH can be used to protect against overflowing the stack via
- * excessive recursion. If set to 0, the default limit will be used.
+ * MAX_DEPTH limits how deep the depth-first search can go, which bounds
+ * the memory used for its stack. (The search keeps its own stack, so
+ * it won't overflow the C stack.) If set to 0, the default limit will
+ * be used.
  *
- * Note: The graph handle is modified during the solving process,
- * so calling `hopscotch_solve` on T multiple times is an error. */
+ * This uses the handle's own solver, so only one thread should call
+ * it (or the other handle-level solving functions) at a time. To solve
+ * the same graph from several threads, use `hopscotch_solver_new`. */
 bool
 hopscotch_solve(struct hopscotch *t, size_t max_depth,
     hopscotch_solve_cb *cb, void *udata);
 
+/* Like `hopscotch_solve`, but only follow edges whose label has at
+ * least one bit in common with LABEL_MASK. Every node is still
+ * reported; nodes whose edges are all masked out end up in groups
+ * by themselves. */
+bool
+hopscotch_solve_masked(struct hopscotch *t, uint8_t label_mask,
+    size_t max_depth, hopscotch_solve_cb *cb, void *udata);
+
+/* Like `hopscotch_solve`, but only consider the ROOT_COUNT nodes in
+ * ROOTS and the nodes reachable from them. Groups are reported in
+ * reverse topological order, with group IDs starting from 0 on each
+ * call. Every root must be a node in the graph.
+ *
+ * This only touches the reachable part of the graph, and resets its
+ * state afterward, so it can be called repeatedly with different root
+ * sets. */
+bool
+hopscotch_solve_from(struct hopscotch *t,
+    size_t root_count, const uint32_t *roots, size_t max_depth,
+    hopscotch_solve_cb *cb, void *udata);
+
+/* Find every node that transitively depends on (has a path to) any of
+ * the CHANGED_COUNT nodes in CHANGED, including those nodes themselves.
+ *
+ * The first call solves the graph and saves its groups, along with the
+ * reverse edges between them; later calls reuse them, and only do work
+ * proportional to the size of the affected region.
+ *
+ * On success, sets *AFFECTED_COUNT and *AFFECTED to an array of the
+ * affected node IDs, in no particular order (though members of the same
+ * group are adjacent). The array is owned by the handle, and is only
+ * valid until the next call to `hopscotch_impact` or `hopscotch_free`. */
+bool
+hopscotch_impact(struct hopscotch *t,
+    size_t changed_count, const uint32_t *changed,
+    size_t *affected_count, const uint32_t **affected);
+
+/* A solved graph's groups, as flat arrays. The members of group G are
+ * MEMBERS[GROUP_OFFSETS[G]] up to (but not including)
+ * MEMBERS[GROUP_OFFSETS[G + 1]], and groups are in the same order as
+ * they would be passed to a `hopscotch_solve_cb`. */
+struct hopscotch_result {
+    size_t id_limit;            /* entries in node_group */
+    size_t node_count;          /* entries in members */
+    uint32_t group_count;
+    uint32_t *node_group;       /* node ID -> group ID */
+    uint32_t *group_offsets;    /* group_count + 1 entries */
+    uint32_t *members;
+    uint8_t owned;              /* internal: allocated by hopscotch */
+    uint8_t owned_ceil2[3];     /* internal: their allocated sizes */
+};
+
+/* Group ID in a result's node_group for IDs that aren't in the graph. */
+#define HOPSCOTCH_NO_GROUP UINT32_MAX
+
+/* Get the sizes needed for a sealed graph's result buffers: NODE_GROUP
+ * needs *ID_LIMIT entries, MEMBERS needs *NODE_COUNT, and GROUP_OFFSETS
+ * needs *NODE_COUNT + 1 (enough for every node in its own group). */
+bool
+hopscotch_result_size(struct hopscotch *t,
+    size_t *id_limit, size_t *node_count);
+
+/* Solve the graph, as in `hopscotch_solve`, but write the groups into
+ * RES, rather than calling a callback for each one.
+ *
+ * RES should be zeroed before its first use. Any of its NODE_GROUP,
+ * GROUP_OFFSETS, and MEMBERS buffers left NULL are allocated, and
+ * should be freed with `hopscotch_result_free`; the rest are written
+ * in place, and must be sized as given by `hopscotch_result_size`.
+ * Reusing the same RES reuses the buffers it allocated. */
+bool
+hopscotch_solve_into(struct hopscotch *t, struct hopscotch_result *res);
+
+/* Free any buffers RES allocated, and set them to NULL. */
+void
+hopscotch_result_free(struct hopscotch_result *res);
+
+/* Copy the payloads of RES's members into OUT, in the same order as
+ * its MEMBERS array, so group G's payloads start at byte
+ * GROUP_OFFSETS[G] * (payload size). OUT must have room for
+ * RES->NODE_COUNT payloads. */
+bool
+hopscotch_gather_payloads(struct hopscotch *t,
+    const struct hopscotch_result *res, void *out);
+
+enum hopscotch_verify_res {
+    HOPSCOTCH_VERIFY_OK,
+    HOPSCOTCH_VERIFY_MISUSE,        /* unsealed graph or mis-sized result */
+    HOPSCOTCH_VERIFY_BAD_MEMBERS,   /* node missing, repeated, or unknown */
+    HOPSCOTCH_VERIFY_NOT_CONNECTED, /* group isn't strongly connected */
+    HOPSCOTCH_VERIFY_BAD_ORDER,     /* edge to a later group */
+    HOPSCOTCH_VERIFY_ERROR_MEMORY,  /* allocation failure */
+};
+
+/* Check that RES is a correct solution for the sealed graph T, following
+ * every edge: each node is in exactly one group, each group is strongly
+ * connected, and groups are in reverse topological order (every edge
+ * leads to the same group or an earlier one). Together, these mean each
+ * group is a maximal strongly connected component.
+ *
+ * This takes O(V + E) time, reading T's own successor arrays; the only
+ * extra memory is for the reverse of the edges within groups. */
+enum hopscotch_verify_res
+hopscotch_verify(struct hopscotch *t, const struct hopscotch_result *res);
+
+/* Set a node's weight, such as how long it takes to build, for
+ * `hopscotch_critical_path`. Nodes without one have a weight of 0.
+ * This can be called before or after sealing. */
+bool
+hopscotch_set_weight(struct hopscotch *t, uint32_t node_id, uint64_t weight);
+
+/* The critical path through a solved graph's groups. */
+struct hopscotch_critical_path {
+    uint32_t group_count;       /* entries in finish */
+    uint64_t *finish;           /* group ID -> earliest finish time */
+    uint64_t total;             /* weight of the critical path */
+    uint32_t path_length;       /* entries in path */
+    uint32_t *path;             /* group IDs, dependencies first */
+};
+
+/* Find the earliest finish time of each group in RES (a result from
+ * `hopscotch_solve_into` for T), treating each edge between groups as
+ * a dependency: a group's finish time is its members' total weight,
+ * plus the latest finish time of any group it has an edge to. Since
+ * groups are in reverse topological order, this takes one pass over
+ * them. Also find the critical path, the chain of groups ending at the
+ * latest finish time, which bounds how quickly everything can finish.
+ *
+ * Edges to later groups (possible in results from label-masked
+ * solvers) are ignored. CP's arrays are allocated, and should be
+ * freed with `hopscotch_critical_path_free`. */
+bool
+hopscotch_critical_path(struct hopscotch *t,
+    const struct hopscotch_result *res, struct hopscotch_critical_path *cp);
+
+void
+hopscotch_critical_path_free(struct hopscotch_critical_path *cp);
+
+/* The transitive reduction of a solved graph's groups: the edges
+ * between groups that aren't implied by any other path. */
+struct hopscotch_reduction {
+    uint32_t group_count;
+    uint32_t *offsets;          /* group_count + 1 entries */
+    uint32_t *edges;            /* group IDs, from offsets[G] to [G + 1] */
+    size_t removed;             /* how many redundant edges were dropped */
+};
+
+/* Find the transitive reduction of the groups in RES (a result from
+ * `hopscotch_solve_into` for T). Group G keeps an edge to an earlier
+ * group H unless H can be reached through one of G's other edges.
+ * Each group's edges are listed from latest to earliest group ID.
+ *
+ * This walks the groups in reverse topological order, building each
+ * group's set of reachable groups as a bitset from its successors'
+ * sets with word-wide ORs. To bound memory, only a block of target
+ * groups is tracked at a time, so it uses about 64 MB at most, but
+ * takes O((G + E) * G / 64) time in total for G groups and E edges
+ * between them, so dense group graphs cost much more. RED's arrays
+ * are allocated, and should be freed with `hopscotch_reduction_free`. */
+bool
+hopscotch_reduce(struct hopscotch *t,
+    const struct hopscotch_result *res, struct hopscotch_reduction *red);
+
+void
+hopscotch_reduction_free(struct hopscotch_reduction *red);
+
+/* Compute a Merkle-style fingerprint for each group in RES (a result
+ * from `hopscotch_solve_into` for T), covering the content hashes of
+ * its members and the fingerprints of every group it has an edge to,
+ * so it changes whenever anything the group transitively depends on
+ * changes. NODE_HASHES has a caller-provided 64-bit hash per node ID
+ * (RES->ID_LIMIT entries), and FINGERPRINTS gets one per group
+ * (RES->GROUP_COUNT entries). Since groups are in reverse topological
+ * order, this takes one pass over them.
+ *
+ * Fingerprints don't depend on node or group IDs, or on the order of
+ * members and edges, so they can be compared between runs where IDs
+ * were assigned differently. They're meant for cache keys, and aren't
+ * cryptographically strong. */
+bool
+hopscotch_fingerprint(struct hopscotch *t,
+    const struct hopscotch_result *res, const uint64_t *node_hashes,
+    uint64_t *fingerprints);
+
 /* Get the error for the HOPSCOTCH handle, if any. */
 enum hopscotch_error {
     HOPSCOTCH_ERROR_NONE,            /* no error */
     HOPSCOTCH_ERROR_MISUSE,          /* API misuse */
-    HOPSCOTCH_ERROR_MEMORY,          /* allocation failure */
+    HOPSCOTCH_ERROR_MEMORY,          /* allocation failure, or over limit */
     HOPSCOTCH_ERROR_RECURSION_DEPTH, /* exceeded recursion limit */
 };
 enum hopscotch_error
 hopscotch_error(struct hopscotch *t);
 
+/* Opaque handle to a solver, which holds all of the state used while
+ * solving a sealed graph. The graph itself is not modified, so several
+ * solvers (e.g. one per thread) can solve or query the same graph at
+ * the same time, and each solver can be reused for many solves.
+ *
+ * The functions above that take a `struct hopscotch *` use a solver
+ * owned by the handle, so they should only be used by one thread. */
+struct hopscotch_solver;
+
+/* Order of the members within each group. */
+enum hopscotch_member_order {
+    HOPSCOTCH_MEMBERS_SORTED,    /* ascending node ID (default) */
+    HOPSCOTCH_MEMBERS_STACK,     /* as popped off the stack, unsorted */
+    HOPSCOTCH_MEMBERS_DISCOVERY, /* order first reached by the search */
+};
+
+/* Algorithm used to find groups. Both find the same groups, in the
+ * same order, and (when sorted) with members in the same order.
+ *
+ * Tarjan's algorithm keeps an index, a lowlink, and an on-stack bit for
+ * every node ID, about 8.1 bytes each. Pearce's variant only keeps one
+ * 4-byte word, and only pushes nodes that aren't the root of their
+ * group, so it uses about half as much memory per node. Both also need
+ * 24 bytes per level of search depth, and 4 per stacked node. */
+enum hopscotch_engine {
+    HOPSCOTCH_ENGINE_TARJAN,     /* default */
+    HOPSCOTCH_ENGINE_PEARCE,     /* lower memory */
+};
+
+/* Configuration for a solver. Any fields left as 0 use the defaults. */
+struct hopscotch_solver_config {
+    /* Recursion limit, as in `hopscotch_solve`. */
+    size_t max_depth;
+    /* Only follow edges with a label in this mask, as in
+     * `hopscotch_solve_masked`. Defaults to HOPSCOTCH_LABEL_ALL. */
+    uint8_t label_mask;
+    /* Order for each group's members. Sorting uses a radix sort, so
+     * it's linear, but skipping it saves a pass over large groups. */
+    enum hopscotch_member_order member_order;
+    /* Algorithm to use. With HOPSCOTCH_ENGINE_PEARCE, the STACK and
+     * DISCOVERY member orders both put the group's first-visited
+     * node first, then the rest in reverse order of finishing. */
+    enum hopscotch_engine engine;
+};
+
+/* Allocate a new solver for the sealed graph T. CONFIG can be NULL.
+ * Returns NULL on error. The solver must be freed before T is. */
+struct hopscotch_solver *
+hopscotch_solver_new(struct hopscotch *t,
+    const struct hopscotch_solver_config *config);
+
+/* Free a solver. */
+void
+hopscotch_solver_free(struct hopscotch_solver *s);
+
+/* Solve the whole graph, as in `hopscotch_solve`. */
+bool
+hopscotch_solver_solve(struct hopscotch_solver *s,
+    hopscotch_solve_cb *cb, void *udata);
+
+/* Solve from a set of roots, as in `hopscotch_solve_from`. */
+bool
+hopscotch_solver_solve_from(struct hopscotch_solver *s,
+    size_t root_count, const uint32_t *roots,
+    hopscotch_solve_cb *cb, void *udata);
+
+/* Solve the whole graph into RES, as in `hopscotch_solve_into`. */
+bool
+hopscotch_solver_solve_into(struct hopscotch_solver *s,
+    struct hopscotch_result *res);
+
+/* Find the nodes affected by a set of changed nodes, as in
+ * `hopscotch_impact`. The groups and reverse edges built on the
+ * first query are shared by all of the graph's solvers, but the
+ * array returned in *AFFECTED belongs to S, and is only valid
+ * until its next impact query. */
+bool
+hopscotch_solver_impact(struct hopscotch_solver *s,
+    size_t changed_count, const uint32_t *changed,
+    size_t *affected_count, const uint32_t **affected);
+
+/* Like `hopscotch_get_successors`, but if the graph has been
+ * compressed or renumbered, the successors are decoded or mapped into
+ * a buffer owned by S, which is valid until S's next call to this (or
+ * until S is freed), so each thread can use its own solver. */
+bool
+hopscotch_solver_get_successors(struct hopscotch_solver *s,
+    uint32_t node_id, size_t *succ_count, const uint32_t **successors);
+
+/* Get the number of bytes currently allocated by the solver. */
+size_t
+hopscotch_solver_memory(const struct hopscotch_solver *s);
+
+/* Get the error for the solver, if any. */
+enum hopscotch_error
+hopscotch_solver_error(const struct hopscotch_solver *s);
+
+/* An iterator over a sealed graph's groups, which only does as much
+ * of the search as needed to find each next group. */
+struct hopscotch_iter;
+
+/* Allocate an iterator for the sealed graph T. CONFIG can be NULL.
+ * Returns NULL on error. The iterator must be freed before T is. */
+struct hopscotch_iter *
+hopscotch_iter_new(struct hopscotch *t,
+    const struct hopscotch_solver_config *config);
+
+/* Get the next group, in the same order as `hopscotch_solve` would
+ * report them. Sets *GROUP_ID, *COUNT, and *MEMBERS, and returns true;
+ * MEMBERS is only valid until the next call. Returns false once there
+ * are no groups left, or on error (see `hopscotch_iter_error`).
+ *
+ * It's fine to stop early, and free the iterator without finishing. */
+bool
+hopscotch_iter_next(struct hopscotch_iter *it, uint32_t *group_id,
+    size_t *count, const uint32_t **members);
+
+/* Get the payloads of the last group's members, in the same order,
+ * packed into one array owned by the iterator, which is only valid
+ * until the next call to `hopscotch_iter_next`. Returns NULL on
+ * allocation failure (see `hopscotch_iter_error`). */
+const void *
+hopscotch_iter_payloads(struct hopscotch_iter *it);
+
+/* Get the error for the iterator, if any. */
+enum hopscotch_error
+hopscotch_iter_error(const struct hopscotch_iter *it);
+
+/* Free an iterator. */
+void
+hopscotch_iter_free(struct hopscotch_iter *it);
+
+/* hopscotch_solve_many callback type -- like `hopscotch_solve_cb`,
+ * but also given the index of the graph the group belongs to. */
+typedef void
+hopscotch_solve_many_cb(size_t graph_index, uint32_t group_id,
+    size_t group_count, const uint32_t *group, void *udata);
+
+/* Solve COUNT independent, sealed graphs, spread over a pool of
+ * NTHREADS threads (or one per online CPU, if 0). Each thread solves
+ * whole graphs at a time, reusing its own buffers between them.
+ *
+ * CB may be called from several threads at once, but all of a graph's
+ * groups are reported in order, from the same thread. Every graph in
+ * GRAPHS must be distinct, and not otherwise in use until this returns.
+ *
+ * Returns true if every graph was solved. Otherwise, the error is set
+ * on each graph that failed, and the rest are still solved. */
+bool
+hopscotch_solve_many(size_t count, struct hopscotch *const *graphs,
+    size_t nthreads, hopscotch_solve_many_cb *cb, void *udata);
+
+/* Run TASK_CB once for each group of the sealed graph T, on a pool of
+ * NTHREADS threads (or one per online CPU, if 0), starting each group
+ * as soon as every group it has an edge to has finished. Groups and
+ * their IDs are the same as `hopscotch_impact` uses, and members are
+ * sorted.
+ *
+ * Each group has an atomic count of unfinished dependencies, and
+ * whichever thread finishes the last one queues it. Each thread has
+ * its own work-stealing deque (with room for every group, so 4 bytes
+ * per group per thread), and takes work from the others when idle,
+ * so there's no central lock or queue.
+ *
+ * TASK_CB is called from several threads at once. Returns false, and
+ * sets the handle's error, if the graph can't be solved. */
+bool
+hopscotch_execute(struct hopscotch *t, size_t nthreads,
+    hopscotch_solve_cb *task_cb, void *udata);
+
 #endif
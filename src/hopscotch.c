@@ -15,45 +15,141 @@ hopscotch_new(void) {
         return NULL;
     }
 
-    res->stack_ceil2 = DEF_STACK_CEIL2;
-    res->stack = calloc(1LLU << res->stack_ceil2, sizeof(res->stack[0]));
-    if (res->stack == NULL) {
-        free(res);
-        free(res->nodes);
-        return NULL;
-    }
-    res->stack_top = 0;
-
     const size_t node_count = 1LLU << res->node_ceil2;
     for (size_t i = 0; i < node_count; i++) {
         struct node n = {
             .id = i,
-            .index = NO_INDEX,
         };
         memcpy(&res->nodes[i], &n, sizeof(n));
     }
+    res->memory_used = sizeof(*res) + node_count * sizeof(res->nodes[0]);
+
+    if (pthread_mutex_init(&res->lock, NULL) != 0) {
+        free(res->nodes);
+        free(res);
+        return NULL;
+    }
 
     LOG("%s: returning %p\n", __func__, (void *)res);
     return res;
 }
 
 void hopscotch_free(struct hopscotch *t) {
+    /* Unused nodes may still have buffers, kept by `hopscotch_reset`. */
     const size_t node_ceil = (1LLU << t->node_ceil2);
     for (size_t i = 0; i < node_ceil; i++) {
         struct node *n = &t->nodes[i];
-        if (n->used) {
-            free(n->succ);
-        } else {
-            assert(n->succ == NULL);
-        }
+        free(n->succ);
+        free(n->labels);
     }
+    if (t->solver != NULL) { hopscotch_solver_free(t->solver); }
     free(t->nodes);
-    free(t->stack);
+    free(t->packed.buf);
+    free(t->ext_ids);
+    free(t->int_ids);
+    free(t->weights);
+    free(t->payloads);
+    free(t->name_bytes.buf);
+    free(t->name_offsets);
+    free(t->name_slots);
+    free(t->name_succ.buf);
+    free_condensation(t, t->cond);
+    free_shards(t);
+    pthread_mutex_destroy(&t->lock);
+    if (t->budget != NULL) { charge_memory(t->budget, t->memory_used, 0); }
     free(t);
 }
 
+void hopscotch_reset(struct hopscotch *t) {
+    assert(t);
+    LOG("%s: %p, id_limit %zu\n", __func__, (void *)t, t->id_limit);
+
+    /* Keep each node's successor (and label) buffers for reuse. Once
+     * compressed, nodes' successor arrays are freed, and their label
+     * arrays no longer match the new arrays' sizes, so free those too. */
+    for (size_t i = 0; i < t->id_limit; i++) {
+        struct node *n = &t->nodes[i];
+        n->used = false;
+        n->connected = false;
+        n->labeled = false;
+        n->succ_count = 0;
+        if (t->compressed) {
+            tracked_free(t, n->labels,
+                (1LLU << n->succ_ceil) * sizeof(n->labels[0]));
+            n->labels = NULL;
+        }
+    }
+    if (t->ext_ids != NULL) {
+        tracked_free(t, t->ext_ids, t->id_limit * sizeof(t->ext_ids[0]));
+        tracked_free(t, t->int_ids, t->id_limit * sizeof(t->int_ids[0]));
+        t->ext_ids = NULL;
+        t->int_ids = NULL;
+    }
+    t->id_limit = 0;
+    t->compressed = false;
+    t->packed.count = 0;
+    if (t->weights != NULL) {
+        memset(t->weights, 0x00, (1LLU << t->weight_ceil2) * sizeof(t->weights[0]));
+    }
+    if (t->payloads != NULL) {
+        memset(t->payloads, 0x00, (1LLU << t->payload_ceil2) * t->payload_size);
+    }
+    if (t->name_slots != NULL) {
+        memset(t->name_slots, 0x00,
+            (1LLU << t->name_slot_ceil2) * sizeof(t->name_slots[0]));
+    }
+    t->name_count = 0;
+    t->name_bytes.count = 0;
+
+    free_shards(t);
+    free_condensation(t, t->cond);
+    t->cond = NULL;
+    if (t->solver != NULL) { solver_clear_impact(t->solver); }
+
+    t->state = HOPSCOTCH_CREATED;
+    t->error = HOPSCOTCH_ERROR_NONE;
+}
+
+bool hopscotch_set_memory_limit(struct hopscotch *t, size_t bytes) {
+    assert(t);
+    if (bytes != 0 && __atomic_load_n(&t->memory_used, __ATOMIC_RELAXED) > bytes) {
+        t->error = HOPSCOTCH_ERROR_MEMORY;
+        return false;
+    }
+    __atomic_store_n(&t->memory_limit, bytes, __ATOMIC_RELAXED);
+    return true;
+}
+
+bool hopscotch_share_memory_limit(struct hopscotch *t,
+    struct hopscotch *owner) {
+    assert(t);
+    assert(owner);
+    if (t->budget != NULL || t == owner) {
+        t->error = HOPSCOTCH_ERROR_MISUSE;
+        return false;
+    }
+    if (!charge_memory(owner, 0, __atomic_load_n(&t->memory_used,
+                __ATOMIC_RELAXED))) {
+        t->error = HOPSCOTCH_ERROR_MEMORY;
+        return false;
+    }
+    t->budget = owner;
+    return true;
+}
+
+bool hopscotch_charge_memory(struct hopscotch *t,
+    size_t old_bytes, size_t new_bytes) {
+    assert(t);
+    return charge_memory(t, old_bytes, new_bytes);
+}
+
 bool hopscotch_add(struct hopscotch *t, uint32_t node_id,
     size_t succ_count, const uint32_t *successors) {
+    return hopscotch_add_labeled(t, node_id, succ_count, successors, NULL);
+}
+
+bool hopscotch_add_labeled(struct hopscotch *t, uint32_t node_id,
+    size_t succ_count, const uint32_t *successors, const uint8_t *labels) {
     assert(t);
     if (t->state != HOPSCOTCH_CREATED) {
         t->error = HOPSCOTCH_ERROR_MISUSE;
@@ -73,65 +169,141 @@ bool hopscotch_add(struct hopscotch *t, uint32_t node_id,
             return false;
         }
     }
+    if (max_node >= t->id_limit) { t->id_limit = max_node + 1; }
 
-    struct node *n = &t->nodes[node_id];
     const bool connected = (succ_count > 1
         || (succ_count == 1 && successors[0] != node_id));
 
-    if (n->succ == NULL) {  /* init node */
-        LOG("%s: initializing node %u, adding %zd successors\n",
-            __func__, node_id, succ_count);
-
-        uint8_t ceil2 = 1;
-        while ((1LLU << ceil2) < succ_count) { ceil2++; }
-        if (!init_node(t, node_id, ceil2, connected)) {
-            return false;
-        }
-
-        assert((1LLU << n->succ_ceil) >= succ_count);
-        memcpy(n->succ, successors,
-            succ_count * sizeof(uint32_t));
-        n->succ_count = succ_count;
+    if (!append_successors(t, node_id, succ_count, successors,
+            labels, connected)) {
+        t->error = HOPSCOTCH_ERROR_MEMORY;
+        return false;
+    }
 
+    /* If it isn't connected, its only possible successor is itself. */
+    if (connected) {
         for (size_t i = 0; i < succ_count; i++) {
-            if (!init_node(t, successors[i], 0, connected)) { return false; }
-        }
-    } else {
-        /* append, growing if necessary */
-        const size_t ncount = n->succ_count + succ_count;
-
-        if (ncount >= (1LLU << n->succ_ceil)) {
-            uint8_t nceil2 = n->succ_ceil + 1;
-            while ((1LLU << nceil2) < ncount) { nceil2++; }
-            const size_t nceil = 1LLU << nceil2;
-            uint32_t *nsucc = realloc(n->succ,
-                nceil * sizeof(*nsucc));
-            if (nsucc == NULL) {
+            if (!init_node(t, successors[i], 0, true)) {
                 t->error = HOPSCOTCH_ERROR_MEMORY;
                 return false;
             }
-            n->succ_ceil = nceil2;
-            n->succ = nsucc;
-        }
-        for (size_t i = 0; i < succ_count; i++) {
-            if (!init_node(t, successors[i], 0, connected)) { return false; }
-            n->succ[n->succ_count + i] = successors[i];
         }
-        n->succ_count += succ_count;
     }
 
 #ifdef USE_LOG
-    n = &t->nodes[node_id];     /* n may be stale, reload */
+    struct node *n = &t->nodes[node_id];
     LOG("%s: node %u: %zu successors:\n", __func__, n->id, n->succ_count);
     for (size_t i = 0; i < n->succ_count; i++) {
-        LOG(" -- %u: %u\n", node_id, n->succ[i]);
+        LOG(" -- %u: %u (label 0x%02x)\n", node_id, n->succ[i],
+            n->labeled ? n->labels[i] : HOPSCOTCH_LABEL_DEFAULT);
     }
 #endif
 
     return true;
 }
 
+struct hopscotch_shard *
+hopscotch_shard_new(struct hopscotch *t) {
+    assert(t);
+    struct hopscotch_shard *res = tracked_realloc(t, NULL, 0, sizeof(*res));
+    if (res == NULL) { return NULL; }
+    memset(res, 0x00, sizeof(*res));
+    res->t = t;
+
+    if (pthread_mutex_lock(&t->lock) != 0) {
+        tracked_free(t, res, sizeof(*res));
+        return NULL;
+    }
+
+    if (t->state != HOPSCOTCH_CREATED) {
+        pthread_mutex_unlock(&t->lock);
+        tracked_free(t, res, sizeof(*res));
+        return NULL;
+    }
+
+    /* Append, so shards are merged in the order they were created. */
+    if (t->shards_tail == NULL) {
+        t->shards = res;
+    } else {
+        t->shards_tail->next = res;
+    }
+    t->shards_tail = res;
+    t->shard_count++;
+
+    pthread_mutex_unlock(&t->lock);
+    LOG("%s: %p -> %p\n", __func__, (void *)t, (void *)res);
+    return res;
+}
+
+bool hopscotch_shard_add(struct hopscotch_shard *s, uint32_t node_id,
+    size_t succ_count, const uint32_t *successors) {
+    return hopscotch_shard_add_labeled(s, node_id,
+        succ_count, successors, NULL);
+}
+
+bool hopscotch_shard_add_labeled(struct hopscotch_shard *s,
+    uint32_t node_id, size_t succ_count, const uint32_t *successors,
+    const uint8_t *labels) {
+    assert(s);
+    if (s->error != HOPSCOTCH_ERROR_NONE) { return false; }
+    if (succ_count >= UINT32_MAX) {
+        s->error = HOPSCOTCH_ERROR_MISUSE;
+        return false;
+    }
+
+    const bool connected = (succ_count > 1
+        || (succ_count == 1 && successors[0] != node_id));
+
+    /* Record: node ID, successor count, whether labels follow in the
+     * partition's label vector, then the successors. */
+    struct shard_part *part = &s->parts[SHARD_PART_OF(node_id)];
+    if (!u32vec_reserve(s->t, &part->adds, 3 + succ_count)) { goto fail; }
+    uint32_t *rec = &part->adds.buf[part->adds.count];
+    rec[0] = node_id;
+    rec[1] = (uint32_t)succ_count;
+    rec[2] = (labels != NULL);
+    if (succ_count > 0) {
+        memcpy(&rec[3], successors, succ_count * sizeof(rec[0]));
+    }
+    part->adds.count += 3 + succ_count;
+
+    if (labels != NULL) {
+        if (!u8vec_reserve(s->t, &part->labels, succ_count)) { goto fail; }
+        memcpy(&part->labels.buf[part->labels.count], labels,
+            succ_count * sizeof(labels[0]));
+        part->labels.count += succ_count;
+    }
+
+    uint32_t max_node = node_id;
+    if (connected) {
+        /* Successors may belong to other partitions, so note them
+         * there, rather than touching their nodes during the merge. */
+        for (size_t i = 0; i < succ_count; i++) {
+            const uint32_t succ_id = successors[i];
+            if (succ_id > max_node) { max_node = succ_id; }
+            struct shard_part *spart = &s->parts[SHARD_PART_OF(succ_id)];
+            if (!u32vec_reserve(s->t, &spart->touches, 1)) { goto fail; }
+            spart->touches.buf[spart->touches.count++] = succ_id;
+        }
+    }
+
+    if (!s->has_nodes || max_node > s->max_id) { s->max_id = max_node; }
+    s->has_nodes = true;
+    return true;
+
+fail:
+    s->error = HOPSCOTCH_ERROR_MEMORY;
+    return false;
+}
+
 bool hopscotch_seal(struct hopscotch *t) {
+    if (t->state != HOPSCOTCH_CREATED) {
+        t->error = HOPSCOTCH_ERROR_MISUSE;
+        return false;
+    }
+
+    if (t->shards != NULL && !merge_shards(t)) { return false; }
+
     /* canonicalize: eliminate duplicates, sort, ? */
     t->state = HOPSCOTCH_SEALED;
     LOG("%s: %p\n", __func__, (void *)t);
@@ -146,262 +318,3230 @@ bool hopscotch_get_successors(struct hopscotch *t, uint32_t node_id,
     if (t->state != HOPSCOTCH_SEALED) { return false; }
 
     assert(node_id < (1LLU << t->node_ceil2));
-    struct node *n = &t->nodes[node_id];
-    *successors = n->succ;
-    *succ_count = n->succ_count;
+    if (!t->compressed && t->ext_ids == NULL) {
+        const struct node *n = &t->nodes[node_id];
+        *succ_count = n->succ_count;
+        *successors = n->succ;
+        return true;
+    }
+
+    /* Otherwise they're decoded or mapped into the handle's solver. */
+    struct hopscotch_solver *s = get_solver(t);
+    if (s == NULL) { return false; }
+    if (!hopscotch_solver_get_successors(s, node_id, succ_count, successors)) {
+        t->error = s->error;
+        return false;
+    }
     return true;
 }
 
-
-bool hopscotch_solve(struct hopscotch *t, size_t max_depth,
-    hopscotch_solve_cb *cb, void *udata) {
-    LOG("%s: %p -- ceil2 %u, state %d\n",
-        __func__, (void *)t, t->node_ceil2, t->state);
-    if (t->state != HOPSCOTCH_SEALED) {
+bool hopscotch_renumber(struct hopscotch *t, enum hopscotch_node_order order) {
+    assert(t);
+    if (t->state != HOPSCOTCH_SEALED || t->compressed) {
         t->error = HOPSCOTCH_ERROR_MISUSE;
         return false;
     }
+    const size_t id_limit = t->id_limit;
+    const size_t node_ceil = (1LLU << t->node_ceil2);
+    if (id_limit == 0) { return true; }
 
-    const uint8_t scc_buf_ceil = DEF_SCC_BUF_CEIL2;
-    uint32_t *buf = calloc(1LLU << scc_buf_ceil, sizeof(*buf));
-    if (buf == NULL) { return false; }
+    /* New position -> old ID, and old ID -> new position. */
+    const size_t id_bytes = id_limit * sizeof(uint32_t);
+    const size_t node_bytes = node_ceil * sizeof(t->nodes[0]);
+    uint32_t *by_pos = tracked_realloc(t, NULL, 0, id_bytes);
+    uint32_t *pos_of = tracked_realloc(t, NULL, 0, id_bytes);
+    struct node *nnodes = tracked_realloc(t, NULL, 0, node_bytes);
+    if (by_pos == NULL || pos_of == NULL || nnodes == NULL
+        || !order_nodes(t, order, by_pos, pos_of)) {
+        tracked_free(t, by_pos, id_bytes);
+        tracked_free(t, pos_of, id_bytes);
+        tracked_free(t, nnodes, node_bytes);
+        t->error = HOPSCOTCH_ERROR_MEMORY;
+        return false;
+    }
 
-    if (max_depth == 0) { max_depth = HOPSCOTCH_SOLVE_DEFAULT_MAX_DEPTH; }
+    /* Move each node (and its buffers) to its new position, and
+     * rewrite its successors' IDs. */
+    for (size_t i = 0; i < node_ceil; i++) {
+        const struct node *o = &t->nodes[i < id_limit ? by_pos[i] : i];
+        struct node n = {
+            .id = i,
+            .succ_ceil = o->succ_ceil,
+            .used = o->used,
+            .connected = o->connected,
+            .labeled = o->labeled,
+            .succ_count = o->succ_count,
+            .succ = o->succ,
+            .labels = o->labels,
+        };
+        for (size_t si = 0; si < n.succ_count; si++) {
+            n.succ[si] = pos_of[n.succ[si]];
+        }
+        memcpy(&nnodes[i], &n, sizeof(n));
+    }
+    tracked_free(t, t->nodes, node_bytes);
+    t->nodes = nnodes;
 
-    struct solve_env env = {
-        .t = t,
-        .scc_buf_ceil = scc_buf_ceil,
-        .scc_buf = buf,
-        .max_depth = max_depth,
-        .cb = cb,
-        .udata = udata,
-    };
+    /* Compose with any earlier renumbering, then invert. */
+    if (t->ext_ids != NULL) {
+        for (size_t i = 0; i < id_limit; i++) {
+            by_pos[i] = t->ext_ids[by_pos[i]];
+        }
+    }
+    for (size_t i = 0; i < id_limit; i++) { pos_of[by_pos[i]] = i; }
+    if (t->ext_ids != NULL) {
+        tracked_free(t, t->ext_ids, id_bytes);
+        tracked_free(t, t->int_ids, id_bytes);
+    }
+    t->ext_ids = by_pos;
+    t->int_ids = pos_of;
+    LOG("%s: renumbered %zu IDs\n", __func__, id_limit);
+    return true;
+}
 
-    const size_t node_ceil = (1LLU << t->node_ceil2);
+bool hopscotch_compress(struct hopscotch *t) {
+    assert(t);
+    if (t->state != HOPSCOTCH_SEALED) {
+        t->error = HOPSCOTCH_ERROR_MISUSE;
+        return false;
+    }
+    if (t->compressed) { return true; }
 
-    /* First pass: emit any nodes that have no references to them */
-    for (size_t i = 0; i < node_ceil; i++) {
-        if (!t->nodes[i].used) { continue; }
-        if (!t->nodes[i].connected) { report_disconnected(&env, i); }
+    /* Scratch space for sorting a node's successors with their labels. */
+    size_t max_count = 0;
+    for (size_t i = 0; i < t->id_limit; i++) {
+        const struct node *n = &t->nodes[i];
+        if (n->used && n->succ_count > max_count) { max_count = n->succ_count; }
+    }
+    const size_t pairs_bytes = (max_count + 1) * sizeof(uint64_t);
+    uint64_t *pairs = tracked_realloc(t, NULL, 0, pairs_bytes);
+    if (pairs == NULL) {
+        t->error = HOPSCOTCH_ERROR_MEMORY;
+        return false;
     }
 
-    for (size_t i = 0; i < node_ceil; i++) {
-        if (!t->nodes[i].used) { continue; }
-        if (!strongconnect(&env, i, 0)) {
-            LOG("%s: strongconnect failure\n", __func__);
-            free(env.scc_buf);
+    /* Pack everything before freeing anything, so the graph is still
+     * usable (if sorted) when running out of memory part way. */
+    t->packed.count = 0;
+    for (size_t i = 0; i < t->id_limit; i++) {
+        struct node *n = &t->nodes[i];
+        if (!n->used) { continue; }
+        if (!pack_node(t, n, pairs)) {
+            tracked_free(t, pairs, pairs_bytes);
+            t->error = HOPSCOTCH_ERROR_MEMORY;
             return false;
         }
     }
+    tracked_free(t, pairs, pairs_bytes);
 
-    free(env.scc_buf);
+    /* succ_ceil is kept, since it's still the size of the labels. */
+    for (size_t i = 0; i < t->id_limit; i++) {
+        struct node *n = &t->nodes[i];
+        tracked_free(t, n->succ, (1LLU << n->succ_ceil) * sizeof(n->succ[0]));
+        n->succ = NULL;
+    }
+    t->compressed = true;
+    LOG("%s: packed into %zu bytes\n", __func__, t->packed.count);
     return true;
 }
 
-enum hopscotch_error
-hopscotch_error(struct hopscotch *t) {
-    return t->error;
+size_t hopscotch_memory(const struct hopscotch *t) {
+    const size_t node_ceil = (1LLU << t->node_ceil2);
+    size_t res = sizeof(*t) + node_ceil * sizeof(t->nodes[0]);
+    for (size_t i = 0; i < node_ceil; i++) {
+        const struct node *n = &t->nodes[i];
+        const size_t ceil = (1LLU << n->succ_ceil);
+        if (n->succ != NULL) { res += ceil * sizeof(n->succ[0]); }
+        if (n->labels != NULL) { res += ceil * sizeof(n->labels[0]); }
+    }
+    if (t->packed.buf != NULL) { res += (1LLU << t->packed.ceil2); }
+    if (t->ext_ids != NULL) {
+        res += 2 * t->id_limit * sizeof(t->ext_ids[0]);
+    }
+    if (t->weights != NULL) {
+        res += (1LLU << t->weight_ceil2) * sizeof(t->weights[0]);
+    }
+    if (t->payloads != NULL) {
+        res += (1LLU << t->payload_ceil2) * t->payload_size;
+    }
+    if (t->name_bytes.buf != NULL) { res += (1LLU << t->name_bytes.ceil2); }
+    if (t->name_offsets != NULL) {
+        res += (1LLU << t->name_offset_ceil2) * sizeof(t->name_offsets[0]);
+    }
+    if (t->name_slots != NULL) {
+        res += (1LLU << t->name_slot_ceil2) * sizeof(t->name_slots[0]);
+    }
+    return res;
 }
 
-static bool init_node(struct hopscotch *t, uint32_t node_id,
-    uint8_t hint, bool connected) {
-    if (hint == 0) { hint = DEF_SUCC_CEIL2; }
-    assert(node_id < (1LLU << t->node_ceil2));
-    struct node *n = &t->nodes[node_id];
-    if (n->succ != NULL) {
-        LOG("%s: already initialized, returning\n", __func__);
-        if (connected) { n->connected = true; }
-        return true;
-    }
 
-    uint32_t *succ = calloc(1LLU << hint, sizeof(uint32_t));
-    if (succ == NULL) {
-        t->error = HOPSCOTCH_ERROR_MEMORY;
+bool hopscotch_solve(struct hopscotch *t, size_t max_depth,
+    hopscotch_solve_cb *cb, void *udata) {
+    return hopscotch_solve_masked(t, HOPSCOTCH_LABEL_ALL,
+        max_depth, cb, udata);
+}
+
+bool hopscotch_solve_masked(struct hopscotch *t, uint8_t label_mask,
+    size_t max_depth, hopscotch_solve_cb *cb, void *udata) {
+    LOG("%s: %p -- ceil2 %u, state %d, mask 0x%02x\n",
+        __func__, (void *)t, t->node_ceil2, t->state, label_mask);
+    struct hopscotch_solver *s = get_solver(t);
+    if (s == NULL) { return false; }
+
+    if (!solve_all(s, label_mask, max_depth, cb, udata, NULL)) {
+        t->error = s->error;
         return false;
     }
-    n->succ = succ;
-    n->succ_ceil = hint;
-    n->succ_count = 0;
-    n->used = true;
-    n->connected = connected;
     return true;
 }
 
-static bool grow_nodes(struct hopscotch *t, uint32_t new_max_id) {
-    uint8_t nceil2 = t->node_ceil2;
-    while ((1LLU << nceil2) <= new_max_id) {
-        nceil2++;
-    }
-    const size_t ncount = 1LLU << nceil2;
-    const size_t nsize = ncount * sizeof(t->nodes[0]);
+bool hopscotch_solve_from(struct hopscotch *t,
+    size_t root_count, const uint32_t *roots, size_t max_depth,
+    hopscotch_solve_cb *cb, void *udata) {
+    LOG("%s: %p -- %zu roots, state %d\n",
+        __func__, (void *)t, root_count, t->state);
+    struct hopscotch_solver *s = get_solver(t);
+    if (s == NULL) { return false; }
 
-    struct node *nnodes = realloc(t->nodes, nsize);
-    LOG("%s: growing from %u to %u, %p\n",
-        __func__, t->node_ceil2, nceil2, (void *)nnodes);
-    if (nnodes == NULL) {
-        t->error = HOPSCOTCH_ERROR_MEMORY;
+    if (!solve_roots(s, root_count, roots,
+            HOPSCOTCH_LABEL_ALL, max_depth, cb, udata)) {
+        t->error = s->error;
         return false;
     }
+    return true;
+}
 
-    const size_t ocount = (1LLU << t->node_ceil2);
-    for (size_t i = ocount; i < ncount; i++) {
-        struct node n = {
-            .id = i,
-            .index = NO_INDEX,
-        };
-        memcpy(&nnodes[i], &n, sizeof(n));
+bool hopscotch_result_size(struct hopscotch *t,
+    size_t *id_limit, size_t *node_count) {
+    assert(id_limit);
+    assert(node_count);
+    if (t->state != HOPSCOTCH_SEALED) {
+        t->error = HOPSCOTCH_ERROR_MISUSE;
+        return false;
     }
+    *id_limit = t->id_limit;
+    *node_count = count_nodes(t);
+    return true;
+}
 
-    t->nodes = nnodes;
-    t->node_ceil2 = nceil2;
+bool hopscotch_solve_into(struct hopscotch *t, struct hopscotch_result *res) {
+    struct hopscotch_solver *s = get_solver(t);
+    if (s == NULL) { return false; }
+
+    if (!solve_all(s, HOPSCOTCH_LABEL_ALL, 0, NULL, NULL, res)) {
+        t->error = s->error;
+        return false;
+    }
     return true;
 }
 
-static void report_disconnected(struct solve_env *env, uint32_t node_id) {
-    struct node *n = &env->t->nodes[node_id];
-    if (env->cb != NULL) {
-        uint32_t buf[1] = { n->id, };
-        env->cb(env->scc_id, 1, buf, env->udata);
+void hopscotch_result_free(struct hopscotch_result *res) {
+    assert(res);
+    if (res->owned & (1U << RESULT_NODE_GROUP)) {
+        free(res->node_group);
+        res->node_group = NULL;
     }
-    env->scc_id++;
-    n->used = false;
-    free(n->succ);
-    n->succ = NULL;
+    if (res->owned & (1U << RESULT_GROUP_OFFSETS)) {
+        free(res->group_offsets);
+        res->group_offsets = NULL;
+    }
+    if (res->owned & (1U << RESULT_MEMBERS)) {
+        free(res->members);
+        res->members = NULL;
+    }
+    res->owned = 0;
 }
 
-#define MIN(X, Y) (X < Y ? X : Y)
+enum hopscotch_verify_res
+hopscotch_verify(struct hopscotch *t, const struct hopscotch_result *res) {
+    assert(res);
+    if (t->state != HOPSCOTCH_SEALED || res->id_limit != t->id_limit
+        || res->node_group == NULL || res->group_offsets == NULL
+        || res->members == NULL) {
+        return HOPSCOTCH_VERIFY_MISUSE;
+    }
 
-static int cmp_uint32_t(const void *va, const void *vb) {
-    uint32_t a = *(const uint32_t *)va;
-    uint32_t b = *(const uint32_t *)vb;
-    return (a < b ? -1 : a > b ? 1 : 0);
-}
+    const size_t id_limit = t->id_limit;
+    enum hopscotch_verify_res vres = HOPSCOTCH_VERIFY_ERROR_MEMORY;
 
-static bool strongconnect(struct solve_env *env,
-    uint32_t node_id, size_t depth) {
-    LOG("%s: node_id %u\n", __func__, node_id);
+    /* Count the scratch space against the memory limit up front. */
+    size_t scratch = (id_limit/64 + 1) * sizeof(uint64_t)
+        + (id_limit + 2 + res->node_count + 1) * sizeof(uint32_t);
+    if (t->ext_ids != NULL) {
+        scratch += (id_limit + res->node_count + 1) * sizeof(uint32_t);
+    }
+    if (!charge_memory(t, 0, scratch)) { return HOPSCOTCH_VERIFY_ERROR_MEMORY; }
 
-    if (depth >= env->max_depth) {
-        env->t->error = HOPSCOTCH_ERROR_RECURSION_DEPTH;
-        return false;
+    /* If renumbered, check a copy using the graph's internal IDs. */
+    struct hopscotch_result internal = *res;
+    internal.owned = 0;
+    if (t->ext_ids != NULL) {
+        internal.node_group = malloc(id_limit * sizeof(internal.node_group[0]));
+        internal.members = malloc((res->node_count + 1)
+            * sizeof(internal.members[0]));
+        internal.owned = (1U << RESULT_NODE_GROUP) | (1U << RESULT_MEMBERS);
+        if (internal.node_group == NULL || internal.members == NULL) {
+            hopscotch_result_free(&internal);
+            charge_memory(t, scratch, 0);
+            return HOPSCOTCH_VERIFY_ERROR_MEMORY;
+        }
+        for (size_t i = 0; i < id_limit; i++) {
+            internal.node_group[i] = res->node_group[t->ext_ids[i]];
+        }
+        for (size_t i = 0; i < res->node_count; i++) {
+            internal.members[i] = to_internal(t, res->members[i]);
+        }
+        res = &internal;
     }
 
-    struct hopscotch *t = env->t;
-    struct node *n = &t->nodes[node_id];
-    assert(n->id == node_id);
-    assert(n->used);
+    uint64_t *seen = calloc(id_limit/64 + 1, sizeof(seen[0]));
+    uint32_t *rev_offsets = calloc(id_limit + 2, sizeof(rev_offsets[0]));
+    uint32_t *rev = NULL;
+    struct u32vec decoded = { .ceil2 = 0 };
+    uint32_t *queue = malloc((res->node_count + 1) * sizeof(queue[0]));
+    if (seen == NULL || rev_offsets == NULL || queue == NULL) { goto cleanup; }
 
-    if (n->index != NO_INDEX) {
-        LOG("%s: already processed\n", __func__);
-        return true;            /* node already processed */
-    } else {
-        assert(n->index == NO_INDEX);
-        assert(n->lowlink == 0);
-        n->index = t->index;
-        n->lowlink = t->index;
-        t->index++;
-        if (!push_node(t, node_id)) { return false; }
+    vres = verify_members(t, res, seen);
+    if (vres != HOPSCOTCH_VERIFY_OK) { goto cleanup; }
 
-        LOG("%s: processing node %u, (index %u, lowlink %u, succ_count %zu)\n",
-            __func__, node_id, n->index, n->lowlink, n->succ_count);
+    vres = verify_edges(t, res, rev_offsets, &decoded);
+    if (vres != HOPSCOTCH_VERIFY_OK) { goto cleanup; }
 
-        /* consider successors of node */
+    /* Fill in the reversed edges within each group. */
+    const size_t rev_bytes = ((size_t)rev_offsets[id_limit + 1] + 1)
+        * sizeof(rev[0]);
+    if (!charge_memory(t, 0, rev_bytes)) {
+        vres = HOPSCOTCH_VERIFY_ERROR_MEMORY;
+        goto cleanup;
+    }
+    scratch += rev_bytes;
+    rev = malloc(rev_bytes);
+    if (rev == NULL) {
+        vres = HOPSCOTCH_VERIFY_ERROR_MEMORY;
+        goto cleanup;
+    }
+    for (size_t i = 0; i < id_limit; i++) {
+        const struct node *n = &t->nodes[i];
+        if (!n->used) { continue; }
+        const uint32_t g = res->node_group[i];
+        const uint32_t *succ = get_succ(t, n, &decoded);
+        if (succ == NULL && n->succ_count > 0) {
+            vres = HOPSCOTCH_VERIFY_ERROR_MEMORY;
+            goto cleanup;
+        }
         for (size_t si = 0; si < n->succ_count; si++) {
-            uint32_t s_id = n->succ[si];
-            assert(s_id < (1LLU << t->node_ceil2));
-
-            struct node *s = &t->nodes[s_id];
+            const uint32_t v = succ[si];
+            if (res->node_group[v] == g) {
+                rev[rev_offsets[v + 1]++] = i;
+            }
+        }
+    }
 
-            LOG("%s: checking successor %u\n", __func__, s_id);
+    memset(seen, 0x00, (id_limit/64 + 1) * sizeof(seen[0]));
+    vres = verify_connected(t, res, rev_offsets, rev, seen, queue, &decoded);
 
-            if (s->index == NO_INDEX) {
-                /* not yet visited -- recurse on it */
-                LOG("%s: not yet visited, recursing\n", __func__);
-                if (!strongconnect(env, s_id, depth + 1)) {
-                    return false;
-                }
+cleanup:
+    charge_memory(t, scratch, 0);
+    hopscotch_result_free(&internal);
+    u32vec_free(t, &decoded);
+    free(seen);
+    free(rev_offsets);
+    free(rev);
+    free(queue);
+    return vres;
+}
 
-                n->lowlink = MIN(n->lowlink, s->lowlink);
-                LOG("%s: node %u lowlink now %u\n", __func__, n->id, n->lowlink);
-            } else if (is_stacked(t, s_id)) {
-                LOG("%s: successor already stacked\n", __func__);
+/* Check that the groups cover every node exactly once, and agree
+ * with node_group. */
+static enum hopscotch_verify_res verify_members(const struct hopscotch *t,
+    const struct hopscotch_result *res, uint64_t *seen) {
+    if (res->node_count != count_nodes(t)
+        || res->group_offsets[0] != 0
+        || res->group_offsets[res->group_count] != res->node_count) {
+        return HOPSCOTCH_VERIFY_BAD_MEMBERS;
+    }
 
-                /* "Note: The next line may look odd - but is correct.
-                 * It says w.index not w.lowlink; that is deliberate
-                 * and from the original paper." where 'w' is 's') */
-                n->lowlink = MIN(n->lowlink, s->index);
-                LOG("%s: node %u lowlink now %u\n", __func__, n->id, n->lowlink);
-            }
+    for (uint32_t g = 0; g < res->group_count; g++) {
+        const uint32_t start = res->group_offsets[g];
+        const uint32_t end = res->group_offsets[g + 1];
+        if (end <= start || end > res->node_count) {
+            return HOPSCOTCH_VERIFY_BAD_MEMBERS;
         }
-
-        /* If n is a root node, then pop the stack and generate an SCC. */
-        if (n->lowlink == n->index) {
-            /* start a new SCC */
-            LOG("%s: root node found, starting group\n", __func__);
-
-            size_t used = 0;
-            uint32_t edge;
-            do {
-                edge = pop_node(t);
-                assert(edge < (1LLU << t->node_ceil2));
-                if (used >= (1LLU << env->scc_buf_ceil)) {
-                    uint8_t nceil = env->scc_buf_ceil + 1;
-                    uint32_t *nbuf = realloc(env->scc_buf,
-                        (1LLU << nceil) * sizeof(*nbuf));
-                    if (nbuf == NULL) { return false; }
-                    env->scc_buf_ceil = nceil;
-                    env->scc_buf = nbuf;
-                }
-                env->scc_buf[used] = edge;
-                used++;
-                LOG("%s: added node %u, %zd in group\n",
-                    __func__, edge, used);
-            } while (edge != node_id);
-
-            /* Sorting could be optional, but commenting out sorting has
-             * very little impact on benchmarks. */
-            qsort(env->scc_buf, used, sizeof(env->scc_buf[0]), cmp_uint32_t);
-
-            /* Note: The SCCs are output in reverse topological order. */
-            if (env->cb) {
-                env->cb(env->scc_id, used, env->scc_buf, env->udata);
+        for (uint32_t mi = start; mi < end; mi++) {
+            const uint32_t id = res->members[mi];
+            if (id >= t->id_limit || !t->nodes[id].used
+                || get_bit(seen, id) || res->node_group[id] != g) {
+                return HOPSCOTCH_VERIFY_BAD_MEMBERS;
             }
-            env->scc_id++;
+            set_bit(seen, id);
         }
-        return true;
     }
+    return HOPSCOTCH_VERIFY_OK;
 }
 
-static bool is_stacked(struct hopscotch *t, uint32_t node_id) {
-    return t->nodes[node_id].stacked;
-}
+/* Check that no edge leads to a later group, and count the edges
+ * within groups into each node (in REV_OFFSETS[id + 2], so they
+ * end up as offsets at REV_OFFSETS[id + 1] after summing). */
+static enum hopscotch_verify_res verify_edges(struct hopscotch *t,
+    const struct hopscotch_result *res, uint32_t *rev_offsets,
+    struct u32vec *decoded) {
+    const size_t id_limit = t->id_limit;
+    for (size_t i = 0; i < id_limit; i++) {
+        const struct node *n = &t->nodes[i];
+        if (!n->used) { continue; }
+        const uint32_t g = res->node_group[i];
+        const uint32_t *succ = get_succ(t, n, decoded);
+        if (succ == NULL && n->succ_count > 0) {
+            return HOPSCOTCH_VERIFY_ERROR_MEMORY;
+        }
+        for (size_t si = 0; si < n->succ_count; si++) {
+            const uint32_t h = res->node_group[succ[si]];
+            if (h > g) { return HOPSCOTCH_VERIFY_BAD_ORDER; }
+            if (h == g) { rev_offsets[succ[si] + 2]++; }
+        }
+    }
+    for (size_t i = 2; i < id_limit + 2; i++) {
+        rev_offsets[i] += rev_offsets[i - 1];
+    }
+    return HOPSCOTCH_VERIFY_OK;
+}
+
+/* Check that every member of each group can reach, and be reached from,
+ * its first member, using only edges within the group. */
+static enum hopscotch_verify_res verify_connected(struct hopscotch *t,
+    const struct hopscotch_result *res, const uint32_t *rev_offsets,
+    const uint32_t *rev, uint64_t *seen, uint32_t *queue,
+    struct u32vec *decoded) {
+    for (uint32_t g = 0; g < res->group_count; g++) {
+        const uint32_t start = res->group_offsets[g];
+        const uint32_t end = res->group_offsets[g + 1];
+        const uint32_t size = end - start;
+        if (size == 1) { continue; }
+
+        for (int backward = 0; backward < 2; backward++) {
+            size_t head = 0, tail = 0;
+            queue[tail++] = res->members[start];
+            set_bit(seen, res->members[start]);
+            while (head < tail) {
+                const uint32_t id = queue[head++];
+                const uint32_t *edges;
+                size_t edge_count;
+                if (backward) {
+                    edges = &rev[rev_offsets[id]];
+                    edge_count = rev_offsets[id + 1] - rev_offsets[id];
+                } else {
+                    edges = get_succ(t, &t->nodes[id], decoded);
+                    edge_count = t->nodes[id].succ_count;
+                    if (edges == NULL && edge_count > 0) {
+                        return HOPSCOTCH_VERIFY_ERROR_MEMORY;
+                    }
+                }
+                for (size_t ei = 0; ei < edge_count; ei++) {
+                    const uint32_t v = edges[ei];
+                    if (res->node_group[v] != g || get_bit(seen, v)) { continue; }
+                    set_bit(seen, v);
+                    queue[tail++] = v;
+                }
+            }
+
+            for (size_t i = 0; i < tail; i++) { clear_bit(seen, queue[i]); }
+            if (tail != size) { return HOPSCOTCH_VERIFY_NOT_CONNECTED; }
+        }
+    }
+    return HOPSCOTCH_VERIFY_OK;
+}
+
+bool hopscotch_set_weight(struct hopscotch *t, uint32_t node_id,
+    uint64_t weight) {
+    assert(t);
+    if (t->weights == NULL || node_id >= (1LLU << t->weight_ceil2)) {
+        const size_t old_ceil = (t->weights == NULL
+            ? 0 : (1LLU << t->weight_ceil2));
+        uint8_t nceil2 = (t->weights == NULL
+            ? t->node_ceil2 : t->weight_ceil2 + 1);
+        while ((1LLU << nceil2) <= node_id) { nceil2++; }
+        uint64_t *nweights = tracked_realloc(t, t->weights,
+            old_ceil * sizeof(nweights[0]),
+            (1LLU << nceil2) * sizeof(nweights[0]));
+        if (nweights == NULL) {
+            t->error = HOPSCOTCH_ERROR_MEMORY;
+            return false;
+        }
+        memset(&nweights[old_ceil], 0x00,
+            ((1LLU << nceil2) - old_ceil) * sizeof(nweights[0]));
+        t->weights = nweights;
+        t->weight_ceil2 = nceil2;
+    }
+    t->weights[node_id] = weight;
+    return true;
+}
+
+bool hopscotch_set_payload_size(struct hopscotch *t, size_t size) {
+    assert(t);
+    if (t->payloads != NULL) {
+        t->error = HOPSCOTCH_ERROR_MISUSE;
+        return false;
+    }
+    t->payload_size = size;
+    return true;
+}
+
+bool hopscotch_set_payload(struct hopscotch *t, uint32_t node_id,
+    const void *payload) {
+    assert(t);
+    assert(payload);
+    if (t->payload_size == 0) { t->payload_size = sizeof(void *); }
+    const size_t size = t->payload_size;
+    if (t->payloads == NULL || node_id >= (1LLU << t->payload_ceil2)) {
+        const size_t old_ceil = (t->payloads == NULL
+            ? 0 : (1LLU << t->payload_ceil2));
+        uint8_t nceil2 = (t->payloads == NULL
+            ? t->node_ceil2 : t->payload_ceil2 + 1);
+        while ((1LLU << nceil2) <= node_id) { nceil2++; }
+        uint8_t *npayloads = tracked_realloc(t, t->payloads,
+            old_ceil * size, (1LLU << nceil2) * size);
+        if (npayloads == NULL) {
+            t->error = HOPSCOTCH_ERROR_MEMORY;
+            return false;
+        }
+        memset(&npayloads[old_ceil * size], 0x00,
+            ((1LLU << nceil2) - old_ceil) * size);
+        t->payloads = npayloads;
+        t->payload_ceil2 = nceil2;
+    }
+    memcpy(&t->payloads[node_id * size], payload, size);
+    return true;
+}
+
+const void *hopscotch_payload(const struct hopscotch *t, uint32_t node_id) {
+    assert(t);
+    if (t->payloads == NULL || node_id >= (1LLU << t->payload_ceil2)) {
+        return NULL;
+    }
+    return &t->payloads[node_id * t->payload_size];
+}
+
+bool hopscotch_gather_payloads(struct hopscotch *t,
+    const struct hopscotch_result *res, void *out) {
+    assert(res);
+    assert(out);
+    if (res->id_limit != t->id_limit) {
+        t->error = HOPSCOTCH_ERROR_MISUSE;
+        return false;
+    }
+    copy_payloads(t, res->node_count, res->members, out);
+    return true;
+}
+
+/* Copy the payloads for COUNT node IDs into OUT, with zeroes for
+ * any beyond the payload array. */
+static void copy_payloads(const struct hopscotch *t, size_t count,
+    const uint32_t *ids, uint8_t *out) {
+    const size_t size = (t->payload_size ? t->payload_size : sizeof(void *));
+    const size_t limit = (t->payloads == NULL ? 0 : (1LLU << t->payload_ceil2));
+    for (size_t i = 0; i < count; i++) {
+        if (ids[i] < limit) {
+            memcpy(&out[i * size], &t->payloads[ids[i] * size], size);
+        } else {
+            memset(&out[i * size], 0x00, size);
+        }
+    }
+}
+
+bool hopscotch_intern(struct hopscotch *t, const char *name, size_t len,
+    uint32_t *node_id) {
+    assert(t);
+    assert(name || len == 0);
+    const uint64_t hash = hash_name(name, len);
+    size_t slot = find_name(t, name, len, hash);
+    if (t->name_slots != NULL && t->name_slots[slot].offset != 0) {
+        if (node_id != NULL) {
+            memcpy(node_id, &t->name_bytes.buf[t->name_slots[slot].offset
+                    - sizeof(*node_id)], sizeof(*node_id));
+        }
+        return true;
+    }
+
+    /* Not interned yet, so give it the next ID. */
+    const uint32_t id = t->name_count;
+    if (id == UINT32_MAX || len >= UINT32_MAX) {
+        t->error = HOPSCOTCH_ERROR_MISUSE;
+        return false;
+    }
+    if (t->name_offsets == NULL || id + 2 > (1LLU << t->name_offset_ceil2)) {
+        const uint8_t nceil2 = (t->name_offsets == NULL
+            ? t->node_ceil2 : t->name_offset_ceil2 + 1);
+        const size_t old_ceil = (t->name_offsets == NULL
+            ? 0 : (1LLU << t->name_offset_ceil2));
+        size_t *noffsets = tracked_realloc(t, t->name_offsets,
+            old_ceil * sizeof(noffsets[0]),
+            (1LLU << nceil2) * sizeof(noffsets[0]));
+        if (noffsets == NULL) { goto fail; }
+        if (t->name_offsets == NULL) { noffsets[0] = 0; }
+        t->name_offsets = noffsets;
+        t->name_offset_ceil2 = nceil2;
+    }
+    if (!u8vec_reserve(t, &t->name_bytes, sizeof(id) + len + 1)) { goto fail; }
+    if (t->name_slots == NULL
+        || 2LLU * (id + 1) > (1LLU << t->name_slot_ceil2)) {
+        if (!grow_name_slots(t)) { goto fail; }
+        slot = find_name(t, name, len, hash);
+    }
+
+    uint8_t *dst = &t->name_bytes.buf[t->name_bytes.count];
+    memcpy(dst, &id, sizeof(id));
+    if (len > 0) { memcpy(&dst[sizeof(id)], name, len); }
+    dst[sizeof(id) + len] = '\0';
+    const struct name_slot ns = {
+        .tag = hash >> 32,
+        .len = len,
+        .offset = t->name_bytes.count + sizeof(id),
+    };
+    t->name_slots[slot] = ns;
+    t->name_bytes.count += sizeof(id) + len + 1;
+    t->name_offsets[id + 1] = t->name_bytes.count;
+    t->name_count++;
+    if (node_id != NULL) { *node_id = id; }
+    return true;
+
+fail:
+    t->error = HOPSCOTCH_ERROR_MEMORY;
+    return false;
+}
+
+bool hopscotch_add_named(struct hopscotch *t, const char *name, size_t len,
+    size_t succ_count, const char *const *names, const size_t *lens) {
+    assert(t);
+    assert(names || succ_count == 0);
+    assert(lens || succ_count == 0);
+    if (t->state != HOPSCOTCH_CREATED) {
+        t->error = HOPSCOTCH_ERROR_MISUSE;
+        return false;
+    }
+
+    uint32_t node_id;
+    if (!hopscotch_intern(t, name, len, &node_id)) { return false; }
+    t->name_succ.count = 0;
+    if (!u32vec_reserve(t, &t->name_succ, succ_count)) {
+        t->error = HOPSCOTCH_ERROR_MEMORY;
+        return false;
+    }
+    for (size_t i = 0; i < succ_count; i++) {
+        if (!hopscotch_intern(t, names[i], lens[i], &t->name_succ.buf[i])) {
+            return false;
+        }
+    }
+    return hopscotch_add(t, node_id, succ_count, t->name_succ.buf);
+}
+
+const char *hopscotch_name(const struct hopscotch *t, uint32_t node_id,
+    size_t *len) {
+    assert(t);
+    if (node_id >= t->name_count) { return NULL; }
+    const size_t offset = t->name_offsets[node_id] + sizeof(node_id);
+    if (len != NULL) { *len = t->name_offsets[node_id + 1] - offset - 1; }
+    return (const char *)&t->name_bytes.buf[offset];
+}
+
+/* Hash a name a word at a time, mixing in its length first. */
+static uint64_t hash_name(const char *name, size_t len) {
+    uint64_t h = mix64(len + 1);
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t w;
+        memcpy(&w, &name[i], sizeof(w));
+        h = mix64(h ^ w);
+    }
+    uint64_t w = 0;
+    if (i < len) { memcpy(&w, &name[i], len - i); }
+    return mix64(h ^ w);
+}
+
+/* Find the slot for a name: either the slot holding it, or the empty
+ * slot where it would go. The upper 32 bits of the hash, kept in each
+ * slot, also pick the starting slot, so the index can grow without
+ * rehashing the names. */
+static size_t find_name(const struct hopscotch *t, const char *name,
+    size_t len, uint64_t hash) {
+    if (t->name_slots == NULL) { return 0; }
+    const size_t mask = (1LLU << t->name_slot_ceil2) - 1;
+    const uint32_t tag = hash >> 32;
+    for (size_t slot = tag & mask; ; slot = (slot + 1) & mask) {
+        const struct name_slot *ns = &t->name_slots[slot];
+        if (ns->offset == 0) { return slot; }
+        if (ns->tag == tag && ns->len == len && (len == 0
+                || 0 == memcmp(&t->name_bytes.buf[ns->offset], name, len))) {
+            return slot;
+        }
+    }
+}
+
+/* Double the name index, so it stays at most half full. */
+static bool grow_name_slots(struct hopscotch *t) {
+    const uint8_t nceil2 = (t->name_slots == NULL
+        ? DEF_NAME_SLOT_CEIL2 : t->name_slot_ceil2 + 1);
+    const size_t bytes = (1LLU << nceil2) * sizeof(struct name_slot);
+    struct name_slot *nslots = tracked_realloc(t, NULL, 0, bytes);
+    if (nslots == NULL) { return false; }
+    memset(nslots, 0x00, bytes);
+    const size_t mask = (1LLU << nceil2) - 1;
+    const size_t old_count = (t->name_slots == NULL
+        ? 0 : (1LLU << t->name_slot_ceil2));
+    for (size_t i = 0; i < old_count; i++) {
+        const struct name_slot *ns = &t->name_slots[i];
+        if (ns->offset == 0) { continue; }
+        size_t slot = ns->tag & mask;
+        while (nslots[slot].offset != 0) { slot = (slot + 1) & mask; }
+        nslots[slot] = *ns;
+    }
+    tracked_free(t, t->name_slots, old_count * sizeof(nslots[0]));
+    t->name_slots = nslots;
+    t->name_slot_ceil2 = nceil2;
+    return true;
+}
+
+bool hopscotch_critical_path(struct hopscotch *t,
+    const struct hopscotch_result *res, struct hopscotch_critical_path *cp) {
+    assert(res);
+    assert(cp);
+    if (t->state != HOPSCOTCH_SEALED || res->id_limit != t->id_limit) {
+        t->error = HOPSCOTCH_ERROR_MISUSE;
+        return false;
+    }
+
+    const uint32_t group_count = res->group_count;
+    memset(cp, 0x00, sizeof(*cp));
+    struct u32vec decoded = { .ceil2 = 0 };
+    const size_t via_bytes = ((size_t)group_count + 1) * sizeof(uint32_t);
+    uint32_t *via = tracked_realloc(t, NULL, 0, via_bytes);
+    cp->finish = malloc((group_count + 1) * sizeof(cp->finish[0]));
+    cp->path = malloc((group_count + 1) * sizeof(cp->path[0]));
+    if (via == NULL || cp->finish == NULL || cp->path == NULL) { goto fail; }
+    cp->group_count = group_count;
+
+    /* Every group a group depends on comes before it, so each finish
+     * time is known by the time anything needs it. */
+    uint32_t last = HOPSCOTCH_NO_GROUP;
+    for (uint32_t g = 0; g < group_count; g++) {
+        uint64_t start = 0;
+        via[g] = HOPSCOTCH_NO_GROUP;
+        for (uint32_t mi = res->group_offsets[g];
+             mi < res->group_offsets[g + 1]; mi++) {
+            const struct node *n = &t->nodes[to_internal(t, res->members[mi])];
+            const uint32_t *succ = get_succ(t, n, &decoded);
+            if (succ == NULL && n->succ_count > 0) { goto fail; }
+            for (size_t si = 0; si < n->succ_count; si++) {
+                const uint32_t h = res->node_group[to_external(t, succ[si])];
+                if (h >= g) { continue; }
+                if (cp->finish[h] > start || via[g] == HOPSCOTCH_NO_GROUP) {
+                    start = cp->finish[h];
+                    via[g] = h;
+                }
+            }
+        }
+        cp->finish[g] = start + group_weight(t, res, g);
+        if (last == HOPSCOTCH_NO_GROUP || cp->finish[g] > cp->finish[last]) {
+            last = g;
+        }
+    }
+
+    /* Walk back from the latest finishing group, then reverse. */
+    if (last != HOPSCOTCH_NO_GROUP) {
+        cp->total = cp->finish[last];
+        for (uint32_t g = last; g != HOPSCOTCH_NO_GROUP; g = via[g]) {
+            cp->path[cp->path_length++] = g;
+        }
+        for (uint32_t i = 0; i < cp->path_length / 2; i++) {
+            const uint32_t tmp = cp->path[i];
+            cp->path[i] = cp->path[cp->path_length - 1 - i];
+            cp->path[cp->path_length - 1 - i] = tmp;
+        }
+    }
+
+    tracked_free(t, via, via_bytes);
+    u32vec_free(t, &decoded);
+    return true;
+
+fail:
+    tracked_free(t, via, via_bytes);
+    u32vec_free(t, &decoded);
+    hopscotch_critical_path_free(cp);
+    t->error = HOPSCOTCH_ERROR_MEMORY;
+    return false;
+}
+
+void hopscotch_critical_path_free(struct hopscotch_critical_path *cp) {
+    assert(cp);
+    free(cp->finish);
+    free(cp->path);
+    cp->finish = NULL;
+    cp->path = NULL;
+}
+
+bool hopscotch_reduce(struct hopscotch *t,
+    const struct hopscotch_result *res, struct hopscotch_reduction *red) {
+    assert(res);
+    assert(red);
+    if (t->state != HOPSCOTCH_SEALED || res->id_limit != t->id_limit) {
+        t->error = HOPSCOTCH_ERROR_MISUSE;
+        return false;
+    }
+
+    const uint32_t group_count = res->group_count;
+    memset(red, 0x00, sizeof(*red));
+    const size_t offsets_bytes = ((size_t)group_count + 1) * sizeof(uint32_t);
+    uint32_t *offsets = NULL;
+    struct u32vec edges = { .ceil2 = 0 };
+    bool *redundant = NULL;
+    uint64_t *rows = NULL;
+    size_t redundant_bytes = 0, rows_bytes = 0;
+    if (!group_edges(t, res, &offsets, &edges)) { goto fail; }
+    const uint32_t edge_count = offsets[group_count];
+
+    redundant_bytes = ((size_t)edge_count + 1) * sizeof(bool);
+    redundant = tracked_realloc(t, NULL, 0, redundant_bytes);
+    if (redundant == NULL) { goto fail; }
+    memset(redundant, 0x00, redundant_bytes);
+
+    /* Each block of target groups needs a row for every group
+     * from the start of the block on. Under a memory limit, blocks
+     * shrink to fit what's left, at the cost of more passes. */
+    size_t block_bytes = REDUCE_BLOCK_BYTES;
+    const size_t limit = __atomic_load_n(&t->memory_limit, __ATOMIC_RELAXED);
+    if (limit != 0) {
+        const size_t in_use = __atomic_load_n(&t->memory_used, __ATOMIC_RELAXED);
+        const size_t avail = (limit > in_use ? limit - in_use : 0);
+        if (avail < block_bytes) { block_bytes = avail; }
+    }
+    size_t words = block_bytes / ((size_t)group_count + 1) / 8;
+    if (words < 1) { words = 1; }
+    if (words > group_count/64 + 1) { words = group_count/64 + 1; }
+    rows_bytes = ((size_t)group_count + 1) * words * sizeof(rows[0]);
+    rows = tracked_realloc(t, NULL, 0, rows_bytes);
+    if (rows == NULL) { goto fail; }
+
+    for (uint64_t lo = 0; lo < group_count; lo += 64 * words) {
+        const uint64_t hi = (lo + 64 * words < group_count
+            ? lo + 64 * words : group_count);
+        reduce_block(offsets, edges.buf, group_count, lo, hi, words,
+            rows, redundant);
+    }
+    tracked_free(t, rows, rows_bytes);
+    rows = NULL;
+
+    /* Compact the kept edges in place. */
+    uint32_t used = 0;
+    for (uint32_t g = 0; g < group_count; g++) {
+        const uint32_t start = offsets[g];
+        offsets[g] = used;
+        for (uint32_t ei = start; ei < offsets[g + 1]; ei++) {
+            if (!redundant[ei]) { edges.buf[used++] = edges.buf[ei]; }
+        }
+    }
+    offsets[group_count] = used;
+    tracked_free(t, redundant, redundant_bytes);
+
+    /* The caller owns these now, and `hopscotch_reduction_free`
+     * doesn't know about T, so stop counting them. */
+    charge_memory(t, offsets_bytes
+        + (1LLU << edges.ceil2) * sizeof(edges.buf[0]), 0);
+    red->group_count = group_count;
+    red->offsets = offsets;
+    red->edges = edges.buf;
+    red->removed = edge_count - used;
+    LOG("%s: %u groups, kept %u of %u edges\n",
+        __func__, group_count, used, edge_count);
+    return true;
+
+fail:
+    tracked_free(t, offsets, offsets_bytes);
+    u32vec_free(t, &edges);
+    tracked_free(t, redundant, redundant_bytes);
+    tracked_free(t, rows, rows_bytes);
+    t->error = HOPSCOTCH_ERROR_MEMORY;
+    return false;
+}
+
+void hopscotch_reduction_free(struct hopscotch_reduction *red) {
+    assert(red);
+    free(red->offsets);
+    free(red->edges);
+    red->offsets = NULL;
+    red->edges = NULL;
+}
+
+bool hopscotch_fingerprint(struct hopscotch *t,
+    const struct hopscotch_result *res, const uint64_t *node_hashes,
+    uint64_t *fingerprints) {
+    assert(res);
+    assert(node_hashes);
+    assert(fingerprints);
+    if (t->state != HOPSCOTCH_SEALED || res->id_limit != t->id_limit) {
+        t->error = HOPSCOTCH_ERROR_MISUSE;
+        return false;
+    }
+
+    const uint32_t group_count = res->group_count;
+    struct u32vec decoded = { .ceil2 = 0 };
+    const size_t mark_bytes = ((size_t)group_count + 1) * sizeof(uint32_t);
+    uint32_t *mark = tracked_realloc(t, NULL, 0, mark_bytes);
+    if (mark == NULL) {
+        t->error = HOPSCOTCH_ERROR_MEMORY;
+        return false;
+    }
+    for (uint32_t g = 0; g < group_count; g++) { mark[g] = NO_INDEX; }
+
+    /* Members and dependencies are each combined by summing their
+     * mixed hashes, which doesn't depend on their order. Dependencies
+     * always come earlier, so their fingerprints are already done. */
+    for (uint32_t g = 0; g < group_count; g++) {
+        uint64_t members = 0, deps = 0;
+        const uint32_t count = res->group_offsets[g + 1] - res->group_offsets[g];
+        for (uint32_t mi = res->group_offsets[g];
+             mi < res->group_offsets[g + 1]; mi++) {
+            const uint32_t id = res->members[mi];
+            members += mix64(node_hashes[id]);
+
+            const struct node *n = &t->nodes[to_internal(t, id)];
+            const uint32_t *succ = get_succ(t, n, &decoded);
+            if (succ == NULL && n->succ_count > 0) {
+                tracked_free(t, mark, mark_bytes);
+                u32vec_free(t, &decoded);
+                t->error = HOPSCOTCH_ERROR_MEMORY;
+                return false;
+            }
+            for (size_t si = 0; si < n->succ_count; si++) {
+                const uint32_t h = res->node_group[to_external(t, succ[si])];
+                if (h >= g || mark[h] == g) { continue; }
+                mark[h] = g;
+                deps += mix64(fingerprints[h] ^ 0x9e3779b97f4a7c15LLU);
+            }
+        }
+        fingerprints[g] = mix64(mix64(members + count) ^ deps);
+    }
+
+    tracked_free(t, mark, mark_bytes);
+    u32vec_free(t, &decoded);
+    return true;
+}
+
+/* The 64-bit finalizer from MurmurHash3. */
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdLLU;
+    x ^= x >> 33;
+    x *= 0xc4ceb3fe1a85ec53LLU;
+    x ^= x >> 33;
+    return x;
+}
+
+/* Collect each group's distinct edges to earlier groups, as offsets
+ * and edges arrays, with each group's edges in descending order.
+ * Both are counted against T's limit: OFFSETS has a slot per group,
+ * plus one, and EDGES (which should start out empty) is a vector. */
+static bool group_edges(struct hopscotch *t,
+    const struct hopscotch_result *res, uint32_t **offsets,
+    struct u32vec *edges) {
+    const uint32_t group_count = res->group_count;
+    struct u32vec decoded = { .ceil2 = 0 };
+    const size_t group_bytes = ((size_t)group_count + 1) * sizeof(uint32_t);
+    uint32_t *mark = tracked_realloc(t, NULL, 0, group_bytes);
+    *offsets = tracked_realloc(t, NULL, 0, group_bytes);
+    if (mark == NULL || *offsets == NULL) { goto fail; }
+    for (uint32_t g = 0; g < group_count; g++) { mark[g] = NO_INDEX; }
+
+    for (uint32_t g = 0; g < group_count; g++) {
+        (*offsets)[g] = edges->count;
+        for (uint32_t mi = res->group_offsets[g];
+             mi < res->group_offsets[g + 1]; mi++) {
+            const struct node *n = &t->nodes[to_internal(t, res->members[mi])];
+            const uint32_t *succ = get_succ(t, n, &decoded);
+            if (succ == NULL && n->succ_count > 0) { goto fail; }
+            if (!u32vec_reserve(t, edges, n->succ_count)) { goto fail; }
+            for (size_t si = 0; si < n->succ_count; si++) {
+                const uint32_t h = res->node_group[to_external(t, succ[si])];
+                if (h >= g || mark[h] == g) { continue; }
+                mark[h] = g;
+                edges->buf[edges->count++] = h;
+            }
+        }
+
+        /* Descending, by insertion sort; edge lists are short. */
+        uint32_t *e = &edges->buf[(*offsets)[g]];
+        const size_t count = edges->count - (*offsets)[g];
+        for (size_t i = 1; i < count; i++) {
+            const uint32_t v = e[i];
+            size_t j = i;
+            for (; j > 0 && e[j - 1] < v; j--) { e[j] = e[j - 1]; }
+            e[j] = v;
+        }
+    }
+    (*offsets)[group_count] = edges->count;
+    if (edges->buf == NULL && !u32vec_reserve(t, edges, 1)) { goto fail; }
+    tracked_free(t, mark, group_bytes);
+    u32vec_free(t, &decoded);
+    return true;
+
+fail:
+    tracked_free(t, mark, group_bytes);
+    u32vec_free(t, &decoded);
+    u32vec_free(t, edges);
+    tracked_free(t, *offsets, group_bytes);
+    *offsets = NULL;
+    return false;
+}
+
+/* Mark redundant edges into target groups in [LO, HI). Row G - LO of
+ * ROWS is the set of targets in the block reachable from group G;
+ * groups before LO can't reach any of them, so have no row. Since
+ * edges are in descending order, by the time an edge to H is checked,
+ * everything reachable through the group's later edges is in its row,
+ * and any path to H must go through a later group. */
+static void reduce_block(const uint32_t *offsets, const uint32_t *edges,
+    uint32_t group_count, uint32_t lo, uint32_t hi, size_t words,
+    uint64_t *rows, bool *redundant) {
+    for (uint32_t g = lo; g < group_count; g++) {
+        uint64_t *row = &rows[(size_t)(g - lo) * words];
+        memset(row, 0x00, words * sizeof(row[0]));
+        for (uint32_t ei = offsets[g]; ei < offsets[g + 1]; ei++) {
+            const uint32_t h = edges[ei];
+            if (h < lo) { break; }      /* the rest are too */
+            if (h < hi) {
+                if (get_bit(row, h - lo)) {
+                    redundant[ei] = true;
+                    continue;           /* already OR'd in */
+                }
+                set_bit(row, h - lo);
+            }
+            const uint64_t *hrow = &rows[(size_t)(h - lo) * words];
+            for (size_t w = 0; w < words; w++) { row[w] |= hrow[w]; }
+        }
+    }
+}
+
+static uint64_t group_weight(const struct hopscotch *t,
+    const struct hopscotch_result *res, uint32_t g) {
+    if (t->weights == NULL) { return 0; }
+    const size_t limit = (1LLU << t->weight_ceil2);
+    uint64_t sum = 0;
+    for (uint32_t mi = res->group_offsets[g];
+         mi < res->group_offsets[g + 1]; mi++) {
+        const uint32_t id = res->members[mi];
+        if (id < limit) { sum += t->weights[id]; }
+    }
+    return sum;
+}
+
+bool hopscotch_impact(struct hopscotch *t,
+    size_t changed_count, const uint32_t *changed,
+    size_t *affected_count, const uint32_t **affected) {
+    struct hopscotch_solver *s = get_solver(t);
+    if (s == NULL) { return false; }
+
+    if (!hopscotch_solver_impact(s, changed_count, changed,
+            affected_count, affected)) {
+        t->error = s->error;
+        return false;
+    }
+    return true;
+}
+
+struct hopscotch_solver *
+hopscotch_solver_new(struct hopscotch *t,
+    const struct hopscotch_solver_config *config) {
+    assert(t);
+    if (t->state != HOPSCOTCH_SEALED) { return NULL; }
+    return new_solver(t, config);
+}
+
+/* Allocate a solver for T, which may be rebound to another graph
+ * later (see `solver_fit`). */
+static struct hopscotch_solver *
+new_solver(struct hopscotch *t,
+    const struct hopscotch_solver_config *config) {
+    struct hopscotch_solver *res = calloc(1, sizeof(*res));
+    if (res == NULL) { return NULL; }
+    res->t = t;
+
+#define DEF(FIELD, DEFAULT) (config && config->FIELD ? config->FIELD : DEFAULT)
+    const size_t max_depth = DEF(max_depth, HOPSCOTCH_SOLVE_DEFAULT_MAX_DEPTH);
+    const uint8_t label_mask = DEF(label_mask, HOPSCOTCH_LABEL_ALL);
+    const enum hopscotch_member_order member_order =
+        DEF(member_order, HOPSCOTCH_MEMBERS_SORTED);
+    const enum hopscotch_engine engine = DEF(engine, HOPSCOTCH_ENGINE_TARJAN);
+#undef DEF
+
+    res->max_depth = max_depth;
+    res->label_mask = label_mask;
+    res->member_order = member_order;
+    res->engine = engine;
+    res->next_component = NO_INDEX - 1;
+
+    res->stack_ceil2 = DEF_STACK_CEIL2;
+    res->stack = solver_realloc(res, NULL, 0,
+        (1LLU << res->stack_ceil2) * sizeof(res->stack[0]));
+    res->scc_buf_ceil = DEF_SCC_BUF_CEIL2;
+    res->scc_buf = solver_realloc(res, NULL, 0,
+        (1LLU << res->scc_buf_ceil) * sizeof(res->scc_buf[0]));
+    res->visited_ceil = DEF_VISITED_CEIL2;
+    res->visited = solver_realloc(res, NULL, 0,
+        (1LLU << res->visited_ceil) * sizeof(res->visited[0]));
+    res->frame_ceil2 = DEF_FRAME_CEIL2;
+    res->frames = solver_realloc(res, NULL, 0,
+        (1LLU << res->frame_ceil2) * sizeof(res->frames[0]));
+
+    if (res->stack == NULL || res->scc_buf == NULL || res->visited == NULL
+        || res->frames == NULL || !solver_fit(res)) {
+        hopscotch_solver_free(res);
+        return NULL;
+    }
+
+    LOG("%s: returning %p\n", __func__, (void *)res);
+    return res;
+}
+
+void hopscotch_solver_free(struct hopscotch_solver *s) {
+    free(s->index);
+    free(s->lowlink);
+    free(s->stacked);
+    free(s->stack);
+    free(s->scc_buf);
+    free(s->sort_tmp);
+    free(s->visited);
+    free(s->frames);
+    free(s->succ_buf.buf);
+    solver_clear_impact(s);
+    charge_memory(s->t, s->charged, 0);
+    free(s);
+}
+
+bool hopscotch_solver_solve(struct hopscotch_solver *s,
+    hopscotch_solve_cb *cb, void *udata) {
+    assert(s);
+    return solve_all(s, s->label_mask, s->max_depth, cb, udata, NULL);
+}
+
+bool hopscotch_solver_solve_from(struct hopscotch_solver *s,
+    size_t root_count, const uint32_t *roots,
+    hopscotch_solve_cb *cb, void *udata) {
+    assert(s);
+    return solve_roots(s, root_count, roots,
+        s->label_mask, s->max_depth, cb, udata);
+}
+
+bool hopscotch_solver_solve_into(struct hopscotch_solver *s,
+    struct hopscotch_result *res) {
+    assert(s);
+    return solve_all(s, s->label_mask, s->max_depth, NULL, NULL, res);
+}
+
+bool hopscotch_solver_get_successors(struct hopscotch_solver *s,
+    uint32_t node_id, size_t *succ_count, const uint32_t **successors) {
+    assert(s);
+    assert(successors);
+    assert(succ_count);
+    struct hopscotch *t = s->t;
+    assert(node_id < s->node_ceil);
+    const struct node *n = &t->nodes[to_internal(t, node_id)];
+    *succ_count = n->succ_count;
+    if (n->succ_count == 0 || (!t->compressed && t->ext_ids == NULL)) {
+        *successors = n->succ;
+        return true;
+    }
+
+    /* Decode them into the solver's buffer, and map them back, copying
+     * them there first if they weren't compressed. */
+    s->succ_buf.count = 0;
+    if (!solver_u32vec_reserve(s, &s->succ_buf, n->succ_count)) {
+        s->error = HOPSCOTCH_ERROR_MEMORY;
+        return false;
+    }
+    const uint32_t *succ = get_succ(t, n, &s->succ_buf);
+    if (t->ext_ids != NULL) {
+        for (size_t i = 0; i < n->succ_count; i++) {
+            s->succ_buf.buf[i] = to_external(t, succ[i]);
+        }
+    }
+    *successors = s->succ_buf.buf;
+    return true;
+}
+
+bool hopscotch_solver_impact(struct hopscotch_solver *s,
+    size_t changed_count, const uint32_t *changed,
+    size_t *affected_count, const uint32_t **affected) {
+    assert(s);
+    assert(affected_count);
+    assert(affected);
+    struct hopscotch *t = s->t;
+
+    for (size_t i = 0; i < changed_count; i++) {
+        if (changed[i] >= s->node_ceil
+            || !t->nodes[to_internal(t, changed[i])].used) {
+            s->error = HOPSCOTCH_ERROR_MISUSE;
+            return false;
+        }
+    }
+
+    const struct condensation *c = get_condensation(s);
+    if (c == NULL) { return false; }
+
+    if (s->impact_seen == NULL) {
+        const size_t seen_bytes = (c->group_count/64 + 1)
+            * sizeof(s->impact_seen[0]);
+        const size_t queue_bytes = ((size_t)c->group_count + 1)
+            * sizeof(s->impact_queue[0]);
+        const size_t affected_bytes =
+            ((size_t)c->group_offsets[c->group_count] + 1)
+            * sizeof(s->impact_affected[0]);
+        const size_t before = s->charged;
+        s->impact_seen = solver_realloc(s, NULL, 0, seen_bytes);
+        if (s->impact_seen != NULL) { memset(s->impact_seen, 0x00, seen_bytes); }
+        s->impact_queue = solver_realloc(s, NULL, 0, queue_bytes);
+        s->impact_affected = solver_realloc(s, NULL, 0, affected_bytes);
+        s->impact_bytes = s->charged - before;
+        if (s->impact_seen == NULL || s->impact_queue == NULL
+            || s->impact_affected == NULL) {
+            solver_clear_impact(s);
+            s->error = HOPSCOTCH_ERROR_MEMORY;
+            return false;
+        }
+    }
+    uint64_t *seen = s->impact_seen;
+    uint32_t *queue = s->impact_queue;
+
+    /* Breadth-first search backward from the changed nodes' groups.
+     * The queue doubles as the list of affected groups, and every
+     * bit set in seen gets cleared afterward, so the cost only
+     * depends on the size of the affected region. */
+    size_t head = 0, tail = 0;
+    for (size_t i = 0; i < changed_count; i++) {
+        const uint32_t g = c->node_group[changed[i]];
+        if (!get_bit(seen, g)) {
+            set_bit(seen, g);
+            queue[tail++] = g;
+        }
+    }
+
+    while (head < tail) {
+        const uint32_t g = queue[head++];
+        for (uint32_t ri = c->rev_offsets[g]; ri < c->rev_offsets[g + 1]; ri++) {
+            const uint32_t p = c->rev[ri];
+            if (!get_bit(seen, p)) {
+                set_bit(seen, p);
+                queue[tail++] = p;
+            }
+        }
+    }
+
+    size_t used = 0;
+    for (size_t qi = 0; qi < tail; qi++) {
+        const uint32_t g = queue[qi];
+        const uint32_t start = c->group_offsets[g];
+        const uint32_t count = c->group_offsets[g + 1] - start;
+        memcpy(&s->impact_affected[used], &c->members[start],
+            count * sizeof(s->impact_affected[0]));
+        used += count;
+        clear_bit(seen, g);
+    }
+
+    LOG("%s: %zu changed -> %zu groups, %zu nodes affected\n",
+        __func__, changed_count, tail, used);
+    *affected_count = used;
+    *affected = s->impact_affected;
+    return true;
+}
+
+size_t hopscotch_solver_memory(const struct hopscotch_solver *s) {
+    size_t res = sizeof(*s);
+    res += s->node_ceil * sizeof(s->index[0]);
+    if (s->lowlink != NULL) { res += s->node_ceil * sizeof(s->lowlink[0]); }
+    if (s->stacked != NULL) {
+        res += (s->node_ceil/64 + 1) * sizeof(s->stacked[0]);
+    }
+    res += (1LLU << s->stack_ceil2) * sizeof(s->stack[0]);
+    res += (1LLU << s->scc_buf_ceil) * sizeof(s->scc_buf[0]);
+    if (s->sort_tmp != NULL) {
+        res += (1LLU << s->sort_tmp_ceil2) * sizeof(s->sort_tmp[0]);
+    }
+    res += (1LLU << s->frame_ceil2) * sizeof(s->frames[0]);
+    res += (1LLU << s->visited_ceil) * sizeof(s->visited[0]);
+    if (s->succ_buf.buf != NULL) {
+        res += (1LLU << s->succ_buf.ceil2) * sizeof(s->succ_buf.buf[0]);
+    }
+    return res;
+}
+
+enum hopscotch_error
+hopscotch_solver_error(const struct hopscotch_solver *s) {
+    return s->error;
+}
+
+enum hopscotch_error
+hopscotch_error(struct hopscotch *t) {
+    return t->error;
+}
+
+static bool init_node(struct hopscotch *t, uint32_t node_id,
+    uint8_t hint, bool connected) {
+    if (hint == 0) { hint = DEF_SUCC_CEIL2; }
+    assert(node_id < (1LLU << t->node_ceil2));
+    struct node *n = &t->nodes[node_id];
+    if (n->used) {
+        LOG("%s: already initialized, returning\n", __func__);
+        if (connected) { n->connected = true; }
+        return true;
+    }
+
+    /* Reuse the buffer, if it was kept by `hopscotch_reset`. */
+    if (n->succ == NULL) {
+        const size_t bytes = (1LLU << hint) * sizeof(uint32_t);
+        uint32_t *succ = tracked_realloc(t, NULL, 0, bytes);
+        if (succ == NULL) { return false; }
+        memset(succ, 0x00, bytes);
+        n->succ = succ;
+        n->succ_ceil = hint;
+    }
+    n->succ_count = 0;
+    n->used = true;
+    n->connected = connected;
+    return true;
+}
+
+/* Allocate N's label vector (unless one was kept by `hopscotch_reset`),
+ * with the same ceiling as its successors. Any edges it already has get
+ * the default label. */
+static bool init_labels(struct hopscotch *t, struct node *n) {
+    assert(!n->labeled);
+    if (n->labels == NULL) {
+        uint8_t *labels = tracked_realloc(t, NULL, 0,
+            (1LLU << n->succ_ceil) * sizeof(*labels));
+        if (labels == NULL) { return false; }
+        n->labels = labels;
+    }
+    memset(n->labels, HOPSCOTCH_LABEL_DEFAULT, n->succ_count * sizeof(n->labels[0]));
+    n->labeled = true;
+    return true;
+}
+
+/* Add successors (and their labels, if any) to a node, initializing
+ * it if necessary. This only touches the node itself, not its
+ * successors, so it's safe to call from shard merging threads.
+ * Returns false on allocation failure, without setting T's error. */
+static bool append_successors(struct hopscotch *t, uint32_t node_id,
+    size_t succ_count, const uint32_t *successors, const uint8_t *labels,
+    bool connected) {
+    assert(node_id < (1LLU << t->node_ceil2));
+    uint8_t ceil2 = 1;
+    while ((1LLU << ceil2) < succ_count) { ceil2++; }
+    if (!init_node(t, node_id, ceil2, connected)) { return false; }
+    if (succ_count == 0) { return true; }
+
+    struct node *n = &t->nodes[node_id];
+    const size_t ncount = n->succ_count + succ_count;
+
+    if (ncount > (1LLU << n->succ_ceil)) { /* grow */
+        uint8_t nceil2 = n->succ_ceil + 1;
+        while ((1LLU << nceil2) < ncount) { nceil2++; }
+        const size_t ceil = 1LLU << n->succ_ceil;
+        const size_t nceil = 1LLU << nceil2;
+        uint32_t *nsucc = tracked_realloc(t, n->succ,
+            ceil * sizeof(*nsucc), nceil * sizeof(*nsucc));
+        if (nsucc == NULL) { return false; }
+        n->succ = nsucc;
+
+        if (n->labels != NULL) {
+            uint8_t *nlabels = tracked_realloc(t, n->labels,
+                ceil * sizeof(*nlabels), nceil * sizeof(*nlabels));
+            if (nlabels == NULL) {
+                /* Shrink the successors back to match succ_ceil. */
+                uint32_t *osucc = tracked_realloc(t, nsucc,
+                    nceil * sizeof(*nsucc), ceil * sizeof(*nsucc));
+                if (osucc != NULL) { n->succ = osucc; }
+                return false;
+            }
+            n->labels = nlabels;
+        }
+        n->succ_ceil = nceil2;
+    }
+
+    if (labels != NULL && !n->labeled) {
+        if (!init_labels(t, n)) { return false; }
+    }
+
+    memcpy(&n->succ[n->succ_count], successors,
+        succ_count * sizeof(n->succ[0]));
+    if (n->labeled) {
+        if (labels != NULL) {
+            memcpy(&n->labels[n->succ_count], labels,
+                succ_count * sizeof(n->labels[0]));
+        } else {
+            memset(&n->labels[n->succ_count], HOPSCOTCH_LABEL_DEFAULT,
+                succ_count * sizeof(n->labels[0]));
+        }
+    }
+    n->succ_count = ncount;
+    return true;
+}
+
+static bool grow_nodes(struct hopscotch *t, uint32_t new_max_id) {
+    uint8_t nceil2 = t->node_ceil2;
+    while ((1LLU << nceil2) <= new_max_id) {
+        nceil2++;
+    }
+    const size_t ncount = 1LLU << nceil2;
+    const size_t nsize = ncount * sizeof(t->nodes[0]);
+    const size_t ocount = (1LLU << t->node_ceil2);
+
+    struct node *nnodes = tracked_realloc(t, t->nodes,
+        ocount * sizeof(t->nodes[0]), nsize);
+    LOG("%s: growing from %u to %u, %p\n",
+        __func__, t->node_ceil2, nceil2, (void *)nnodes);
+    if (nnodes == NULL) {
+        t->error = HOPSCOTCH_ERROR_MEMORY;
+        return false;
+    }
+
+    for (size_t i = ocount; i < ncount; i++) {
+        struct node n = {
+            .id = i,
+        };
+        memcpy(&nnodes[i], &n, sizeof(n));
+    }
+
+    t->nodes = nnodes;
+    t->node_ceil2 = nceil2;
+    return true;
+}
+
+/* Sort and dedup a node's successors (ORing together duplicate edges'
+ * labels), then append them to t->packed: the first as a zigzag-encoded
+ * offset from the node's own ID, the rest as the gap from the previous
+ * successor minus one, each as a little-endian base-128 varint. */
+static bool pack_node(struct hopscotch *t, struct node *n, uint64_t *pairs) {
+    for (size_t i = 0; i < n->succ_count; i++) {
+        pairs[i] = ((uint64_t)n->succ[i] << 8)
+            | (n->labeled ? n->labels[i] : 0);
+    }
+    qsort(pairs, n->succ_count, sizeof(pairs[0]), cmp_uint64_t);
+
+    size_t count = 0;
+    for (size_t i = 0; i < n->succ_count; i++) {
+        const uint32_t id = pairs[i] >> 8;
+        const uint8_t label = pairs[i] & 0xff;
+        if (count > 0 && n->succ[count - 1] == id) {
+            if (n->labeled) { n->labels[count - 1] |= label; }
+            continue;
+        }
+        n->succ[count] = id;
+        if (n->labeled) { n->labels[count] = label; }
+        count++;
+    }
+    n->succ_count = count;
+
+    if (!u8vec_reserve(t, &t->packed, 5 * count)) { return false; }
+    n->packed = t->packed.count;
+    size_t pos = t->packed.count;
+    uint32_t prev = n->id;
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t id = n->succ[i];
+        if (i == 0) {
+            const int32_t delta = (int32_t)(id - prev);
+            pack_varint(t->packed.buf, &pos,
+                ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+        } else {
+            pack_varint(t->packed.buf, &pos, id - prev - 1);
+        }
+        prev = id;
+    }
+    assert(pos - n->packed < NO_INDEX);
+    t->packed.count = pos;
+    return true;
+}
+
+static void pack_varint(uint8_t *buf, size_t *pos, uint32_t v) {
+    size_t p = *pos;
+    while (v >= 0x80) {
+        buf[p++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    buf[p++] = v;
+    *pos = p;
+}
+
+/* Decode the successor after prev, advancing *pos. */
+static uint32_t unpack_succ(const uint8_t *buf, uint32_t *pos,
+    uint32_t prev, bool first) {
+    uint32_t p = *pos;
+    uint32_t v = buf[p++];
+    if (v & 0x80) {
+        v &= 0x7f;
+        uint8_t shift = 7;
+        uint8_t byte;
+        do {
+            byte = buf[p++];
+            v |= (uint32_t)(byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+    }
+    *pos = p;
+    if (first) { return prev + ((v >> 1) ^ (0U - (v & 1))); }
+    return prev + v + 1;
+}
+
+/* Get a node's successors, decoding them into buf if compressed.
+ * buf is counted against T's limit, so free it with `u32vec_free`.
+ * Returns NULL if decoding failed to allocate (or there are none). */
+static const uint32_t *get_succ(struct hopscotch *t,
+    const struct node *n, struct u32vec *buf) {
+    if (!t->compressed) { return n->succ; }
+    buf->count = 0;
+    if (n->succ_count == 0 || !u32vec_reserve(t, buf, n->succ_count)) {
+        return NULL;
+    }
+    const uint8_t *packed = &t->packed.buf[n->packed];
+    uint32_t pos = 0;
+    uint32_t prev = n->id;
+    for (size_t i = 0; i < n->succ_count; i++) {
+        buf->buf[i] = prev = unpack_succ(packed, &pos, prev, i == 0);
+    }
+    buf->count = n->succ_count;
+    return buf->buf;
+}
+
+static int cmp_uint64_t(const void *a, const void *b) {
+    const uint64_t va = *(const uint64_t *)a;
+    const uint64_t vb = *(const uint64_t *)b;
+    return (va < vb ? -1 : va > vb ? 1 : 0);
+}
+
+/* Choose each node's new position: fill in by_pos with the old IDs
+ * of used nodes in ORDER, then any unused IDs, and pos_of with the
+ * inverse. */
+static bool order_nodes(struct hopscotch *t, enum hopscotch_node_order order,
+    uint32_t *by_pos, uint32_t *pos_of) {
+    const size_t id_limit = t->id_limit;
+    for (size_t i = 0; i < id_limit; i++) { pos_of[i] = NO_INDEX; }
+
+    size_t placed = 0;
+    bool ok = true;
+    const size_t starts_bytes = id_limit * sizeof(uint64_t);
+    uint64_t *starts = NULL;
+    size_t pairs_bytes = 0;
+    uint64_t *pairs = NULL;
+    struct u32vec stack = { .ceil2 = 0 };
+
+    switch (order) {
+    case HOPSCOTCH_ORDER_BFS:
+    default:
+        for (size_t i = 0; i < id_limit; i++) {
+            if (!t->nodes[i].used || pos_of[i] != NO_INDEX) { continue; }
+            placed = place_bfs(t, i, by_pos, pos_of, placed, NULL);
+        }
+        break;
+
+    case HOPSCOTCH_ORDER_DFS:
+        for (size_t i = 0; ok && i < id_limit; i++) {
+            if (!t->nodes[i].used || pos_of[i] != NO_INDEX) { continue; }
+            ok = place_dfs(t, i, by_pos, pos_of, &placed, &stack);
+        }
+        break;
+
+    case HOPSCOTCH_ORDER_RCM:
+    {
+        size_t max_count = 0;
+        for (size_t i = 0; i < id_limit; i++) {
+            const struct node *n = &t->nodes[i];
+            if (n->used && n->succ_count > max_count) { max_count = n->succ_count; }
+        }
+        starts = nodes_by_degree(t, false);
+        pairs_bytes = (max_count + 1) * sizeof(pairs[0]);
+        pairs = tracked_realloc(t, NULL, 0, pairs_bytes);
+        if (starts == NULL || pairs == NULL) {
+            ok = false;
+            break;
+        }
+        for (size_t i = 0; i < id_limit; i++) {
+            const uint32_t id = (uint32_t)starts[i];
+            if (!t->nodes[id].used || pos_of[id] != NO_INDEX) { continue; }
+            placed = place_bfs(t, id, by_pos, pos_of, placed, pairs);
+        }
+        for (size_t i = 0; i < placed / 2; i++) {
+            const uint32_t tmp = by_pos[i];
+            by_pos[i] = by_pos[placed - 1 - i];
+            by_pos[placed - 1 - i] = tmp;
+        }
+        for (size_t i = 0; i < placed; i++) { pos_of[by_pos[i]] = i; }
+        break;
+    }
+
+    case HOPSCOTCH_ORDER_DEGREE:
+        starts = nodes_by_degree(t, true);
+        if (starts == NULL) {
+            ok = false;
+            break;
+        }
+        for (size_t i = 0; i < id_limit; i++) {
+            const uint32_t id = (uint32_t)starts[i];
+            if (!t->nodes[id].used) { continue; }
+            pos_of[id] = placed;
+            by_pos[placed++] = id;
+        }
+        break;
+    }
+
+    tracked_free(t, starts, starts_bytes);
+    tracked_free(t, pairs, pairs_bytes);
+    u32vec_free(t, &stack);
+    if (!ok) { return false; }
+
+    for (size_t i = 0; i < id_limit; i++) {
+        if (pos_of[i] != NO_INDEX) { continue; }
+        pos_of[i] = placed;
+        by_pos[placed++] = i;
+    }
+    assert(placed == id_limit);
+    return true;
+}
+
+/* Place every unplaced node reachable from START, breadth-first.
+ * by_pos doubles as the queue. If PAIRS is non-NULL, each node's
+ * newly found successors are placed in order of their successor
+ * counts, for Cuthill-McKee. Returns the new placed count. */
+static size_t place_bfs(const struct hopscotch *t, uint32_t start,
+    uint32_t *by_pos, uint32_t *pos_of, size_t placed, uint64_t *pairs) {
+    size_t head = placed;
+    pos_of[start] = placed;
+    by_pos[placed++] = start;
+
+    while (head < placed) {
+        const struct node *n = &t->nodes[by_pos[head++]];
+        const size_t first = placed;
+        for (size_t si = 0; si < n->succ_count; si++) {
+            const uint32_t v = n->succ[si];
+            if (pos_of[v] != NO_INDEX) { continue; }
+            pos_of[v] = placed;
+            by_pos[placed++] = v;
+        }
+
+        if (pairs != NULL && placed - first > 1) {
+            const size_t count = placed - first;
+            for (size_t i = 0; i < count; i++) {
+                const uint32_t v = by_pos[first + i];
+                pairs[i] = ((uint64_t)t->nodes[v].succ_count << 32) | v;
+            }
+            qsort(pairs, count, sizeof(pairs[0]), cmp_uint64_t);
+            for (size_t i = 0; i < count; i++) {
+                const uint32_t v = (uint32_t)pairs[i];
+                by_pos[first + i] = v;
+                pos_of[v] = first + i;
+            }
+        }
+    }
+    return placed;
+}
+
+/* Place every unplaced node reachable from START, in depth-first
+ * preorder, using STACK for the nodes still to visit. */
+static bool place_dfs(struct hopscotch *t, uint32_t start,
+    uint32_t *by_pos, uint32_t *pos_of, size_t *placed, struct u32vec *stack) {
+    stack->count = 0;
+    if (!u32vec_reserve(t, stack, 1)) { return false; }
+    stack->buf[stack->count++] = start;
+
+    while (stack->count > 0) {
+        const uint32_t id = stack->buf[--stack->count];
+        if (pos_of[id] != NO_INDEX) { continue; }
+        pos_of[id] = *placed;
+        by_pos[(*placed)++] = id;
+
+        /* Push them in reverse, so the first is visited first. */
+        const struct node *n = &t->nodes[id];
+        if (!u32vec_reserve(t, stack, n->succ_count)) { return false; }
+        for (size_t si = n->succ_count; si > 0; si--) {
+            const uint32_t v = n->succ[si - 1];
+            if (pos_of[v] == NO_INDEX) { stack->buf[stack->count++] = v; }
+        }
+    }
+    return true;
+}
+
+/* Get every ID below id_limit, sorted by successor count (ties by
+ * ID), in the low 32 bits of each entry. The result is counted
+ * against T's limit. */
+static uint64_t *nodes_by_degree(struct hopscotch *t, bool descending) {
+    const size_t id_limit = t->id_limit;
+    uint64_t *res = tracked_realloc(t, NULL, 0, id_limit * sizeof(res[0]));
+    if (res == NULL) { return NULL; }
+    for (size_t i = 0; i < id_limit; i++) {
+        uint64_t count = t->nodes[i].succ_count;
+        if (count > UINT32_MAX) { count = UINT32_MAX; }
+        if (descending) { count = UINT32_MAX - count; }
+        res[i] = (count << 32) | i;
+    }
+    qsort(res, id_limit, sizeof(res[0]), cmp_uint64_t);
+    return res;
+}
+
+static uint32_t to_external(const struct hopscotch *t, uint32_t id) {
+    return (t->ext_ids != NULL && id < t->id_limit ? t->ext_ids[id] : id);
+}
+
+static uint32_t to_internal(const struct hopscotch *t, uint32_t id) {
+    return (t->int_ids != NULL && id < t->id_limit ? t->int_ids[id] : id);
+}
+
+struct hopscotch_iter *
+hopscotch_iter_new(struct hopscotch *t,
+    const struct hopscotch_solver_config *config) {
+    struct hopscotch_iter *res = calloc(1, sizeof(*res));
+    if (res == NULL) { return NULL; }
+
+    /* The iterator has its own solver, since its state
+     * stays in use between calls. */
+    res->s = hopscotch_solver_new(t, config);
+    if (res->s == NULL) {
+        free(res);
+        return NULL;
+    }
+
+    res->phase = ITER_DISCONNECTED;
+    res->env = (struct solve_env) {
+        .s = res->s,
+        .max_depth = res->s->max_depth,
+        .label_mask = res->s->label_mask,
+        .cb = iter_cb,
+        .udata = res,
+    };
+    return res;
+}
+
+bool hopscotch_iter_next(struct hopscotch_iter *it, uint32_t *group_id,
+    size_t *count, const uint32_t **members) {
+    assert(it);
+    struct solve_env *env = &it->env;
+    struct hopscotch_solver *s = it->s;
+    const struct hopscotch *t = s->t;
+
+    env->yield = false;
+    while (!env->yield) {
+        if (s->frame_top > 0) {
+            if (!resume_dfs(env)) {
+                it->phase = ITER_DONE;
+                return false;
+            }
+            continue;
+        }
+
+        if (it->phase == ITER_DONE) { return false; }
+        if (it->next_id >= t->id_limit) {
+            it->phase = (it->phase == ITER_DISCONNECTED
+                ? ITER_CONNECTED : ITER_DONE);
+            it->next_id = 0;
+            continue;
+        }
+
+        const uint32_t id = it->next_id++;
+        const struct node *n = &t->nodes[id];
+        if (!n->used) { continue; }
+        if (it->phase == ITER_DISCONNECTED) {
+            if (!n->connected) { report_disconnected(env, id); }
+        } else if (!strongconnect(env, id)) {
+            it->phase = ITER_DONE;
+            return false;
+        }
+    }
+
+    if (group_id != NULL) { *group_id = it->group_id; }
+    if (count != NULL) { *count = it->group_count; }
+    if (members != NULL) { *members = it->group; }
+    return true;
+}
+
+static void iter_cb(uint32_t group_id,
+    size_t group_count, const uint32_t *group, void *udata) {
+    struct hopscotch_iter *it = udata;
+    it->group_id = group_id;
+    it->group_count = group_count;
+    it->group = group;
+    it->env.yield = true;
+}
+
+enum hopscotch_error
+hopscotch_iter_error(const struct hopscotch_iter *it) {
+    return it->s->error;
+}
+
+const void *hopscotch_iter_payloads(struct hopscotch_iter *it) {
+    assert(it);
+    struct hopscotch *t = it->s->t;
+    const size_t size = (t->payload_size ? t->payload_size : sizeof(void *));
+    const size_t bytes = it->group_count * size;
+    if (it->payload_buf == NULL || bytes > (1LLU << it->payload_ceil2)) {
+        uint8_t nceil2 = it->payload_ceil2;
+        while ((1LLU << nceil2) < bytes) { nceil2++; }
+        const size_t old_bytes = (it->payload_buf == NULL
+            ? 0 : 1LLU << it->payload_ceil2);
+        uint8_t *nbuf = tracked_realloc(t, it->payload_buf,
+            old_bytes, 1LLU << nceil2);
+        if (nbuf == NULL) {
+            it->s->error = HOPSCOTCH_ERROR_MEMORY;
+            return NULL;
+        }
+        it->payload_buf = nbuf;
+        it->payload_ceil2 = nceil2;
+    }
+    copy_payloads(t, it->group_count, it->group, it->payload_buf);
+    return it->payload_buf;
+}
+
+void hopscotch_iter_free(struct hopscotch_iter *it) {
+    if (it == NULL) { return; }
+    tracked_free(it->s->t, it->payload_buf, 1LLU << it->payload_ceil2);
+    hopscotch_solver_free(it->s);
+    free(it);
+}
+
+bool hopscotch_solve_many(size_t count, struct hopscotch *const *graphs,
+    size_t nthreads, hopscotch_solve_many_cb *cb, void *udata) {
+    assert(count == 0 || graphs);
+    if (nthreads == 0) {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = (cpus > 0 ? (size_t)cpus : 1);
+    }
+    if (nthreads > count) { nthreads = count; }
+    if (nthreads == 0) { return true; }
+
+    struct many_env env = {
+        .count = count,
+        .graphs = graphs,
+        .cb = cb,
+        .udata = udata,
+        .ok = true,
+    };
+
+    /* If the workers can't be allocated, solve everything here. */
+    struct many_worker first = { .env = &env, };
+    struct many_worker *workers = calloc(nthreads, sizeof(workers[0]));
+    if (workers == NULL) { nthreads = 1; }
+
+    /* The calling thread is the first worker. */
+    size_t started = 1;
+    for (; started < nthreads; started++) {
+        workers[started].env = &env;
+        if (0 != pthread_create(&workers[started].thread, NULL,
+                solve_many_worker, &workers[started])) {
+            break;
+        }
+    }
+    solve_many_worker(&first);
+
+    for (size_t i = 1; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    free(workers);
+    LOG("%s: %zu graphs, %zu threads, ok %d\n",
+        __func__, count, started, env.ok);
+    return env.ok;
+}
+
+/* Claim graphs until there are none left. Any threads that failed to
+ * start are covered by the others, since graphs are claimed rather
+ * than assigned. */
+static void *solve_many_worker(void *arg) {
+    struct many_worker *w = arg;
+    struct many_env *env = w->env;
+
+    for (;;) {
+        const size_t i = __atomic_fetch_add(&env->next, 1, __ATOMIC_RELAXED);
+        if (i >= env->count) { break; }
+        if (!solve_many_graph(w, i)) {
+            __atomic_store_n(&env->ok, false, __ATOMIC_RELAXED);
+        }
+    }
+
+    if (w->s != NULL) { hopscotch_solver_free(w->s); }
+    return NULL;
+}
+
+static bool solve_many_graph(struct many_worker *w, size_t graph_index) {
+    struct many_env *env = w->env;
+    struct hopscotch *t = env->graphs[graph_index];
+    if (t->state != HOPSCOTCH_SEALED) {
+        t->error = HOPSCOTCH_ERROR_MISUSE;
+        return false;
+    }
+
+    /* Each worker's solver (and its buffers) is reused for every
+     * graph it solves, growing to fit the largest. */
+    if (w->s == NULL) {
+        w->s = new_solver(t, NULL);
+        if (w->s == NULL) {
+            t->error = HOPSCOTCH_ERROR_MEMORY;
+            return false;
+        }
+    } else {
+        /* Move the solver's memory over to T's budget. */
+        if (w->s->t != t) {
+            if (!charge_memory(t, 0, w->s->charged)) {
+                t->error = HOPSCOTCH_ERROR_MEMORY;
+                return false;
+            }
+            charge_memory(w->s->t, w->s->charged, 0);
+        }
+        w->s->t = t;
+        if (!solver_fit(w->s)) {
+            t->error = HOPSCOTCH_ERROR_MEMORY;
+            return false;
+        }
+    }
+
+    struct many_cb_env cb_env = {
+        .graph_index = graph_index,
+        .cb = env->cb,
+        .udata = env->udata,
+    };
+    struct hopscotch_solver *s = w->s;
+    if (!solve_all(s, s->label_mask, s->max_depth,
+            env->cb ? many_cb : NULL, &cb_env, NULL)) {
+        t->error = s->error;
+        s->error = HOPSCOTCH_ERROR_NONE;
+        return false;
+    }
+    return true;
+}
+
+static void many_cb(uint32_t group_id,
+    size_t group_count, const uint32_t *group, void *udata) {
+    struct many_cb_env *env = udata;
+    env->cb(env->graph_index, group_id, group_count, group, env->udata);
+}
+
+bool hopscotch_execute(struct hopscotch *t, size_t nthreads,
+    hopscotch_solve_cb *task_cb, void *udata) {
+    assert(task_cb);
+    struct hopscotch_solver *s = get_solver(t);
+    if (s == NULL) { return false; }
+    const struct condensation *c = get_condensation(s);
+    if (c == NULL) {
+        t->error = s->error;
+        return false;
+    }
+
+    const uint32_t group_count = c->group_count;
+    if (nthreads == 0) {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = (cpus > 0 ? (size_t)cpus : 1);
+    }
+    if (nthreads > group_count) { nthreads = group_count; }
+    if (nthreads == 0) { return true; }
+
+    /* Each worker's deque can hold every group. Under a memory limit,
+     * use fewer workers, if that's all that fits. */
+    const size_t pending_bytes = group_count * sizeof(uint32_t);
+    const size_t worker_bytes = sizeof(struct exec_worker)
+        + group_count * sizeof(uint32_t);
+    while (!charge_memory(t, 0, pending_bytes + nthreads * worker_bytes)) {
+        if (nthreads == 1) {
+            t->error = HOPSCOTCH_ERROR_MEMORY;
+            return false;
+        }
+        nthreads /= 2;
+    }
+    const size_t charged = pending_bytes + nthreads * worker_bytes;
+
+    struct exec_env env = {
+        .c = c,
+        .cb = task_cb,
+        .udata = udata,
+        .nthreads = nthreads,
+        .remaining = group_count,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .wake = PTHREAD_COND_INITIALIZER,
+    };
+    bool ok = false;
+    env.pending = calloc(group_count, sizeof(env.pending[0]));
+    env.workers = calloc(nthreads, sizeof(env.workers[0]));
+    if (env.pending == NULL || env.workers == NULL) { goto cleanup; }
+    for (size_t i = 0; i < nthreads; i++) {
+        struct exec_worker *w = &env.workers[i];
+        w->env = &env;
+        w->index = i;
+        w->deque.buf = malloc(group_count * sizeof(w->deque.buf[0]));
+        if (w->deque.buf == NULL) { goto cleanup; }
+    }
+
+    /* rev lists each group's distinct dependents, so counting how often
+     * a group appears there counts its dependencies. Deal out the groups
+     * that are ready to start among the workers. */
+    for (uint32_t ri = 0; ri < c->rev_offsets[group_count]; ri++) {
+        env.pending[c->rev[ri]]++;
+    }
+    size_t next_worker = 0;
+    for (uint32_t g = 0; g < group_count; g++) {
+        if (env.pending[g] > 0) { continue; }
+        deque_push(&env.workers[next_worker].deque, g);
+        next_worker = (next_worker + 1) % nthreads;
+    }
+
+    /* The calling thread is the first worker. Work dealt to any threads
+     * that fail to start gets stolen by the others. */
+    size_t started = 1;
+    for (; started < nthreads; started++) {
+        if (0 != pthread_create(&env.workers[started].thread, NULL,
+                execute_worker, &env.workers[started])) {
+            break;
+        }
+    }
+    execute_worker(&env.workers[0]);
+    for (size_t i = 1; i < started; i++) {
+        pthread_join(env.workers[i].thread, NULL);
+    }
+    assert(env.remaining == 0);
+    LOG("%s: %u groups, %zu threads\n", __func__, group_count, started);
+    ok = true;
+
+cleanup:
+    if (env.workers != NULL) {
+        for (size_t i = 0; i < nthreads; i++) {
+            free(env.workers[i].deque.buf);
+        }
+    }
+    free(env.workers);
+    free(env.pending);
+    pthread_cond_destroy(&env.wake);
+    pthread_mutex_destroy(&env.lock);
+    charge_memory(t, charged, 0);
+    if (!ok) { t->error = HOPSCOTCH_ERROR_MEMORY; }
+    return ok;
+}
+
+/* Run groups from this worker's deque, or stolen from others', until
+ * every group has finished. */
+static void *execute_worker(void *arg) {
+    struct exec_worker *w = arg;
+    struct exec_env *env = w->env;
+    for (;;) {
+        uint32_t group_id;
+        if (deque_pop(&w->deque, &group_id)) {
+            execute_group(w, group_id);
+            continue;
+        }
+        /* Note the push count before trying to steal, so a push that
+         * lands after a failed steal stops this worker from sleeping. */
+        const uint32_t pushes = __atomic_load_n(&env->pushes, __ATOMIC_SEQ_CST);
+        if (steal_group(w, &group_id)) {
+            execute_group(w, group_id);
+        } else if (__atomic_load_n(&env->remaining, __ATOMIC_ACQUIRE) == 0) {
+            break;
+        } else {
+            execute_wait(env, pushes);
+        }
+    }
+    return NULL;
+}
+
+/* Sleep until something's been pushed since PUSHES was read, or every
+ * group has finished. */
+static void execute_wait(struct exec_env *env, uint32_t pushes) {
+    pthread_mutex_lock(&env->lock);
+    __atomic_add_fetch(&env->sleepers, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&env->pushes, __ATOMIC_SEQ_CST) == pushes
+        && __atomic_load_n(&env->remaining, __ATOMIC_ACQUIRE) > 0) {
+        pthread_cond_wait(&env->wake, &env->lock);
+    }
+    __atomic_sub_fetch(&env->sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&env->lock);
+}
+
+/* Wake one sleeping worker, or ALL of them. Sleepers count themselves
+ * (under the lock) before checking `pushes` and `remaining`, and callers
+ * update those before checking `sleepers`, so either the sleeper sees
+ * the update or this sees the sleeper. */
+static void execute_wake(struct exec_env *env, bool all) {
+    if (__atomic_load_n(&env->sleepers, __ATOMIC_SEQ_CST) == 0) { return; }
+    pthread_mutex_lock(&env->lock);
+    if (all) {
+        pthread_cond_broadcast(&env->wake);
+    } else {
+        pthread_cond_signal(&env->wake);
+    }
+    pthread_mutex_unlock(&env->lock);
+}
+
+/* Run a group's task, then queue any dependents it was the last
+ * unfinished dependency of. */
+static void execute_group(struct exec_worker *w, uint32_t group_id) {
+    struct exec_env *env = w->env;
+    const struct condensation *c = env->c;
+    const uint32_t start = c->group_offsets[group_id];
+    env->cb(group_id, c->group_offsets[group_id + 1] - start,
+        &c->members[start], env->udata);
+
+    for (uint32_t ri = c->rev_offsets[group_id];
+         ri < c->rev_offsets[group_id + 1]; ri++) {
+        const uint32_t dep = c->rev[ri];
+        if (__atomic_sub_fetch(&env->pending[dep], 1, __ATOMIC_ACQ_REL) == 0) {
+            deque_push(&w->deque, dep);
+            __atomic_add_fetch(&env->pushes, 1, __ATOMIC_SEQ_CST);
+            execute_wake(env, false);
+        }
+    }
+    if (__atomic_sub_fetch(&env->remaining, 1, __ATOMIC_SEQ_CST) == 0) {
+        execute_wake(env, true);
+    }
+}
+
+/* Try every other worker's deque, going around again if a steal lost
+ * a race, since that victim may still have groups left. Only return
+ * false once a full pass has found them all empty. */
+static bool steal_group(struct exec_worker *w, uint32_t *group_id) {
+    struct exec_env *env = w->env;
+    bool contended;
+    do {
+        contended = false;
+        for (size_t i = 1; i < env->nthreads; i++) {
+            struct exec_worker *victim =
+                &env->workers[(w->index + i) % env->nthreads];
+            if (deque_steal(&victim->deque, group_id, &contended)) {
+                return true;
+            }
+        }
+    } while (contended);
+    return false;
+}
+
+/* Only the deque's owner pushes and pops. Everything is sequentially
+ * consistent, which keeps the ordering arguments simple; the deque
+ * operations are cheap next to running a task. */
+static void deque_push(struct exec_deque *d, uint32_t group_id) {
+    const int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->buf[b], group_id, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_SEQ_CST);
+}
+
+static bool deque_pop(struct exec_deque *d, uint32_t *group_id) {
+    const int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&d->bottom, b, __ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_SEQ_CST);
+    if (t > b) {                /* empty */
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    *group_id = __atomic_load_n(&d->buf[b], __ATOMIC_RELAXED);
+    if (t < b) { return true; }
+
+    /* Taking the last one, so race any thieves for it. */
+    const bool won = __atomic_compare_exchange_n(&d->top, &t, t + 1,
+        false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    return won;
+}
+
+/* Set *CONTENDED if the deque wasn't empty, but another thread took
+ * the group first. */
+static bool deque_steal(struct exec_deque *d, uint32_t *group_id,
+    bool *contended) {
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_SEQ_CST);
+    const int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_SEQ_CST);
+    if (t >= b) { return false; }
+    const uint32_t id = __atomic_load_n(&d->buf[t], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&d->top, &t, t + 1,
+            false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        *contended = true;      /* lost a race */
+        return false;
+    }
+    *group_id = id;
+    return true;
+}
+
+/* Get the handle's own solver, used by the handle-level solve
+ * functions, creating it on first use. */
+static struct hopscotch_solver *get_solver(struct hopscotch *t) {
+    if (t->state != HOPSCOTCH_SEALED) {
+        t->error = HOPSCOTCH_ERROR_MISUSE;
+        return NULL;
+    }
+    if (t->solver == NULL) {
+        t->solver = hopscotch_solver_new(t, NULL);
+        if (t->solver == NULL) {
+            t->error = HOPSCOTCH_ERROR_MEMORY;
+            return NULL;
+        }
+    } else if (!solver_fit(t->solver)) { /* the graph may have been reset */
+        t->error = HOPSCOTCH_ERROR_MEMORY;
+        return NULL;
+    }
+    return t->solver;
+}
+
+/* Make sure the solver's per-node arrays cover every node in the graph.
+ * A graph doesn't change once sealed, but the handle's own solver is
+ * kept (along with its buffers) when the graph is reset. */
+static bool solver_fit(struct hopscotch_solver *s) {
+    const size_t node_ceil = (1LLU << s->t->node_ceil2);
+    if (s->index != NULL && node_ceil <= s->node_ceil) { return true; }
+    const size_t old_ceil = (s->index == NULL ? 0 : s->node_ceil);
+    const size_t owords = (s->index == NULL ? 0 : old_ceil/64 + 1);
+
+    uint32_t *nindex = solver_realloc(s, s->index,
+        old_ceil * sizeof(nindex[0]), node_ceil * sizeof(nindex[0]));
+    if (nindex == NULL) { return false; }
+    s->index = nindex;
+    for (size_t i = old_ceil; i < node_ceil; i++) { s->index[i] = NO_INDEX; }
+
+    if (s->engine == HOPSCOTCH_ENGINE_TARJAN) {
+        uint32_t *nlowlink = solver_realloc(s, s->lowlink,
+            old_ceil * sizeof(nlowlink[0]), node_ceil * sizeof(nlowlink[0]));
+        if (nlowlink == NULL) { return false; }
+        s->lowlink = nlowlink;
+
+        const size_t words = node_ceil/64 + 1;
+        uint64_t *nstacked = solver_realloc(s, s->stacked,
+            owords * sizeof(nstacked[0]), words * sizeof(nstacked[0]));
+        if (nstacked == NULL) { return false; }
+        s->stacked = nstacked;
+        memset(&s->stacked[owords], 0x00,
+            (words - owords) * sizeof(s->stacked[0]));
+    }
+
+    s->node_ceil = node_ceil;
+    return true;
+}
+
+/* Free the impact query scratch space, which is sized
+ * for the graph's condensation. */
+static void solver_clear_impact(struct hopscotch_solver *s) {
+    charge_memory(s->t, s->impact_bytes, 0);
+    s->charged -= s->impact_bytes;
+    s->impact_bytes = 0;
+    free(s->impact_seen);
+    free(s->impact_queue);
+    free(s->impact_affected);
+    s->impact_seen = NULL;
+    s->impact_queue = NULL;
+    s->impact_affected = NULL;
+}
+
+/* Solve the whole graph, and either call CB with each group or
+ * (if INTO is non-NULL) write the groups into INTO. */
+static bool solve_all(struct hopscotch_solver *s, uint8_t label_mask,
+    size_t max_depth, hopscotch_solve_cb *cb, void *udata,
+    struct hopscotch_result *into) {
+    struct hopscotch *t = s->t;
+    if (max_depth == 0) { max_depth = HOPSCOTCH_SOLVE_DEFAULT_MAX_DEPTH; }
+
+    struct solve_env env = {
+        .s = s,
+        .max_depth = max_depth,
+        .label_mask = label_mask,
+        .cb = cb,
+        .udata = udata,
+        .into = into,
+    };
+
+    const size_t id_limit = t->id_limit;
+    bool res = true;
+
+    if (into != NULL) {
+        if (!prepare_result(into, id_limit, count_nodes(t))) {
+            s->error = HOPSCOTCH_ERROR_MEMORY;
+            return false;
+        }
+    }
+
+    /* First pass: emit any nodes that have no references to them */
+    for (size_t i = 0; i < id_limit; i++) {
+        if (!t->nodes[i].used) { continue; }
+        if (!t->nodes[i].connected) { report_disconnected(&env, i); }
+    }
+
+    for (size_t i = 0; i < id_limit; i++) {
+        if (!t->nodes[i].used) { continue; }
+        if (!strongconnect(&env, i)) {
+            LOG("%s: strongconnect failure\n", __func__);
+            res = false;
+            break;
+        }
+    }
+
+    /* Reset all DFS state, so the graph can be solved again. */
+    memset(s->index, 0xff, id_limit * sizeof(s->index[0]));
+    clear_stack(s);
+    if (into != NULL) { into->group_count = env.scc_id; }
+    return res;
+}
+
+static size_t count_nodes(const struct hopscotch *t) {
+    size_t res = 0;
+    for (size_t i = 0; i < t->id_limit; i++) {
+        if (t->nodes[i].used) { res++; }
+    }
+    return res;
+}
+
+/* Size RES's buffers for a graph, allocating any the caller didn't
+ * provide, and clear it. */
+static bool prepare_result(struct hopscotch_result *res,
+    size_t id_limit, size_t node_count) {
+    if (!reserve_result_buf(res, RESULT_NODE_GROUP,
+            &res->node_group, id_limit)
+        || !reserve_result_buf(res, RESULT_GROUP_OFFSETS,
+            &res->group_offsets, node_count + 1)
+        || !reserve_result_buf(res, RESULT_MEMBERS,
+            &res->members, node_count)) {
+        return false;
+    }
+
+    res->id_limit = id_limit;
+    res->node_count = node_count;
+    res->group_count = 0;
+    for (size_t i = 0; i < id_limit; i++) {
+        res->node_group[i] = HOPSCOTCH_NO_GROUP;
+    }
+    res->group_offsets[0] = 0;
+    return true;
+}
+
+static bool reserve_result_buf(struct hopscotch_result *res,
+    uint8_t which, uint32_t **buf, size_t count) {
+    const uint8_t flag = (1U << which);
+    if (*buf != NULL) {
+        if ((res->owned & flag) == 0) { return true; } /* caller's */
+        if (count <= (1LLU << res->owned_ceil2[which])) { return true; }
+    }
+
+    uint8_t nceil2 = ((res->owned & flag) ? res->owned_ceil2[which] : 0);
+    while ((1LLU << nceil2) < count) { nceil2++; }
+    uint32_t *nbuf = realloc(*buf, (1LLU << nceil2) * sizeof(nbuf[0]));
+    if (nbuf == NULL) { return false; }
+    *buf = nbuf;
+    res->owned |= flag;
+    res->owned_ceil2[which] = nceil2;
+    return true;
+}
+
+static bool solve_roots(struct hopscotch_solver *s,
+    size_t root_count, const uint32_t *roots, uint8_t label_mask,
+    size_t max_depth, hopscotch_solve_cb *cb, void *udata) {
+    struct hopscotch *t = s->t;
+
+    /* Check all roots up front, so a bad one doesn't leave
+     * partially processed state behind. */
+    for (size_t i = 0; i < root_count; i++) {
+        if (roots[i] >= s->node_ceil
+            || !t->nodes[to_internal(t, roots[i])].used) {
+            s->error = HOPSCOTCH_ERROR_MISUSE;
+            return false;
+        }
+    }
+
+    if (max_depth == 0) { max_depth = HOPSCOTCH_SOLVE_DEFAULT_MAX_DEPTH; }
+
+    struct solve_env env = {
+        .s = s,
+        .max_depth = max_depth,
+        .label_mask = label_mask,
+        .cb = cb,
+        .udata = udata,
+        .track_visited = true,
+    };
+
+    /* Unlike `solve_all`, there is no pass over every node
+     * here: only nodes reachable from the roots are ever touched. */
+    bool res = true;
+    for (size_t i = 0; i < root_count; i++) {
+        if (!strongconnect(&env, to_internal(t, roots[i]))) {
+            LOG("%s: strongconnect failure\n", __func__);
+            res = false;
+            break;
+        }
+    }
+
+    clear_visited(s);
+    clear_stack(s);
+    return res;
+}
+
+static void report_disconnected(struct solve_env *env, uint32_t node_id) {
+    struct hopscotch_solver *s = env->s;
+    struct hopscotch_result *into = env->into;
+    const uint32_t ext_id = to_external(s->t, node_id);
+    if (into != NULL) {
+        const uint32_t offset = into->group_offsets[env->scc_id];
+        into->members[offset] = ext_id;
+        into->node_group[ext_id] = env->scc_id;
+        into->group_offsets[env->scc_id + 1] = offset + 1;
+    } else if (env->cb != NULL) {
+        /* scc_buf always has room for one, and (unlike a local)
+         * stays valid for an iterator's caller. */
+        s->scc_buf[0] = ext_id;
+        env->cb(env->scc_id, 1, s->scc_buf, env->udata);
+    }
+    env->scc_id++;
+
+    /* Give it an index (or with Pearce's algorithm, a component
+     * number), so strongconnect considers it processed. */
+    if (s->engine == HOPSCOTCH_ENGINE_PEARCE) {
+        s->index[node_id] = s->next_component--;
+    } else {
+        s->index[node_id] = s->next_index++;
+    }
+}
+
+#define MIN(X, Y) (X < Y ? X : Y)
+
+static bool edge_in_mask(const struct node *n, size_t si, uint8_t mask) {
+    const uint8_t label = (n->labeled
+        ? n->labels[si] : HOPSCOTCH_LABEL_DEFAULT);
+    return (label & mask) != 0;
+}
+
+/* Tarjan's algorithm, using an explicit stack of DFS frames in the
+ * solver rather than recursion, so deep graphs can't overflow the C
+ * stack. The frame stack is still limited to env->max_depth. */
+static bool strongconnect(struct solve_env *env, uint32_t root_id) {
+    LOG("%s: root_id %u\n", __func__, root_id);
+    struct hopscotch_solver *s = env->s;
+
+    if (s->index[root_id] != NO_INDEX) {
+        LOG("%s: already processed\n", __func__);
+        return true;            /* node already processed */
+    }
+    if (!visit_node(env, root_id)) { return false; }
+    return resume_dfs(env);
+}
+
+/* Run the DFS until the frame stack is empty, or (if env->yield gets
+ * set while emitting a group) until just after the next group. */
+static bool resume_dfs(struct solve_env *env) {
+    struct hopscotch_solver *s = env->s;
+    if (s->engine == HOPSCOTCH_ENGINE_PEARCE) { return pearce_resume_dfs(env); }
+    const struct node *nodes = s->t->nodes;
+    const uint8_t *packed_base = (s->t->compressed ? s->t->packed.buf : NULL);
+
+    while (s->frame_top > 0) {
+        struct frame *f = &s->frames[s->frame_top - 1];
+        const uint32_t node_id = f->node_id;
+        const struct node *n = &nodes[node_id];
+
+        /* Edge labels only need checking if some could be masked out. */
+        const bool check_labels = (n->labeled
+            || (HOPSCOTCH_LABEL_DEFAULT & env->label_mask) == 0);
+
+        /* Successors are decoded on the fly, if compressed. */
+        const uint8_t *packed = (packed_base ? &packed_base[n->packed] : NULL);
+        uint32_t pos = f->pos;
+        uint32_t prev = f->prev;
+
+        /* consider successors of node, until finding an unvisited one */
+        bool descended = false;
+        for (size_t si = f->succ_i; si < n->succ_count; si++) {
+            uint32_t s_id;
+            if (packed != NULL) {
+                s_id = prev = unpack_succ(packed, &pos, prev, si == 0);
+            } else {
+                s_id = n->succ[si];
+            }
+            if (check_labels && !edge_in_mask(n, si, env->label_mask)) {
+                continue;
+            }
+            assert(s_id < s->node_ceil);
+
+            LOG("%s: checking successor %u\n", __func__, s_id);
+
+            if (s->index[s_id] == NO_INDEX) {
+                /* not yet visited -- descend into it */
+                LOG("%s: not yet visited, descending\n", __func__);
+                f->succ_i = si + 1;
+                f->pos = pos;
+                f->prev = prev;
+                if (!visit_node(env, s_id)) { return false; }
+                descended = true;
+                break;
+            } else if (is_stacked(s, s_id)) {
+                LOG("%s: successor already stacked\n", __func__);
+
+                /* "Note: The next line may look odd - but is correct.
+                 * It says w.index not w.lowlink; that is deliberate
+                 * and from the original paper." where 'w' is 's') */
+                s->lowlink[node_id] = MIN(s->lowlink[node_id], s->index[s_id]);
+                LOG("%s: node %u lowlink now %u\n",
+                    __func__, node_id, s->lowlink[node_id]);
+            }
+        }
+        if (descended) { continue; }
+
+        /* All successors have been considered. */
+        s->frame_top--;
+
+        /* If n is a root node, then pop the stack and generate an SCC. */
+        if (s->lowlink[node_id] == s->index[node_id]) {
+            if (!emit_group(env, node_id)) { return false; }
+        }
+
+        /* Propagate lowlink back to the node that descended into it. */
+        if (s->frame_top > 0) {
+            const uint32_t p_id = s->frames[s->frame_top - 1].node_id;
+            s->lowlink[p_id] = MIN(s->lowlink[p_id], s->lowlink[node_id]);
+            LOG("%s: node %u lowlink now %u\n",
+                __func__, p_id, s->lowlink[p_id]);
+        }
+        if (env->yield) { return true; }
+    }
+    return true;
+}
+
+/* Pearce's variant of resume_dfs ("A Space-Efficient Algorithm for
+ * Finding Strongly Connected Components", 2016). Each node's index
+ * doubles as its lowlink, and whether a node is still a possible
+ * root is kept in its frame, rather than per node. */
+static bool pearce_resume_dfs(struct solve_env *env) {
+    struct hopscotch_solver *s = env->s;
+    const struct node *nodes = s->t->nodes;
+    const uint8_t *packed_base = (s->t->compressed ? s->t->packed.buf : NULL);
+    uint32_t *index = s->index;
+
+    while (s->frame_top > 0) {
+        struct frame *f = &s->frames[s->frame_top - 1];
+        const uint32_t node_id = f->node_id;
+        const struct node *n = &nodes[node_id];
+
+        const bool check_labels = (n->labeled
+            || (HOPSCOTCH_LABEL_DEFAULT & env->label_mask) == 0);
+
+        const uint8_t *packed = (packed_base ? &packed_base[n->packed] : NULL);
+        uint32_t pos = f->pos;
+        uint32_t prev = f->prev;
+
+        bool descended = false;
+        for (size_t si = f->succ_i; si < n->succ_count; si++) {
+            uint32_t s_id;
+            if (packed != NULL) {
+                s_id = prev = unpack_succ(packed, &pos, prev, si == 0);
+            } else {
+                s_id = n->succ[si];
+            }
+            if (check_labels && !edge_in_mask(n, si, env->label_mask)) {
+                continue;
+            }
+            assert(s_id < s->node_ceil);
+
+            if (index[s_id] == NO_INDEX) {
+                f->succ_i = si + 1;
+                f->pos = pos;
+                f->prev = prev;
+                if (!visit_node(env, s_id)) { return false; }
+                descended = true;
+                break;
+            } else if (index[s_id] < index[node_id]) {
+                /* Finished nodes have a component number, which is
+                 * never less than a live index. */
+                index[node_id] = index[s_id];
+                f->root = false;
+            }
+        }
+        if (descended) { continue; }
+
+        s->frame_top--;
+        if (f->root) {
+            if (!emit_group(env, node_id)) { return false; }
+        } else if (!push_node(s, node_id)) {
+            return false;
+        }
+
+        if (s->frame_top > 0) {
+            struct frame *pf = &s->frames[s->frame_top - 1];
+            if (index[node_id] < index[pf->node_id]) {
+                index[pf->node_id] = index[node_id];
+                pf->root = false;
+            }
+        }
+        if (env->yield) { return true; }
+    }
+    return true;
+}
+
+/* Pop the next member of the group whose root is ROOT_ID into *MEMBER,
+ * which holds the previous member (once USED > 0). Returns false after
+ * the whole group has been popped. */
+static bool next_member(struct hopscotch_solver *s, uint32_t root_id,
+    size_t used, uint32_t *member) {
+    if (s->engine == HOPSCOTCH_ENGINE_TARJAN) {
+        /* The group is everything on the stack, down to the root. */
+        if (used > 0 && *member == root_id) { return false; }
+        *member = pop_node(s);
+        return true;
+    }
+
+    /* With Pearce's algorithm, the root isn't on the stack, and the rest
+     * of the group is everything on top of the stack with an index of at
+     * least the root's. They all get the same component number, and
+     * their indexes are freed for reuse. */
+    if (used == 0) {
+        *member = root_id;
+        return true;
+    }
+    if (s->stack_top > 0
+        && s->index[root_id] <= s->index[s->stack[s->stack_top - 1]]) {
+        *member = pop_node(s);
+        s->index[*member] = s->next_component;
+        s->next_index--;
+        return true;
+    }
+    s->index[root_id] = s->next_component--;
+    s->next_index--;
+    return false;
+}
+
+/* Give a node its index, and push it on the stack and frame stack. */
+static bool visit_node(struct solve_env *env, uint32_t node_id) {
+    struct hopscotch_solver *s = env->s;
+    assert(s->t->nodes[node_id].id == node_id);
+    assert(s->t->nodes[node_id].used);
+
+    if (s->frame_top >= env->max_depth) {
+        s->error = HOPSCOTCH_ERROR_RECURSION_DEPTH;
+        return false;
+    }
+
+    if (s->frame_top == (1LLU << s->frame_ceil2)) { /* grow? */
+        const uint8_t nceil2 = s->frame_ceil2 + 1;
+        struct frame *nframes = solver_realloc(s, s->frames,
+            (1LLU << s->frame_ceil2) * sizeof(s->frames[0]),
+            (1LLU << nceil2) * sizeof(s->frames[0]));
+        if (nframes == NULL) {
+            s->error = HOPSCOTCH_ERROR_MEMORY;
+            return false;
+        }
+        s->frame_ceil2 = nceil2;
+        s->frames = nframes;
+    }
+
+    /* Pearce's algorithm only pushes nodes once it knows
+     * they aren't a root. */
+    const bool pearce = (s->engine == HOPSCOTCH_ENGINE_PEARCE);
+    s->index[node_id] = s->next_index;
+    if (!pearce) { s->lowlink[node_id] = s->next_index; }
+    s->next_index++;
+    if (!mark_visited(env, node_id)) { return false; }
+    if (!pearce && !push_node(s, node_id)) { return false; }
+
+    s->frames[s->frame_top++] = (struct frame) {
+        .node_id = node_id,
+        .root = true,
+        .succ_i = 0,
+        .pos = 0,
+        .prev = node_id,
+    };
+
+    LOG("%s: processing node %u, (index %u, succ_count %zu)\n",
+        __func__, node_id, s->index[node_id],
+        s->t->nodes[node_id].succ_count);
+    return true;
+}
+
+/* Pop the group rooted at ROOT_ID off the stack, and report it. */
+static bool emit_group(struct solve_env *env, uint32_t root_id) {
+    struct hopscotch_solver *s = env->s;
+    LOG("%s: root node found, starting group\n", __func__);
+    if (env->into != NULL) { return emit_group_into(env, root_id); }
+
+    size_t used = 0;
+    uint32_t edge = root_id;
+    while (next_member(s, root_id, used, &edge)) {
+        assert(edge < s->node_ceil);
+        if (used >= (1LLU << s->scc_buf_ceil)) {
+            uint8_t nceil = s->scc_buf_ceil + 1;
+            uint32_t *nbuf = solver_realloc(s, s->scc_buf,
+                (1LLU << s->scc_buf_ceil) * sizeof(*nbuf),
+                (1LLU << nceil) * sizeof(*nbuf));
+            if (nbuf == NULL) {
+                s->error = HOPSCOTCH_ERROR_MEMORY;
+                return false;
+            }
+            s->scc_buf_ceil = nceil;
+            s->scc_buf = nbuf;
+        }
+        s->scc_buf[used] = to_external(s->t, edge);
+        used++;
+        LOG("%s: added node %u, %zd in group\n",
+            __func__, edge, used);
+    }
+
+    if (!order_group(s, s->scc_buf, used)) { return false; }
+
+    /* Note: The SCCs are output in reverse topological order. */
+    if (env->cb) {
+        env->cb(env->scc_id, used, s->scc_buf, env->udata);
+    }
+    env->scc_id++;
+    return true;
+}
+
+/* Like emit_group, but pop the group straight into the result's
+ * member array, which always has room for it. */
+static bool emit_group_into(struct solve_env *env, uint32_t root_id) {
+    struct hopscotch_solver *s = env->s;
+    struct hopscotch_result *into = env->into;
+    const uint32_t group_id = env->scc_id;
+    uint32_t *group = &into->members[into->group_offsets[group_id]];
+
+    size_t used = 0;
+    uint32_t edge = root_id;
+    while (next_member(s, root_id, used, &edge)) {
+        const uint32_t ext_id = to_external(s->t, edge);
+        group[used++] = ext_id;
+        into->node_group[ext_id] = group_id;
+    }
+
+    if (!order_group(s, group, used)) { return false; }
+    into->group_offsets[group_id + 1] = into->group_offsets[group_id] + used;
+    env->scc_id++;
+    return true;
+}
+
+/* Put a group's members, as popped off the stack, in the solver's
+ * member order. The group was contiguous on the stack, in the order
+ * the nodes were first visited, so popping it reverses that. */
+static bool order_group(struct hopscotch_solver *s,
+    uint32_t *group, size_t count) {
+    switch (s->member_order) {
+    case HOPSCOTCH_MEMBERS_SORTED:
+    default:
+        return sort_group(s, group, count);
+    case HOPSCOTCH_MEMBERS_STACK:
+        return true;
+    case HOPSCOTCH_MEMBERS_DISCOVERY:
+        /* Pearce's stack isn't in discovery order; see the header. */
+        if (s->engine == HOPSCOTCH_ENGINE_PEARCE) { return true; }
+        for (size_t i = 0; i < count / 2; i++) {
+            const uint32_t tmp = group[i];
+            group[i] = group[count - 1 - i];
+            group[count - 1 - i] = tmp;
+        }
+        return true;
+    }
+}
+
+/* Sort a group's members in ascending order, with an LSD radix sort
+ * (one byte per pass) for large groups. Passes where every member has
+ * the same byte are skipped, which is common, since IDs in one group
+ * tend to be close together. */
+static bool sort_group(struct hopscotch_solver *s,
+    uint32_t *group, size_t count) {
+    if (count <= RADIX_SORT_MIN) {
+        for (size_t i = 1; i < count; i++) {
+            const uint32_t v = group[i];
+            size_t j = i;
+            while (j > 0 && group[j - 1] > v) {
+                group[j] = group[j - 1];
+                j--;
+            }
+            group[j] = v;
+        }
+        return true;
+    }
+
+    if (s->sort_tmp == NULL || count > (1LLU << s->sort_tmp_ceil2)) {
+        uint8_t nceil2 = s->sort_tmp_ceil2;
+        while ((1LLU << nceil2) < count) { nceil2++; }
+        const size_t old_bytes = (s->sort_tmp == NULL
+            ? 0 : (1LLU << s->sort_tmp_ceil2) * sizeof(s->sort_tmp[0]));
+        uint32_t *ntmp = solver_realloc(s, s->sort_tmp,
+            old_bytes, (1LLU << nceil2) * sizeof(*ntmp));
+        if (ntmp == NULL) {
+            s->error = HOPSCOTCH_ERROR_MEMORY;
+            return false;
+        }
+        s->sort_tmp_ceil2 = nceil2;
+        s->sort_tmp = ntmp;
+    }
+
+    uint32_t *src = group;
+    uint32_t *dst = s->sort_tmp;
+    for (uint8_t shift = 0; shift < 32; shift += 8) {
+        size_t offsets[256] = { 0 };
+        for (size_t i = 0; i < count; i++) {
+            offsets[(src[i] >> shift) & 0xff]++;
+        }
+        if (offsets[(src[0] >> shift) & 0xff] == count) { continue; }
 
-static bool push_node(struct hopscotch *t, uint32_t node_id) {
-    if (t->stack_top == (1LLU << t->stack_ceil2)) { /* grow? */
-        const uint8_t nceil2 = t->stack_ceil2 + 1;
+        size_t total = 0;
+        for (size_t d = 0; d < 256; d++) {
+            const size_t c = offsets[d];
+            offsets[d] = total;
+            total += c;
+        }
+        for (size_t i = 0; i < count; i++) {
+            dst[offsets[(src[i] >> shift) & 0xff]++] = src[i];
+        }
+
+        uint32_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if (src != group) { memcpy(group, src, count * sizeof(group[0])); }
+    return true;
+}
+
+static bool mark_visited(struct solve_env *env, uint32_t node_id) {
+    if (!env->track_visited) { return true; }
+    struct hopscotch_solver *s = env->s;
+    if (s->visited_count == (1LLU << s->visited_ceil)) { /* grow? */
+        const uint8_t nceil2 = s->visited_ceil + 1;
+        uint32_t *nvisited = solver_realloc(s, s->visited,
+            (1LLU << s->visited_ceil) * sizeof(s->visited[0]),
+            (1LLU << nceil2) * sizeof(s->visited[0]));
+        if (nvisited == NULL) {
+            s->error = HOPSCOTCH_ERROR_MEMORY;
+            return false;
+        }
+        s->visited_ceil = nceil2;
+        s->visited = nvisited;
+    }
+    s->visited[s->visited_count++] = node_id;
+    return true;
+}
+
+/* Reset the DFS state for every node touched during the solve,
+ * so the graph can be solved again from other roots. */
+static void clear_visited(struct hopscotch_solver *s) {
+    for (size_t i = 0; i < s->visited_count; i++) {
+        s->index[s->visited[i]] = NO_INDEX;
+    }
+    s->visited_count = 0;
+}
+
+/* Clear anything left on the stacks (after an error), and
+ * start indexing from 0 again. */
+static void clear_stack(struct hopscotch_solver *s) {
+    if (s->stacked != NULL) {
+        for (size_t i = 0; i < s->stack_top; i++) {
+            clear_bit(s->stacked, s->stack[i]);
+        }
+    }
+    s->stack_top = 0;
+    s->frame_top = 0;
+    s->next_index = 0;
+    s->next_component = NO_INDEX - 1;
+}
+
+static bool is_stacked(const struct hopscotch_solver *s, uint32_t node_id) {
+    return get_bit(s->stacked, node_id);
+}
+
+static bool push_node(struct hopscotch_solver *s, uint32_t node_id) {
+    if (s->stack_top == (1LLU << s->stack_ceil2)) { /* grow? */
+        const uint8_t nceil2 = s->stack_ceil2 + 1;
         LOG("%s: growing stack from %zu to %zu\n",
-            __func__, (size_t)(1LLU << t->stack_ceil2),
+            __func__, (size_t)(1LLU << s->stack_ceil2),
             (size_t)(1LLU << nceil2));
-        uint32_t *nstack = realloc(t->stack,
-            (1LLU << nceil2) * sizeof(t->stack[0]));
+        uint32_t *nstack = solver_realloc(s, s->stack,
+            (1LLU << s->stack_ceil2) * sizeof(s->stack[0]),
+            (1LLU << nceil2) * sizeof(s->stack[0]));
         if (nstack == NULL) {
             LOG("%s: stack realloc failure\n", __func__);
+            s->error = HOPSCOTCH_ERROR_MEMORY;
             return false;
         }
-        t->stack_ceil2 = nceil2;
-        t->stack = nstack;
+        s->stack_ceil2 = nceil2;
+        s->stack = nstack;
     }
 
-    t->stack[t->stack_top++] = node_id;
-    t->nodes[node_id].stacked = true;
+    s->stack[s->stack_top++] = node_id;
+    if (s->stacked != NULL) { set_bit(s->stacked, node_id); }
     return true;
 }
 
-static uint32_t pop_node(struct hopscotch *t) {
-    assert(t->stack_top > 0);
-    uint32_t res = t->stack[--t->stack_top];
+static uint32_t pop_node(struct hopscotch_solver *s) {
+    assert(s->stack_top > 0);
+    uint32_t res = s->stack[--s->stack_top];
     LOG("%s: popping %u\n", __func__, res);
-    assert(t->nodes[res].stacked);
-    t->nodes[res].stacked = false;
+    if (s->stacked != NULL) {
+        assert(is_stacked(s, res));
+        clear_bit(s->stacked, res);
+    }
     return res;
 }
+
+/* Get the graph's condensation, building it (using solver S, but
+ * always with sorted members) if this is the first time it's needed. */
+static const struct condensation *get_condensation(struct hopscotch_solver *s) {
+    struct hopscotch *t = s->t;
+    if (pthread_mutex_lock(&t->lock) != 0) {
+        s->error = HOPSCOTCH_ERROR_MISUSE;
+        return NULL;
+    }
+    if (t->cond == NULL) {
+        t->cond = build_condensation(s);
+    }
+    const struct condensation *res = t->cond;
+    pthread_mutex_unlock(&t->lock);
+    return res;
+}
+
+/* Solve the graph once and save the groups, along with the reverse
+ * (dependent) edges between them, deduplicated. */
+static struct condensation *build_condensation(struct hopscotch_solver *s) {
+    struct hopscotch *t = s->t;
+    size_t scratch_bytes = 0;
+    uint32_t *mark = NULL;
+    uint32_t *cursor = NULL;
+    struct u32vec decoded = { .ceil2 = 0 };
+    struct condensation *c = tracked_realloc(t, NULL, 0, sizeof(*c));
+    if (c == NULL) { goto fail; }
+    memset(c, 0x00, sizeof(*c));
+    c->bytes = sizeof(*c);
+
+    /* The group arrays aren't tracked as the solve fills them in, so
+     * count their smallest possible size before solving, then their
+     * actual size after. */
+    const size_t node_count = count_nodes(t);
+    const size_t min_bytes = (t->id_limit + 2 * node_count + 1)
+        * sizeof(uint32_t);
+    if (!charge_memory(t, 0, min_bytes)) { goto fail; }
+    c->bytes += min_bytes;
+
+    /* The condensation takes ownership of the result's buffers. It's
+     * shared, and execute promises sorted members, so sort them
+     * whatever S's own member order is. */
+    struct hopscotch_result groups = { .id_limit = 0 };
+    const enum hopscotch_member_order member_order = s->member_order;
+    s->member_order = HOPSCOTCH_MEMBERS_SORTED;
+    const bool solved = solve_all(s, HOPSCOTCH_LABEL_ALL, 0, NULL, NULL, &groups);
+    s->member_order = member_order;
+    if (!solved) {
+        hopscotch_result_free(&groups);
+        free_condensation(t, c);
+        return NULL;
+    }
+    c->group_count = groups.group_count;
+    c->node_group = groups.node_group;
+    c->group_offsets = groups.group_offsets;
+    c->members = groups.members;
+    size_t groups_bytes = 0;
+    for (uint8_t i = RESULT_NODE_GROUP; i <= RESULT_MEMBERS; i++) {
+        groups_bytes += (1LLU << groups.owned_ceil2[i]) * sizeof(uint32_t);
+    }
+    if (!charge_memory(t, min_bytes, groups_bytes)) { goto fail; }
+    c->bytes += groups_bytes - min_bytes;
+
+    const uint32_t group_count = c->group_count;
+    const size_t offsets_bytes = ((size_t)group_count + 1)
+        * sizeof(c->rev_offsets[0]);
+    c->rev_offsets = tracked_realloc(t, NULL, 0, offsets_bytes);
+    if (c->rev_offsets == NULL) { goto fail; }
+    c->bytes += offsets_bytes;
+    memset(c->rev_offsets, 0x00, offsets_bytes);
+    scratch_bytes = offsets_bytes;
+    mark = tracked_realloc(t, NULL, 0, scratch_bytes);
+    cursor = tracked_realloc(t, NULL, 0, scratch_bytes);
+    if (mark == NULL || cursor == NULL) { goto fail; }
+
+    /* First pass: count each group's distinct dependents, then convert
+     * the counts to offsets. Second pass: fill in the edges. */
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t g = 0; g < group_count; g++) { mark[g] = NO_INDEX; }
+
+        for (uint32_t g = 0; g < group_count; g++) {
+            for (uint32_t mi = c->group_offsets[g];
+                 mi < c->group_offsets[g + 1]; mi++) {
+                const struct node *n =
+                    &t->nodes[to_internal(t, c->members[mi])];
+                const uint32_t *succ = get_succ(t, n, &decoded);
+                if (succ == NULL && n->succ_count > 0) { goto fail; }
+                for (size_t si = 0; si < n->succ_count; si++) {
+                    const uint32_t h =
+                        c->node_group[to_external(t, succ[si])];
+                    if (h == g || mark[h] == g) { continue; }
+                    mark[h] = g;
+                    if (pass == 0) {
+                        c->rev_offsets[h + 1]++;
+                    } else {
+                        c->rev[cursor[h]++] = g;
+                    }
+                }
+            }
+        }
+
+        if (pass == 0) {
+            for (uint32_t g = 0; g < group_count; g++) {
+                c->rev_offsets[g + 1] += c->rev_offsets[g];
+                cursor[g] = c->rev_offsets[g];
+            }
+            const size_t rev_bytes = ((size_t)c->rev_offsets[group_count] + 1)
+                * sizeof(c->rev[0]);
+            c->rev = tracked_realloc(t, NULL, 0, rev_bytes);
+            if (c->rev == NULL) { goto fail; }
+            c->bytes += rev_bytes;
+        }
+    }
+    tracked_free(t, cursor, scratch_bytes);
+    tracked_free(t, mark, scratch_bytes);
+    u32vec_free(t, &decoded);
+
+    LOG("%s: %zu nodes, %u groups, %u dependent edges\n",
+        __func__, groups.node_count, group_count, c->rev_offsets[group_count]);
+    return c;
+
+fail:
+    s->error = HOPSCOTCH_ERROR_MEMORY;
+    tracked_free(t, cursor, scratch_bytes);
+    tracked_free(t, mark, scratch_bytes);
+    u32vec_free(t, &decoded);
+    free_condensation(t, c);
+    return NULL;
+}
+
+static void free_condensation(struct hopscotch *t, struct condensation *c) {
+    if (c == NULL) { return; }
+    charge_memory(t, c->bytes, 0);
+    free(c->node_group);
+    free(c->group_offsets);
+    free(c->members);
+    free(c->rev_offsets);
+    free(c->rev);
+    free(c);
+}
+
+static void set_bit(uint64_t *bits, size_t pos) {
+    bits[pos/64] |= (1LLU << (pos & 63));
+}
+
+static void clear_bit(uint64_t *bits, size_t pos) {
+    bits[pos/64] &= ~(1LLU << (pos & 63));
+}
+
+static bool get_bit(const uint64_t *bits, size_t pos) {
+    return (bits[pos/64] & (1LLU << (pos & 63))) != 0;
+}
+
+/* Account for resizing an allocation from OLD_BYTES to NEW_BYTES.
+ * Growing fails, changing nothing, if it would put T (or the handle
+ * it shares a budget with) over its memory limit; shrinking always
+ * succeeds. Since shard merging threads and solvers on other threads
+ * can allocate at the same time, the count is updated atomically. */
+static bool charge_memory(struct hopscotch *t,
+    size_t old_bytes, size_t new_bytes) {
+    if (t->budget != NULL && !charge_memory(t->budget, old_bytes, new_bytes)) {
+        return false;
+    }
+    if (new_bytes <= old_bytes) {
+        __atomic_fetch_sub(&t->memory_used, old_bytes - new_bytes,
+            __ATOMIC_RELAXED);
+        return true;
+    }
+    const size_t delta = new_bytes - old_bytes;
+    const size_t limit = __atomic_load_n(&t->memory_limit, __ATOMIC_RELAXED);
+    size_t used = __atomic_load_n(&t->memory_used, __ATOMIC_RELAXED);
+    do {
+        if (limit != 0 && (delta > limit || used > limit - delta)) {
+            LOG("%s: %zu more bytes would exceed limit %zu (using %zu)\n",
+                __func__, delta, limit, used);
+            if (t->budget != NULL) {
+                charge_memory(t->budget, new_bytes, old_bytes);
+            }
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&t->memory_used, &used,
+            used + delta, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return true;
+}
+
+/* Like realloc, but counted against T's memory limit (if T is
+ * non-NULL). Returns NULL, leaving P as it was, on failure. */
+static void *tracked_realloc(struct hopscotch *t, void *p,
+    size_t old_bytes, size_t new_bytes) {
+    if (t != NULL && !charge_memory(t, old_bytes, new_bytes)) { return NULL; }
+    void *np = realloc(p, new_bytes);
+    if (np == NULL && t != NULL) { charge_memory(t, new_bytes, old_bytes); }
+    return np;
+}
+
+static void tracked_free(struct hopscotch *t, void *p, size_t bytes) {
+    if (p == NULL) { return; }
+    if (t != NULL) { charge_memory(t, bytes, 0); }
+    free(p);
+}
+
+/* Grow one of a solver's buffers, keeping track of how much it has
+ * been charged, so it can be released when the solver is freed. */
+static void *solver_realloc(struct hopscotch_solver *s, void *p,
+    size_t old_bytes, size_t new_bytes) {
+    assert(new_bytes >= old_bytes);
+    void *np = tracked_realloc(s->t, p, old_bytes, new_bytes);
+    if (np != NULL) { s->charged += new_bytes - old_bytes; }
+    return np;
+}
+
+/* Like `u32vec_reserve`, for a vector owned by solver S. */
+static bool solver_u32vec_reserve(struct hopscotch_solver *s,
+    struct u32vec *v, size_t count) {
+    const size_t old_bytes = (v->buf == NULL
+        ? 0 : (1LLU << v->ceil2) * sizeof(v->buf[0]));
+    if (!u32vec_reserve(s->t, v, count)) { return false; }
+    s->charged += (1LLU << v->ceil2) * sizeof(v->buf[0]) - old_bytes;
+    return true;
+}
+
+static bool u32vec_reserve(struct hopscotch *t, struct u32vec *v,
+    size_t count) {
+    const size_t ncount = v->count + count;
+    if (v->buf != NULL && ncount <= (1LLU << v->ceil2)) { return true; }
+
+    uint8_t nceil2 = (v->buf == NULL ? DEF_SHARD_VEC_CEIL2 : v->ceil2 + 1);
+    while ((1LLU << nceil2) < ncount) { nceil2++; }
+    const size_t old_bytes = (v->buf == NULL
+        ? 0 : (1LLU << v->ceil2) * sizeof(v->buf[0]));
+    uint32_t *nbuf = tracked_realloc(t, v->buf,
+        old_bytes, (1LLU << nceil2) * sizeof(*nbuf));
+    if (nbuf == NULL) { return false; }
+    v->ceil2 = nceil2;
+    v->buf = nbuf;
+    return true;
+}
+
+static bool u8vec_reserve(struct hopscotch *t, struct u8vec *v,
+    size_t count) {
+    const size_t ncount = v->count + count;
+    if (v->buf != NULL && ncount <= (1LLU << v->ceil2)) { return true; }
+
+    uint8_t nceil2 = (v->buf == NULL ? DEF_SHARD_VEC_CEIL2 : v->ceil2 + 1);
+    while ((1LLU << nceil2) < ncount) { nceil2++; }
+    const size_t old_bytes = (v->buf == NULL ? 0 : (1LLU << v->ceil2));
+    uint8_t *nbuf = tracked_realloc(t, v->buf, old_bytes, 1LLU << nceil2);
+    if (nbuf == NULL) { return false; }
+    v->ceil2 = nceil2;
+    v->buf = nbuf;
+    return true;
+}
+
+static void u32vec_free(struct hopscotch *t, struct u32vec *v) {
+    tracked_free(t, v->buf, (1LLU << v->ceil2) * sizeof(v->buf[0]));
+    v->buf = NULL;
+}
+
+static void u8vec_free(struct hopscotch *t, struct u8vec *v) {
+    tracked_free(t, v->buf, 1LLU << v->ceil2);
+    v->buf = NULL;
+}
+
+/* Merge every shard into the graph. Each partition of node IDs is only
+ * ever written by one merging thread, so they don't need to lock. */
+static bool merge_shards(struct hopscotch *t) {
+    bool has_nodes = false;
+    uint32_t max_id = 0;
+    for (struct hopscotch_shard *s = t->shards; s != NULL; s = s->next) {
+        if (s->error != HOPSCOTCH_ERROR_NONE) {
+            t->error = s->error;
+            return false;
+        }
+        if (s->has_nodes && (!has_nodes || s->max_id > max_id)) {
+            max_id = s->max_id;
+            has_nodes = true;
+        }
+    }
+
+    if (has_nodes && max_id >= (1LLU << t->node_ceil2)) {
+        if (!grow_nodes(t, max_id)) { return false; }
+    }
+    if (has_nodes && max_id >= t->id_limit) { t->id_limit = max_id + 1; }
+
+    size_t thread_count = t->shard_count;
+    if (thread_count > SHARD_PARTS) { thread_count = SHARD_PARTS; }
+
+    struct merge_env envs[SHARD_PARTS];
+    for (size_t i = 0; i < thread_count; i++) {
+        envs[i] = (struct merge_env) {
+            .t = t,
+            .first_part = i,
+            .stride = thread_count,
+        };
+    }
+
+    /* The calling thread does the first share of the work itself. */
+    size_t started = 1;
+    for (; started < thread_count; started++) {
+        if (0 != pthread_create(&envs[started].thread, NULL,
+                merge_parts, &envs[started])) {
+            break;
+        }
+    }
+    merge_parts(&envs[0]);
+
+    /* If any threads couldn't be started, do their share here. */
+    for (size_t i = started; i < thread_count; i++) { merge_parts(&envs[i]); }
+
+    bool ok = true;
+    for (size_t i = 0; i < thread_count; i++) {
+        if (i > 0 && i < started) { pthread_join(envs[i].thread, NULL); }
+        if (!envs[i].ok) { ok = false; }
+    }
+
+    free_shards(t);
+    LOG("%s: merged %zu threads, ok %d\n", __func__, thread_count, ok);
+    if (!ok) {
+        t->error = HOPSCOTCH_ERROR_MEMORY;
+        return false;
+    }
+    return true;
+}
+
+static void *merge_parts(void *arg) {
+    struct merge_env *env = arg;
+    struct hopscotch *t = env->t;
+    env->ok = true;
+
+    for (size_t p = env->first_part; p < SHARD_PARTS; p += env->stride) {
+        for (struct hopscotch_shard *s = t->shards; s != NULL; s = s->next) {
+            const struct shard_part *part = &s->parts[p];
+            const uint8_t *labels = part->labels.buf;
+
+            size_t offset = 0;
+            while (offset < part->adds.count) {
+                const uint32_t *rec = &part->adds.buf[offset];
+                const uint32_t node_id = rec[0];
+                const uint32_t succ_count = rec[1];
+                const bool labeled = rec[2];
+                const uint32_t *successors = &rec[3];
+                const bool connected = (succ_count > 1
+                    || (succ_count == 1 && successors[0] != node_id));
+
+                if (!append_successors(t, node_id, succ_count, successors,
+                        labeled ? labels : NULL, connected)) {
+                    env->ok = false;
+                    return NULL;
+                }
+                if (labeled) { labels += succ_count; }
+                offset += 3 + succ_count;
+            }
+
+            for (size_t i = 0; i < part->touches.count; i++) {
+                if (!init_node(t, part->touches.buf[i], 0, true)) {
+                    env->ok = false;
+                    return NULL;
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+static void free_shards(struct hopscotch *t) {
+    struct hopscotch_shard *s = t->shards;
+    while (s != NULL) {
+        struct hopscotch_shard *next = s->next;
+        for (size_t p = 0; p < SHARD_PARTS; p++) {
+            u32vec_free(t, &s->parts[p].adds);
+            u32vec_free(t, &s->parts[p].touches);
+            u8vec_free(t, &s->parts[p].labels);
+        }
+        tracked_free(t, s, sizeof(*s));
+        s = next;
+    }
+    t->shards = NULL;
+    t->shards_tail = NULL;
+    t->shard_count = 0;
+}
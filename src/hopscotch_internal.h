@@ -5,6 +5,8 @@
 
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
 
 /* These are all default log2 ceiling sizes for arrays/buffers that
  * realloc and double on demand. */
@@ -12,9 +14,37 @@
 #define DEF_NODE_CEIL2 2
 #define DEF_SUCC_CEIL2 2
 #define DEF_SCC_BUF_CEIL2 2
+#define DEF_VISITED_CEIL2 2
+#define DEF_FRAME_CEIL2 4
+#define DEF_SHARD_VEC_CEIL2 6
+#define DEF_NAME_SLOT_CEIL2 6
+
+/* Shards split their input into partitions by node ID, so that
+ * each partition can be merged into the graph by a separate thread.
+ * Runs of 2^SHARD_BLOCK_BITS IDs go in the same partition, to keep
+ * threads from writing to neighboring nodes. */
+#define SHARD_PART_BITS 4
+#define SHARD_PARTS (1U << SHARD_PART_BITS)
+#define SHARD_BLOCK_BITS 6
+#define SHARD_PART_OF(ID) (((ID) >> SHARD_BLOCK_BITS) & (SHARD_PARTS - 1))
 
 #define NO_INDEX (UINT32_MAX)
 
+/* Groups up to this size are sorted by insertion sort, rather than
+ * radix sort, since it's faster on a handful of members. */
+#define RADIX_SORT_MIN 32
+
+/* Transitive reduction tracks reachability as one bitset per group,
+ * over a block of target groups at a time, sized to keep all of the
+ * bitsets within about this many bytes. */
+#define REDUCE_BLOCK_BYTES (64LLU << 20)
+
+/* A `struct hopscotch_result`'s buffers, as bits in its owned field
+ * and indexes into its owned_ceil2 array. */
+#define RESULT_NODE_GROUP 0
+#define RESULT_GROUP_OFFSETS 1
+#define RESULT_MEMBERS 2
+
 /* #define USE_LOG */
 
 #ifdef USE_LOG
@@ -25,11 +55,32 @@
 #endif
 
 struct node;
+struct condensation;
 
 enum hopscotch_state {
     HOPSCOTCH_CREATED,
     HOPSCOTCH_SEALED,
-    HOPSCOTCH_SOLVED,
+};
+
+/* A slot in the name index. Since it has the name's length and
+ * location, a lookup only reads the slot and the name itself. */
+struct name_slot {
+    uint32_t tag;               /* upper 32 bits of the name's hash */
+    uint32_t len;
+    size_t offset;              /* of the name in name_bytes, 0 if empty */
+};
+
+/* Vectors that double in size on demand. */
+struct u32vec {
+    uint8_t ceil2;
+    size_t count;
+    uint32_t *buf;
+};
+
+struct u8vec {
+    uint8_t ceil2;
+    size_t count;
+    uint8_t *buf;
 };
 
 struct hopscotch {
@@ -37,52 +88,415 @@ struct hopscotch {
     enum hopscotch_error error;
     uint8_t node_ceil2;
     struct node *nodes;
+    size_t id_limit;            /* 1 + highest node ID added */
 
-    uint32_t index;
-    uint32_t link;
+    /* Bytes allocated for the handle and its solvers, updated
+     * atomically, and the most allowed (0 for no limit). */
+    size_t memory_used;
+    size_t memory_limit;
 
-    uint8_t stack_ceil2;
-    size_t stack_top;
-    uint32_t *stack;
+    /* If set, a handle whose limit this one's allocations also count
+     * against (see `hopscotch_share_memory_limit`). */
+    struct hopscotch *budget;
+
+    /* Solver used by `hopscotch_solve` and friends, created on demand. */
+    struct hopscotch_solver *solver;
+
+    /* Protects the shard list and building the condensation. */
+    pthread_mutex_t lock;
+
+    /* Built on demand by `hopscotch_impact`. */
+    struct condensation *cond;
+
+    /* Varint-encoded successors for every node, once compressed. */
+    bool compressed;
+    struct u8vec packed;
+
+    /* Once renumbered, maps between internal node IDs (positions in
+     * nodes) and the caller's IDs. Both are NULL otherwise. */
+    uint32_t *ext_ids;
+    uint32_t *int_ids;
+
+    /* Node ID -> weight, for `hopscotch_critical_path`. */
+    uint8_t weight_ceil2;
+    uint64_t *weights;
+
+    /* Node ID -> payload, payload_size bytes each. */
+    size_t payload_size;
+    uint8_t payload_ceil2;
+    uint8_t *payloads;
+
+    /* Interned names, for `hopscotch_add_named`: each is stored in
+     * name_bytes as its ID, then the name, NUL-terminated, starting at
+     * name_offsets[ID] (name_count + 1 entries), and indexed by an
+     * open-addressed hash table. */
+    uint32_t name_count;
+    struct u8vec name_bytes;
+    uint8_t name_offset_ceil2;
+    size_t *name_offsets;
+    uint8_t name_slot_ceil2;
+    struct name_slot *name_slots;
+    struct u32vec name_succ;    /* successor IDs for hopscotch_add_named */
+
+    /* Shards, in creation order, to be merged when sealing. */
+    size_t shard_count;
+    struct hopscotch_shard *shards;
+    struct hopscotch_shard *shards_tail;
 };
 
+struct shard_part {
+    struct u32vec adds;         /* add records, see hopscotch_shard_add */
+    struct u32vec touches;      /* IDs of connected successors */
+    struct u8vec labels;        /* labels for labeled add records */
+};
+
+struct hopscotch_shard {
+    struct hopscotch *t;
+    struct hopscotch_shard *next;
+    enum hopscotch_error error;
+    bool has_nodes;
+    uint32_t max_id;
+    struct shard_part parts[SHARD_PARTS];
+};
+
+struct merge_env {
+    struct hopscotch *t;
+    pthread_t thread;
+    size_t first_part;
+    size_t stride;
+    bool ok;
+};
+
+/* A node in the graph. Once the graph is sealed, nodes are read-only;
+ * all state used while solving lives in a `struct hopscotch_solver`. */
 struct node {
     const uint32_t id;
-    uint32_t index;
-    uint32_t lowlink;
 
     /* Note: This vector-based implementation just automatically
      * collapses duplicates, because it only adds successor nodes
      * that have already been processed. */
     uint8_t succ_ceil;
     bool used;
-    bool stacked;
     bool connected;
+    bool labeled;
     size_t succ_count;
     uint32_t *succ;
+    size_t packed;              /* offset into t->packed, once compressed */
+
+    /* Per-edge label bitmasks, parallel to succ. This is only used
+     * once an edge with a label has been added (and labeled is set);
+     * until then, edges have HOPSCOTCH_LABEL_DEFAULT. Like succ, it
+     * may be kept for reuse after the node is reset. */
+    uint8_t *labels;
 };
 
-struct solve_env {
+/* A node being visited by the DFS, and its next successor to check. */
+struct frame {
+    uint32_t node_id;
+    bool root;                  /* Pearce: still possibly a group's root */
+    size_t succ_i;
+
+    /* Cursor into a compressed successor list: the byte offset of the
+     * next successor, and the last one decoded. */
+    uint32_t pos;
+    uint32_t prev;
+};
+
+/* All of the mutable state for solving a sealed graph. Several solvers
+ * can work on the same graph at once, since they only read from it. */
+struct hopscotch_solver {
     struct hopscotch *t;
+    enum hopscotch_error error;
+    size_t charged;             /* bytes counted against t's limit */
+    size_t impact_bytes;        /* of those, for impact scratch space */
+    size_t max_depth;
+    uint8_t label_mask;
+    enum hopscotch_member_order member_order;
+    enum hopscotch_engine engine;
+
+    /* Per-node DFS state, indexed by node ID. Pearce's algorithm
+     * only uses index (as its rindex), and leaves the rest NULL. */
+    size_t node_ceil;
+    uint32_t *index;
+    uint32_t *lowlink;
+    uint64_t *stacked;          /* bitset */
+    uint32_t next_index;
+
+    /* Pearce: next component number, counting down. Components are
+     * numbered above every index in use, so finished nodes never
+     * lower a live node's index. */
+    uint32_t next_component;
+
+    uint8_t stack_ceil2;
+    size_t stack_top;
+    uint32_t *stack;
+
     uint8_t scc_buf_ceil;
     uint32_t *scc_buf;
+
+    /* Scratch space for radix sorting groups, allocated on demand. */
+    uint8_t sort_tmp_ceil2;
+    uint32_t *sort_tmp;
+
+    /* DFS frames, in place of recursion. */
+    uint8_t frame_ceil2;
+    size_t frame_top;
+    struct frame *frames;
+
+    /* Every node given an index while solving from roots, so
+     * their state can be cleared afterward. */
+    uint8_t visited_ceil;
+    size_t visited_count;
+    uint32_t *visited;
+
+    /* Scratch space for impact queries, allocated on demand. */
+    uint64_t *impact_seen;      /* bitset of groups, kept clear */
+    uint32_t *impact_queue;     /* BFS queue of groups */
+    uint32_t *impact_affected;  /* affected nodes, returned to caller */
+
+    /* Successors decoded or mapped by `hopscotch_solver_get_successors`. */
+    struct u32vec succ_buf;
+};
+
+struct solve_env {
+    struct hopscotch_solver *s;
     uint32_t scc_id;
     size_t max_depth;
+    uint8_t label_mask;
+    hopscotch_solve_cb *cb;
+    void *udata;
+    bool track_visited;
+    struct hopscotch_result *into; /* if set, used instead of cb */
+    bool yield;                 /* set to pause the DFS after a group */
+};
+
+/* An iterator walks through the same two passes as solve_all, but
+ * pauses after each group. The DFS frames are kept in its solver, so
+ * the search can pick up where it left off. */
+enum iter_phase {
+    ITER_DISCONNECTED,
+    ITER_CONNECTED,
+    ITER_DONE,
+};
+
+struct hopscotch_iter {
+    struct hopscotch_solver *s;
+    struct solve_env env;
+    enum iter_phase phase;
+    size_t next_id;             /* next node to start from, in phase */
+
+    /* The last group found. */
+    uint32_t group_id;
+    size_t group_count;
+    const uint32_t *group;
+
+    /* The last group's payloads, for `hopscotch_iter_payloads`. */
+    uint8_t payload_ceil2;
+    uint8_t *payload_buf;
+};
+
+/* Shared by the threads in `hopscotch_solve_many`. */
+struct many_env {
+    size_t count;
+    struct hopscotch *const *graphs;
+    hopscotch_solve_many_cb *cb;
+    void *udata;
+    size_t next;                /* next graph to claim, atomic */
+    bool ok;                    /* cleared on any failure, atomic */
+};
+
+struct many_worker {
+    struct many_env *env;
+    pthread_t thread;
+    struct hopscotch_solver *s; /* rebound to each graph in turn */
+};
+
+/* A Chase-Lev work-stealing deque of group IDs: its owner pushes and
+ * pops at the bottom, and other workers steal from the top. It has room
+ * for every group, so it never wraps or grows. */
+struct exec_deque {
+    int64_t top;                /* atomic */
+    int64_t bottom;             /* atomic */
+    uint32_t *buf;
+};
+
+struct exec_env {
+    const struct condensation *c;
     hopscotch_solve_cb *cb;
     void *udata;
+    size_t nthreads;
+    struct exec_worker *workers;
+    uint32_t *pending;          /* group ID -> unfinished deps, atomic */
+    uint32_t remaining;         /* unfinished groups, atomic */
+    /* Idle workers sleep on `wake` until there's more work to steal,
+     * or everything has finished. */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    uint32_t pushes;            /* groups queued so far, atomic */
+    uint32_t sleepers;          /* workers waiting on `wake`, atomic */
+};
+
+struct exec_worker {
+    struct exec_env *env;
+    size_t index;
+    pthread_t thread;
+    struct exec_deque deque;
+};
+
+/* Passed through to `many_cb`, to add the graph index. */
+struct many_cb_env {
+    size_t graph_index;
+    hopscotch_solve_many_cb *cb;
+    void *udata;
+};
+
+/* The solved graph's groups, with edges from each group to the
+ * groups that depend on it. Once built, this is read-only. */
+struct condensation {
+    uint32_t group_count;
+    uint32_t *node_group;       /* node ID -> group ID */
+    uint32_t *group_offsets;    /* group ID -> offset into members */
+    uint32_t *members;          /* members, in group order */
+
+    uint32_t *rev_offsets;      /* group ID -> offset into rev */
+    uint32_t *rev;              /* dependent group IDs */
+
+    size_t bytes;               /* counted against the handle's limit */
 };
 
 static bool init_node(struct hopscotch *t, uint32_t node_id,
     uint8_t hint, bool connected);
 
+static bool init_labels(struct hopscotch *t, struct node *n);
+static bool append_successors(struct hopscotch *t, uint32_t node_id,
+    size_t succ_count, const uint32_t *successors, const uint8_t *labels,
+    bool connected);
 static bool grow_nodes(struct hopscotch *t, uint32_t new_max_id);
+static bool pack_node(struct hopscotch *t, struct node *n, uint64_t *pairs);
+static void pack_varint(uint8_t *buf, size_t *pos, uint32_t v);
+static uint32_t unpack_succ(const uint8_t *buf, uint32_t *pos,
+    uint32_t prev, bool first);
+static const uint32_t *get_succ(struct hopscotch *t,
+    const struct node *n, struct u32vec *buf);
+static int cmp_uint64_t(const void *a, const void *b);
+static bool order_nodes(struct hopscotch *t, enum hopscotch_node_order order,
+    uint32_t *by_pos, uint32_t *pos_of);
+static size_t place_bfs(const struct hopscotch *t, uint32_t start,
+    uint32_t *by_pos, uint32_t *pos_of, size_t placed, uint64_t *pairs);
+static bool place_dfs(struct hopscotch *t, uint32_t start,
+    uint32_t *by_pos, uint32_t *pos_of, size_t *placed, struct u32vec *stack);
+static uint64_t *nodes_by_degree(struct hopscotch *t, bool descending);
+static uint64_t group_weight(const struct hopscotch *t,
+    const struct hopscotch_result *res, uint32_t g);
+static bool group_edges(struct hopscotch *t,
+    const struct hopscotch_result *res, uint32_t **offsets,
+    struct u32vec *edges);
+static uint64_t mix64(uint64_t x);
+static void copy_payloads(const struct hopscotch *t, size_t count,
+    const uint32_t *ids, uint8_t *out);
+static uint64_t hash_name(const char *name, size_t len);
+static size_t find_name(const struct hopscotch *t, const char *name,
+    size_t len, uint64_t hash);
+static bool grow_name_slots(struct hopscotch *t);
+static void reduce_block(const uint32_t *offsets, const uint32_t *edges,
+    uint32_t group_count, uint32_t lo, uint32_t hi, size_t words,
+    uint64_t *rows, bool *redundant);
+static uint32_t to_external(const struct hopscotch *t, uint32_t id);
+static uint32_t to_internal(const struct hopscotch *t, uint32_t id);
+static bool edge_in_mask(const struct node *n, size_t si, uint8_t mask);
+
+static struct hopscotch_solver *new_solver(struct hopscotch *t,
+    const struct hopscotch_solver_config *config);
+static struct hopscotch_solver *get_solver(struct hopscotch *t);
+static bool solver_fit(struct hopscotch_solver *s);
+static void solver_clear_impact(struct hopscotch_solver *s);
+static bool solve_all(struct hopscotch_solver *s, uint8_t label_mask,
+    size_t max_depth, hopscotch_solve_cb *cb, void *udata,
+    struct hopscotch_result *into);
+static bool solve_roots(struct hopscotch_solver *s,
+    size_t root_count, const uint32_t *roots, uint8_t label_mask,
+    size_t max_depth, hopscotch_solve_cb *cb, void *udata);
 
 static void report_disconnected(struct solve_env *env, uint32_t node_id);
-static bool strongconnect(struct solve_env *env,
-    uint32_t node_id, size_t depth);
+static bool strongconnect(struct solve_env *env, uint32_t root_id);
+static bool resume_dfs(struct solve_env *env);
+static bool pearce_resume_dfs(struct solve_env *env);
+static bool next_member(struct hopscotch_solver *s, uint32_t root_id,
+    size_t used, uint32_t *member);
+static void iter_cb(uint32_t group_id,
+    size_t group_count, const uint32_t *group, void *udata);
+static bool visit_node(struct solve_env *env, uint32_t node_id);
+static bool emit_group(struct solve_env *env, uint32_t root_id);
+static bool emit_group_into(struct solve_env *env, uint32_t root_id);
+static bool order_group(struct hopscotch_solver *s,
+    uint32_t *group, size_t count);
+static bool sort_group(struct hopscotch_solver *s,
+    uint32_t *group, size_t count);
+
+static enum hopscotch_verify_res verify_members(const struct hopscotch *t,
+    const struct hopscotch_result *res, uint64_t *seen);
+static enum hopscotch_verify_res verify_edges(struct hopscotch *t,
+    const struct hopscotch_result *res, uint32_t *rev_offsets,
+    struct u32vec *decoded);
+static enum hopscotch_verify_res verify_connected(struct hopscotch *t,
+    const struct hopscotch_result *res, const uint32_t *rev_offsets,
+    const uint32_t *rev, uint64_t *seen, uint32_t *queue,
+    struct u32vec *decoded);
+
+static size_t count_nodes(const struct hopscotch *t);
+static bool prepare_result(struct hopscotch_result *res,
+    size_t id_limit, size_t node_count);
+static bool reserve_result_buf(struct hopscotch_result *res,
+    uint8_t which, uint32_t **buf, size_t count);
+
+static void *solve_many_worker(void *arg);
+static bool solve_many_graph(struct many_worker *w, size_t graph_index);
+static void many_cb(uint32_t group_id,
+    size_t group_count, const uint32_t *group, void *udata);
+
+static void *execute_worker(void *arg);
+static void execute_wait(struct exec_env *env, uint32_t pushes);
+static void execute_wake(struct exec_env *env, bool all);
+static void execute_group(struct exec_worker *w, uint32_t group_id);
+static bool steal_group(struct exec_worker *w, uint32_t *group_id);
+static void deque_push(struct exec_deque *d, uint32_t group_id);
+static bool deque_pop(struct exec_deque *d, uint32_t *group_id);
+static bool deque_steal(struct exec_deque *d, uint32_t *group_id,
+    bool *contended);
+
+static const struct condensation *get_condensation(struct hopscotch_solver *s);
+static struct condensation *build_condensation(struct hopscotch_solver *s);
+static void free_condensation(struct hopscotch *t, struct condensation *c);
+
+static void set_bit(uint64_t *bits, size_t pos);
+static void clear_bit(uint64_t *bits, size_t pos);
+static bool get_bit(const uint64_t *bits, size_t pos);
+
+static bool charge_memory(struct hopscotch *t,
+    size_t old_bytes, size_t new_bytes);
+static void *tracked_realloc(struct hopscotch *t, void *p,
+    size_t old_bytes, size_t new_bytes);
+static void tracked_free(struct hopscotch *t, void *p, size_t bytes);
+static void *solver_realloc(struct hopscotch_solver *s, void *p,
+    size_t old_bytes, size_t new_bytes);
+static bool solver_u32vec_reserve(struct hopscotch_solver *s,
+    struct u32vec *v, size_t count);
+static bool u32vec_reserve(struct hopscotch *t, struct u32vec *v,
+    size_t count);
+static bool u8vec_reserve(struct hopscotch *t, struct u8vec *v,
+    size_t count);
+static void u32vec_free(struct hopscotch *t, struct u32vec *v);
+static void u8vec_free(struct hopscotch *t, struct u8vec *v);
+static bool merge_shards(struct hopscotch *t);
+static void *merge_parts(void *arg);
+static void free_shards(struct hopscotch *t);
+
+static bool mark_visited(struct solve_env *env, uint32_t node_id);
+static void clear_visited(struct hopscotch_solver *s);
+static void clear_stack(struct hopscotch_solver *s);
 
-static bool is_stacked(struct hopscotch *t, uint32_t node_id);
-static bool push_node(struct hopscotch *t, uint32_t node_id);
-static uint32_t pop_node(struct hopscotch *t);
+static bool is_stacked(const struct hopscotch_solver *s, uint32_t node_id);
+static bool push_node(struct hopscotch_solver *s, uint32_t node_id);
+static uint32_t pop_node(struct hopscotch_solver *s);
 
 #endif
@@ -14,9 +14,14 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <stdio.h>
 
@@ -29,77 +34,336 @@
 #include <string.h>
 
 #include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_SSE2 1
+#define HAVE_AVX2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SSE2 1
+#endif
 
 #include "hopscotch.h"
-#include "symtab.h"
 
-char buf[64 * 1024LLU];
+#define DEF_LINE_NAMES_CEIL 3
+#define DEF_ARRAY_CEIL2 8
+
+/* Size of each read() when the input can't be mapped (e.g. a pipe).
+ * The buffer doubles to fit any line longer than this. */
+#define READ_CHUNK (1LLU << 20)
+
+/* With -j, inputs are split into chunks of at least this many bytes,
+ * parsed on at most MAX_JOBS threads. */
+#define MIN_CHUNK_SIZE (1LLU << 20)
+#define MAX_JOBS 256
 
-#define DEF_LINE_IDS_CEIL 3
+/* Output is collected here and written in blocks this size. */
+#define OUT_BUF_SIZE (1LLU << 20)
+
+/* Binary output starts with this, then the version, as a 32-bit int. */
+#define BINARY_MAGIC "HSCB"
+#define BINARY_VERSION 1
+
+enum input_format {
+    INPUT_ADJ,                  /* head: succ succ ... */
+    INPUT_EDGES,                /* from to, one edge per line */
+    INPUT_MAKE,                 /* Makefile rules, as from cc -MD */
+    INPUT_DOT,                  /* Graphviz DOT */
+};
+
+enum output_format {
+    FORMAT_TEXT,
+    FORMAT_DOT,
+    FORMAT_JSON,                /* JSON lines, one group per line */
+    FORMAT_TSV,                 /* name<TAB>group_id, one node per line */
+    FORMAT_BINARY,              /* see README */
+};
 
 struct main_env {
     struct hopscotch *t;
-    struct symtab *s;
-    bool dot;
+    enum input_format input;
+    enum output_format format;
+    bool verify;
+    bool renumber;
+    enum hopscotch_node_order order;
+    bool weights;
+    bool reduce;
+    size_t memory_limit;
 
-    FILE *in;
+    /* With -t, the groups and their reduced edges, for print_cb. */
+    const struct hopscotch_result *result;
+    const struct hopscotch_reduction *red;
 
-    /* Buffer for IDs read from the current line, grown on demand */
-    uint8_t line_ids_ceil;
-    uint32_t *line_ids;
+    /* Input files, or stdin if none, and how many threads parse them. */
+    int path_count;
+    char **paths;
+    size_t jobs;
+    enum hopscotch_error load_error;
 };
 
-/* static bool
- * intern(struct main_env *env, size_t len, const char *name,
- *     struct symtab_symbol **s, uint32_t *id); */
-
 static void usage(const char *msg) {
     if (msg) { fprintf(stderr, "%s\n\n", msg); }
     fprintf(stderr, "hopscotch v. %d.%d.%d by %s\n",
         HOPSCOTCH_VERSION_MAJOR, HOPSCOTCH_VERSION_MINOR,
         HOPSCOTCH_VERSION_PATCH, HOPSCOTCH_AUTHOR);
     fprintf(stderr,
-        "Usage: hopscotch [-d] [input_file]\n"
+        "Usage: hopscotch [-d [-t]] [-i FORMAT] [-j JOBS] [-m LIMIT] [-o FORMAT]\n"
+        "                 [-r ORDER] [-v] [-w] [input_file ...]\n"
+        "    -d: print Graphviz dot (same as -o dot)\n"
+        "    -i: input FORMAT: adj (default, \"head: succ ...\"), edges\n"
+        "        (\"from to\"), make (dependency files from cc -MD), or dot\n"
+        "    -j: parse input on JOBS threads (default: one per CPU)\n"
+        "    -m: fail rather than use more than LIMIT bytes of memory\n"
+        "        (with an optional k, m, or g suffix)\n"
+        "    -o: output FORMAT: text (default), dot, json, tsv, or binary\n"
+        "    -t: only draw edges between groups not implied by other paths\n"
+        "    -r: renumber nodes before solving, for locality\n"
+        "        (ORDER: bfs, dfs, rcm, or degree)\n"
+        "    -v: verify the result before printing it\n"
+        "    -w: read weights (as NAME=WEIGHT at the start of an adj or edges line),\n"
+        "        and print the critical path (with text, dot, or json)\n"
         );
     exit(1);
 }
 
+static size_t parse_size(const char *str) {
+    char *end = NULL;
+    errno = 0;
+    unsigned long long res = strtoull(str, &end, 10);
+    if (errno != 0 || end == str) { usage("Bad memory limit"); }
+    unsigned shift = 0;
+    switch (*end) {
+    case '\0': break;
+    case 'k': case 'K': shift = 10; end++; break;
+    case 'm': case 'M': shift = 20; end++; break;
+    case 'g': case 'G': shift = 30; end++; break;
+    default: usage("Bad memory limit");
+    }
+    if (*end != '\0' || res == 0 || res > (SIZE_MAX >> shift)) {
+        usage("Bad memory limit");
+    }
+    return (size_t)res << shift;
+}
+
 static void handle_args(struct main_env *env, int argc, char **argv) {
     int fl;
-    while ((fl = getopt(argc, argv, "dh")) != -1) {
+    while ((fl = getopt(argc, argv, "dhi:j:m:o:r:tvw")) != -1) {
         switch (fl) {
         case 'd':               /* dot */
-            env->dot = true;
+            env->format = FORMAT_DOT;
             break;
         case 'h':               /* help */
             usage(NULL);
             break;
+        case 'i':               /* input format */
+            if (0 == strcmp(optarg, "adj")) {
+                env->input = INPUT_ADJ;
+            } else if (0 == strcmp(optarg, "edges")) {
+                env->input = INPUT_EDGES;
+            } else if (0 == strcmp(optarg, "make")) {
+                env->input = INPUT_MAKE;
+            } else if (0 == strcmp(optarg, "dot")) {
+                env->input = INPUT_DOT;
+            } else {
+                usage("Bad input format");
+            }
+            break;
+        case 'j':               /* jobs */
+        {
+            char *end = NULL;
+            errno = 0;
+            const unsigned long jobs = strtoul(optarg, &end, 10);
+            if (errno != 0 || end == optarg || *end != '\0'
+                || jobs == 0 || jobs > MAX_JOBS) {
+                usage("Bad job count");
+            }
+            env->jobs = jobs;
+            break;
+        }
+        case 'm':               /* memory limit */
+            env->memory_limit = parse_size(optarg);
+            break;
+        case 'o':               /* output format */
+            if (0 == strcmp(optarg, "text")) {
+                env->format = FORMAT_TEXT;
+            } else if (0 == strcmp(optarg, "dot")) {
+                env->format = FORMAT_DOT;
+            } else if (0 == strcmp(optarg, "json")) {
+                env->format = FORMAT_JSON;
+            } else if (0 == strcmp(optarg, "tsv")) {
+                env->format = FORMAT_TSV;
+            } else if (0 == strcmp(optarg, "binary")) {
+                env->format = FORMAT_BINARY;
+            } else {
+                usage("Bad output format");
+            }
+            break;
+        case 'r':               /* renumber */
+            env->renumber = true;
+            if (0 == strcmp(optarg, "bfs")) {
+                env->order = HOPSCOTCH_ORDER_BFS;
+            } else if (0 == strcmp(optarg, "dfs")) {
+                env->order = HOPSCOTCH_ORDER_DFS;
+            } else if (0 == strcmp(optarg, "rcm")) {
+                env->order = HOPSCOTCH_ORDER_RCM;
+            } else if (0 == strcmp(optarg, "degree")) {
+                env->order = HOPSCOTCH_ORDER_DEGREE;
+            } else {
+                usage("Bad renumbering order");
+            }
+            break;
+        case 't':               /* transitive reduction */
+            env->reduce = true;
+            break;
+        case 'v':               /* verify */
+            env->verify = true;
+            break;
+        case 'w':               /* weights */
+            env->weights = true;
+            break;
         case '?':
         default:
             usage(NULL);
         }
     }
 
+    if (env->reduce && env->format != FORMAT_DOT) { usage("-t requires -d"); }
+    if (env->weights && env->input != INPUT_ADJ && env->input != INPUT_EDGES) {
+        usage("-w requires adj or edges input");
+    }
+
     argc -= (optind - 1);
     argv += (optind - 1);
 
-    if (argc > 1) {
-        env->in = fopen(argv[1], "r");
-        if (env->in == NULL) {
-            err(1, "fopen: %s", argv[1]);
-        }
+    env->path_count = argc - 1;
+    env->paths = &argv[1];
+
+    if (env->jobs == 0) {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        env->jobs = (cpus <= 0 ? 1 : cpus > MAX_JOBS ? MAX_JOBS : (size_t)cpus);
     }
 }
 
 static void
 print_cb(uint32_t group_id, size_t count, const uint32_t *group, void *udata);
 
-#define MAX_LENGTH 256
+/* Output goes through one large buffer, with integers formatted by
+ * hand, rather than through stdio for every token. */
+static struct {
+    size_t used;
+    char buf[OUT_BUF_SIZE];
+} out;
 
-struct symbol {
-    uint8_t len;
-    char name[MAX_LENGTH];
-};
+static void write_all(const char *p, size_t len) {
+    while (len > 0) {
+        const ssize_t wr = write(STDOUT_FILENO, p, len);
+        if (wr == -1) {
+            if (errno == EINTR) { continue; }
+            err(1, "write");
+        }
+        p += wr;
+        len -= wr;
+    }
+}
+
+static void out_flush(void) {
+    write_all(out.buf, out.used);
+    out.used = 0;
+}
+
+static void out_bytes(const void *p, size_t len) {
+    if (len > OUT_BUF_SIZE - out.used) {
+        out_flush();
+        /* Too big to buffer, so write it as-is. */
+        if (len > OUT_BUF_SIZE) {
+            write_all(p, len);
+            return;
+        }
+    }
+    memcpy(&out.buf[out.used], p, len);
+    out.used += len;
+}
+
+static void out_str(const char *str) {
+    out_bytes(str, strlen(str));
+}
+
+static void out_char(char c) {
+    if (out.used == OUT_BUF_SIZE) { out_flush(); }
+    out.buf[out.used++] = c;
+}
+
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324"
+    "25262728293031323334353637383940414243444546474849"
+    "50515253545556575859606162636465666768697071727374"
+    "75767778798081828384858687888990919293949596979899";
+
+static void out_u64(uint64_t v) {
+    char tmp[20];
+    size_t i = sizeof(tmp);
+    while (v >= 100) {
+        const size_t pair = 2*(v % 100);
+        v /= 100;
+        tmp[--i] = digit_pairs[pair + 1];
+        tmp[--i] = digit_pairs[pair];
+    }
+    if (v >= 10) {
+        tmp[--i] = digit_pairs[2*v + 1];
+        tmp[--i] = digit_pairs[2*v];
+    } else {
+        tmp[--i] = '0' + v;
+    }
+    out_bytes(&tmp[i], sizeof(tmp) - i);
+}
+
+/* Binary output is little-endian, whatever the host. */
+static void out_le32(uint32_t v) {
+    const uint8_t bytes[4] = { v, v >> 8, v >> 16, v >> 24 };
+    out_bytes(bytes, sizeof(bytes));
+}
+
+/* Write a name as a JSON string, escaping quotes, backslashes, and
+ * control characters. */
+static void out_json_str(const char *name, size_t len) {
+    out_char('"');
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        const unsigned char c = name[i];
+        if (c >= 0x20 && c != '"' && c != '\\') { continue; }
+        out_bytes(&name[start], i - start);
+        if (c == '"' || c == '\\') {
+            out_char('\\');
+            out_char(c);
+        } else {
+            const char hex[] = "0123456789abcdef";
+            const char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0f] };
+            out_bytes(esc, sizeof(esc));
+        }
+        start = i + 1;
+    }
+    out_bytes(&name[start], len - start);
+    out_char('"');
+}
+
+/* Write a name as a quoted DOT string. Backslashes are escaped too,
+ * since Graphviz reads escapes like \n in labels. */
+static void out_dot_str(const char *name, size_t len) {
+    out_char('"');
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (name[i] != '"' && name[i] != '\\') { continue; }
+        out_bytes(&name[start], i - start);
+        out_char('\\');
+        out_char(name[i]);
+        start = i + 1;
+    }
+    out_bytes(&name[start], len - start);
+    out_char('"');
+}
 
 static const char *
 getenv_attr(const char *key) {
@@ -111,129 +375,1471 @@ getenv_attr(const char *key) {
 static const char *indent_regular = "    ";
 static const char *indent_cluster = "        ";
 
+static void print_dot_edge(const char *indent, uint32_t from, uint32_t to) {
+    out_str(indent);
+    out_char('n');
+    out_u64(from);
+    out_bytes(" -> n", 5);
+    out_u64(to);
+    out_char('\n');
+}
+
+static void print_dot(struct main_env *env, uint32_t group_id,
+        size_t group_count, const uint32_t *group) {
+    bool cluster = group_count > 1;
+    const char *indent = indent_regular;
+    if (cluster) {
+        out_str(indent);
+        out_str("subgraph cluster_");
+        out_u64(group_id);
+        out_str(" {\n");
+        indent = indent_cluster;
+        out_str(indent);
+        out_str("graph [");
+        out_str(getenv_attr("HOPSCOTCH_DOT_CLUSTER_ATTR"));
+        out_str("];\n");
+    }
+
+    for (size_t g_i = 0; g_i < group_count; g_i++) {
+        const uint32_t root_id = group[g_i];
+        size_t len;
+        const char *name = hopscotch_name(env->t, root_id, &len);
+        assert(name);
+        out_str(indent);
+        out_char('n');
+        out_u64(root_id);
+        out_str(" [label=");
+        out_dot_str(name, len);
+        out_str("];\n");
+    }
+
+    if (cluster) {
+        out_str("    }\n");
+        indent = indent_regular;
+    }
+
+    for (size_t g_i = 0; g_i < group_count; g_i++) {
+        const uint32_t root_id = group[g_i];
+
+        const uint32_t *successors = NULL;
+        size_t succ_count = 0;
+        if (!hopscotch_get_successors(env->t, root_id, &succ_count, &successors)) {
+            assert(false);
+        }
+
+        for (size_t s_i = 0; s_i < succ_count; s_i++) {
+            const uint32_t edge_id = successors[s_i];
+            /* Edges between groups come from the reduction. */
+            if (env->red != NULL && env->result->node_group[edge_id]
+                != env->result->node_group[root_id]) {
+                continue;
+            }
+            print_dot_edge(indent, root_id, edge_id);
+        }
+    }
+
+    if (env->red != NULL) {
+        const struct hopscotch_result *res = env->result;
+        const uint32_t *offsets = env->red->offsets;
+        for (uint32_t ei = offsets[group_id]; ei < offsets[group_id + 1]; ei++) {
+            const uint32_t h = env->red->edges[ei];
+            print_dot_edge(indent, group[0],
+                res->members[res->group_offsets[h]]);
+        }
+    }
+
+    out_char('\n');
+}
+
 static void print_cb(uint32_t group_id,
         size_t group_count, const uint32_t *group, void *udata) {
     (void)udata;
     struct main_env *env = (struct main_env *)udata;
     assert(env);
 
-    if (env->dot) {
-        bool cluster = group_count > 1;
-        const char *indent = indent_regular;
-        if (cluster) {
-            printf("%ssubgraph cluster_%d {\n", indent, group_id);
-            indent = indent_cluster;
-            printf("%sgraph [%s];\n", indent, getenv_attr("HOPSCOTCH_DOT_CLUSTER_ATTR"));
+    size_t len;
+    const char *name;
+    switch (env->format) {
+    case FORMAT_DOT:
+        print_dot(env, group_id, group_count, group);
+        break;
+
+    case FORMAT_TEXT:
+        out_u64(group_id);
+        out_bytes(": ", 2);
+        for (size_t i = 0; i < group_count; i++) {
+            name = hopscotch_name(env->t, group[i], &len);
+            assert(name);
+            out_bytes(name, len);
+            out_char(' ');
         }
+        out_char('\n');
+        break;
 
-        for (size_t g_i = 0; g_i < group_count; g_i++) {
-            const uint32_t root_id = group[g_i];
-            const struct symtab_symbol *sym = symtab_get(env->s, root_id);
-            assert(sym);
-            printf("%sn%u [label=\"%s\"];\n", indent, root_id, sym->str);
+    case FORMAT_JSON:
+        out_str("{\"group\":");
+        out_u64(group_id);
+        out_str(",\"nodes\":[");
+        for (size_t i = 0; i < group_count; i++) {
+            name = hopscotch_name(env->t, group[i], &len);
+            assert(name);
+            if (i > 0) { out_char(','); }
+            out_json_str(name, len);
         }
+        out_str("]}\n");
+        break;
 
-        if (cluster) {
-            printf("    }\n");
-            indent = indent_regular;
+    case FORMAT_TSV:
+        for (size_t i = 0; i < group_count; i++) {
+            name = hopscotch_name(env->t, group[i], &len);
+            assert(name);
+            out_bytes(name, len);
+            out_char('\t');
+            out_u64(group_id);
+            out_char('\n');
         }
+        break;
 
-        for (size_t g_i = 0; g_i < group_count; g_i++) {
-            const uint32_t root_id = group[g_i];
+    case FORMAT_BINARY:
+        out_le32(group_id);
+        out_le32(group_count);
+        for (size_t i = 0; i < group_count; i++) {
+            name = hopscotch_name(env->t, group[i], &len);
+            assert(name);
+            out_le32(len);
+            out_bytes(name, len);
+        }
+        break;
+    }
+}
 
-            const uint32_t *successors = NULL;
-            size_t succ_count = 0;
-            if (!hopscotch_get_successors(env->t, root_id, &succ_count, &successors)) {
-                assert(false);
-            }
+static const char *verify_res_str(enum hopscotch_verify_res vres) {
+    switch (vres) {
+    case HOPSCOTCH_VERIFY_OK: return "ok";
+    case HOPSCOTCH_VERIFY_MISUSE: return "misuse";
+    case HOPSCOTCH_VERIFY_BAD_MEMBERS: return "node missing or repeated";
+    case HOPSCOTCH_VERIFY_NOT_CONNECTED: return "group not strongly connected";
+    case HOPSCOTCH_VERIFY_BAD_ORDER: return "groups out of order";
+    case HOPSCOTCH_VERIFY_ERROR_MEMORY: return "allocation failure";
+    default: return "unknown";
+    }
+}
 
-            for (size_t s_i = 0; s_i < succ_count; s_i++) {
-                const uint32_t edge_id = successors[s_i];
-                printf("%sn%u -> n%u\n", indent, root_id, edge_id);
-            }
+static void print_critical_path(struct main_env *env,
+    const struct hopscotch_result *result,
+    const struct hopscotch_critical_path *cp) {
+    if (env->format == FORMAT_JSON) {
+        out_str("{\"critical_path\":[");
+        for (uint32_t i = 0; i < cp->path_length; i++) {
+            if (i > 0) { out_char(','); }
+            out_u64(cp->path[i]);
+        }
+        out_str("],\"total\":");
+        out_u64(cp->total);
+        out_str("}\n");
+        return;
+    }
+
+    out_str(env->format == FORMAT_DOT ? "    // " : "");
+    out_str("critical path (total ");
+    out_u64(cp->total);
+    out_str("):");
+    for (uint32_t i = 0; i < cp->path_length; i++) {
+        const uint32_t g = cp->path[i];
+        if (i > 0) { out_str(" ->"); }
+        for (uint32_t mi = result->group_offsets[g];
+             mi < result->group_offsets[g + 1]; mi++) {
+            size_t len;
+            const char *name = hopscotch_name(env->t,
+                result->members[mi], &len);
+            assert(name);
+            out_char(' ');
+            out_bytes(name, len);
         }
+    }
+    out_char('\n');
+}
 
-        printf("\n");
+/* Solve into flat arrays, and check them (if verifying) before
+ * printing, so the output is exactly what was verified. */
+static bool solve_and_report(struct main_env *env) {
+    struct hopscotch_result result = { .id_limit = 0 };
+    struct hopscotch_critical_path cp = { .group_count = 0 };
+    struct hopscotch_reduction red = { .group_count = 0 };
+    bool ok = false;
+    if (!hopscotch_solve_into(env->t, &result)) { goto cleanup; }
 
-    } else {
-        printf("%u: ", group_id);
-        for (size_t i = 0; i < group_count; i++) {
-            const struct symtab_symbol *sym = symtab_get(env->s, group[i]);
-            assert(sym);
-            printf("%s ", sym->str);
+    if (env->verify) {
+        const enum hopscotch_verify_res vres = hopscotch_verify(env->t, &result);
+        if (vres != HOPSCOTCH_VERIFY_OK) {
+            fprintf(stderr, "verification failed: %s\n", verify_res_str(vres));
+            goto cleanup;
+        }
+    }
+
+    if (env->reduce) {
+        if (!hopscotch_reduce(env->t, &result, &red)) { goto cleanup; }
+        env->result = &result;
+        env->red = &red;
+    }
+
+    for (uint32_t g = 0; g < result.group_count; g++) {
+        const uint32_t offset = result.group_offsets[g];
+        print_cb(g, result.group_offsets[g + 1] - offset,
+            &result.members[offset], env);
+    }
+
+    if (env->weights && env->format != FORMAT_TSV
+        && env->format != FORMAT_BINARY) {
+        if (!hopscotch_critical_path(env->t, &result, &cp)) { goto cleanup; }
+        print_critical_path(env, &result, &cp);
+    }
+    ok = true;
+
+cleanup:
+    env->result = NULL;
+    env->red = NULL;
+    hopscotch_reduction_free(&red);
+    hopscotch_critical_path_free(&cp);
+    hopscotch_result_free(&result);
+    return ok;
+}
+
+/* Bytes that end a token, repeated to fill all four. */
+struct delims {
+    char c[4];
+};
+static const struct delims head_delims = { { ':', ' ', '\t', '\n' } };
+static const struct delims edge_delims = { { ' ', '\t', '\n', '\n' } };
+static const struct delims succ_delims = { { ' ', '\t', '\n', '\n' } };
+static const struct delims line_delims = { { '\n', '\n', '\n', '\n' } };
+
+/* Return the first byte in [p, end) matching one of D, or end. */
+typedef const char *
+scan_fun(const char *p, const char *end, const struct delims *d);
+
+static const char *
+scan_scalar(const char *p, const char *end, const struct delims *d) {
+    for (; p < end; p++) {
+        const char c = *p;
+        if (c == d->c[0] || c == d->c[1] || c == d->c[2] || c == d->c[3]) {
+            break;
         }
-        printf("\n");
     }
+    return p;
 }
 
-int main(int argc, char **argv) {
-    int res = EXIT_SUCCESS;
-    struct main_env env = {
-        .in = stdin,
-    };
-    handle_args(&env, argc, argv);
+#if HAVE_SSE2
+static const char *
+scan_sse2(const char *p, const char *end, const struct delims *d) {
+    const __m128i d0 = _mm_set1_epi8(d->c[0]);
+    const __m128i d1 = _mm_set1_epi8(d->c[1]);
+    const __m128i d2 = _mm_set1_epi8(d->c[2]);
+    const __m128i d3 = _mm_set1_epi8(d->c[3]);
+    while (end - p >= 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)p);
+        const __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, d0), _mm_cmpeq_epi8(v, d1)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, d2), _mm_cmpeq_epi8(v, d3)));
+        const unsigned mask = (unsigned)_mm_movemask_epi8(hits);
+        if (mask != 0) { return p + __builtin_ctz(mask); }
+        p += 16;
+    }
+    return scan_scalar(p, end, d);
+}
+#endif
 
-    env.t = hopscotch_new();
-    assert(env.t);
-    env.s = symtab_new(NULL);
-    assert(env.s);
+#if HAVE_AVX2
+/* Built for AVX2 regardless of -march, and only used when the CPU
+ * has it. Tokens are usually short, so check the first 16 bytes
+ * before paying for 32-byte loads. */
+__attribute__((target("avx2")))
+static const char *
+scan_avx2(const char *p, const char *end, const struct delims *d) {
+    const __m256i d0 = _mm256_set1_epi8(d->c[0]);
+    const __m256i d1 = _mm256_set1_epi8(d->c[1]);
+    const __m256i d2 = _mm256_set1_epi8(d->c[2]);
+    const __m256i d3 = _mm256_set1_epi8(d->c[3]);
+    while (end - p >= 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        const __m256i hits = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, d0), _mm256_cmpeq_epi8(v, d1)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, d2), _mm256_cmpeq_epi8(v, d3)));
+        const unsigned mask = (unsigned)_mm256_movemask_epi8(hits);
+        if (mask != 0) { return p + __builtin_ctz(mask); }
+        p += 32;
+    }
+    return scan_sse2(p, end, d);
+}
+#endif
 
-    env.line_ids_ceil = DEF_LINE_IDS_CEIL;
-    env.line_ids = malloc((1LLU << DEF_LINE_IDS_CEIL) * sizeof(*env.line_ids));
+#if HAVE_SSE2
+static scan_fun *scan = scan_sse2;
+#else
+static scan_fun *scan = scan_scalar;
+#endif
 
-    for (;;) {
-        char *line = fgets(buf, sizeof(buf) - 1, env.in);
-        if (line == NULL) { break; }
-        size_t len = strlen(line);
-        if (len > 0 && line[len - 1] == '\n') {
-            line[len - 1] = '\0';
-            len--;
+static void pick_scanner(void) {
+#if HAVE_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) { scan = scan_avx2; }
+#endif
+}
+
+static bool parse_weight(const char *p, const char *end, uint64_t *weight) {
+    if (p == end) { return false; }
+    uint64_t res = 0;
+    for (; p < end; p++) {
+        if (*p < '0' || *p > '9') { return false; }
+        const uint64_t digit = (uint64_t)(*p - '0');
+        if (res > (UINT64_MAX - digit) / 10) { return false; }
+        res = 10*res + digit;
+    }
+    *weight = res;
+    return true;
+}
+
+/* Input is parsed into the handle T. With a chunk, names are only
+ * interned into T, and each node is recorded in the chunk, to be
+ * added to the graph later. */
+struct parser {
+    struct hopscotch *t;
+    enum input_format format;
+    bool weights;
+    struct chunk *chunk;
+    const char *path;           /* for errors */
+
+    /* Buffers for names read from the current line, grown on demand */
+    uint8_t line_names_ceil;
+    const char **line_names;
+    size_t *line_lens;
+
+    /* For make and DOT input: interned IDs, and unescaped names (each
+     * ending at the matching offset in name_ends). */
+    size_t id_count;
+    uint8_t id_ceil2;
+    uint32_t *ids;
+    size_t name_len;
+    uint8_t name_ceil2;
+    char *name_buf;
+    size_t name_end_count;
+    uint8_t name_end_ceil2;
+    size_t *name_ends;
+};
+
+/* A run of input parsed by one thread, made of whole lines from one
+ * or more spans. Its names get local IDs, in order of appearance, so
+ * interning them into the graph in chunk order gives the same IDs as
+ * parsing serially. Lines are then added through the chunk's shard,
+ * and shards are merged in the order they were created. */
+struct chunk {
+    size_t span_first;
+    size_t span_count;
+    struct hopscotch *local;    /* shares the graph's memory limit */
+    struct hopscotch_shard *shard;
+    bool parsed;
+    bool ok;
+    enum hopscotch_error error; /* the local handle's, if it failed */
+
+    /* The arrays below are counted against the graph's memory limit. */
+    struct hopscotch *graph;
+    uint8_t map_ceil2;
+    uint32_t *map;              /* local ID -> graph ID */
+
+    /* Records: head, successor count, then the successors. */
+    size_t rec_count;
+    uint8_t rec_ceil2;
+    uint32_t *recs;
+
+    size_t weight_count;
+    uint8_t weight_ceil2;
+    struct chunk_weight {
+        uint32_t id;
+        uint64_t weight;
+    } *weights;
+};
+
+struct span {
+    const char *p;
+    const char *end;
+    const char *path;
+    size_t charged;             /* if read into a buffer, its size */
+};
+
+/* Grow BUF, an array of 1 << *CEIL2 items of SIZE bytes, to fit at
+ * least NEED, counting it against T's memory limit if T is non-NULL.
+ * Returns NULL (leaving BUF alone) on failure. */
+static void *grow_array(struct hopscotch *t, void *buf, uint8_t *ceil2,
+        size_t need, size_t size) {
+    if (buf != NULL && need <= (1LLU << *ceil2)) { return buf; }
+    uint8_t nceil2 = (buf == NULL ? DEF_ARRAY_CEIL2 : *ceil2 + 1);
+    while ((1LLU << nceil2) < need) { nceil2++; }
+    const size_t old_bytes = (buf == NULL ? 0 : (1LLU << *ceil2) * size);
+    const size_t new_bytes = (1LLU << nceil2) * size;
+    if (t != NULL && !hopscotch_charge_memory(t, old_bytes, new_bytes)) {
+        return NULL;
+    }
+    void *nbuf = realloc(buf, new_bytes);
+    if (nbuf == NULL) {
+        if (t != NULL) { hopscotch_charge_memory(t, new_bytes, old_bytes); }
+        return NULL;
+    }
+    *ceil2 = nceil2;
+    return nbuf;
+}
+
+/* Free an array grown by grow_array with the same T, CEIL2, and SIZE. */
+static void free_array(struct hopscotch *t, void *buf, uint8_t ceil2,
+        size_t size) {
+    if (buf == NULL) { return; }
+    if (t != NULL) { hopscotch_charge_memory(t, (1LLU << ceil2) * size, 0); }
+    free(buf);
+}
+
+static void free_parser(struct parser *ps) {
+    free(ps->line_names);
+    free(ps->line_lens);
+    free(ps->ids);
+    free(ps->name_buf);
+    free(ps->name_ends);
+}
+
+static bool push_line_name(struct parser *ps, size_t used,
+        const char *name, size_t len) {
+    if (ps->line_names == NULL || used == (1LLU << ps->line_names_ceil)) {
+        const uint8_t nceil = (ps->line_names == NULL
+            ? DEF_LINE_NAMES_CEIL : ps->line_names_ceil + 1);
+        const char **nline_names = realloc(ps->line_names,
+            (1LLU << nceil) * sizeof(*nline_names));
+        if (nline_names == NULL) { return false; }
+        ps->line_names = nline_names;
+        size_t *nline_lens = realloc(ps->line_lens,
+            (1LLU << nceil) * sizeof(*nline_lens));
+        if (nline_lens == NULL) { return false; }
+        ps->line_lens = nline_lens;
+        ps->line_names_ceil = nceil;
+    }
+    ps->line_names[used] = name;
+    ps->line_lens[used] = len;
+    return true;
+}
+
+static bool record_line(struct parser *ps, const char *head,
+        size_t head_len, size_t used) {
+    struct chunk *c = ps->chunk;
+    const size_t need = c->rec_count + 2 + used;
+    uint32_t *nrecs = grow_array(c->graph, c->recs, &c->rec_ceil2,
+        need, sizeof(*nrecs));
+    if (nrecs == NULL) {
+        c->error = HOPSCOTCH_ERROR_MEMORY;
+        return false;
+    }
+    c->recs = nrecs;
+
+    uint32_t *rec = &c->recs[c->rec_count];
+    if (!hopscotch_intern(ps->t, head, head_len, &rec[0])) { return false; }
+    rec[1] = (uint32_t)used;
+    for (size_t i = 0; i < used; i++) {
+        if (!hopscotch_intern(ps->t, ps->line_names[i], ps->line_lens[i],
+                &rec[2 + i])) {
+            return false;
         }
+    }
+    c->rec_count = need;
+    return true;
+}
 
+static bool record_weight(struct chunk *c, uint32_t id, uint64_t weight) {
+    struct chunk_weight *nweights = grow_array(c->graph, c->weights,
+        &c->weight_ceil2, c->weight_count + 1, sizeof(*nweights));
+    if (nweights == NULL) {
+        c->error = HOPSCOTCH_ERROR_MEMORY;
+        return false;
+    }
+    c->weights = nweights;
+    c->weights[c->weight_count++] = (struct chunk_weight) {
+        .id = id,
+        .weight = weight,
+    };
+    return true;
+}
+
+/* Add every line in [p, end), which ends at a newline or EOF. Each
+ * line is a head name (leading ':', ' ', and '\t' skipped), ended by
+ * one of those, then successor names separated by spaces and tabs.
+ * Edge lists are the same, except that ':' is part of a name.
+ * Names are passed as pointers into the input, so nothing is copied
+ * until it's interned. */
+static bool parse_lines(struct parser *ps, const char *p, const char *end) {
+    const bool edges = (ps->format == INPUT_EDGES);
+    while (p < end) {
         /* Allow comment lines */
-        if (line[0] == '#') { continue; }
+        if (*p == '#') {
+            p = scan(p, end, &line_delims);
+            if (p < end) { p++; }
+            continue;
+        }
 
-        const char *head = strtok(line, ": \t");
-        if (head == NULL) { continue; }
+        while (p < end && ((*p == ':' && !edges) || *p == ' ' || *p == '\t')) {
+            p++;
+        }
+        if (p == end) { break; }
+        if (*p == '\n') { p++; continue; }
+
+        const char *head = p;
+        p = scan(p, end, edges ? &edge_delims : &head_delims);
+        size_t head_len = p - head;
+        if (p < end && *p != '\n') { p++; }
 
-        /* get symbol and id for head */
-        struct symtab_symbol *sym_head = NULL;
-        enum symtab_intern_res ires =
-          symtab_intern(env.s, strlen(head), (uint8_t *)head,
-              &sym_head);
-        assert(ires == SYMTAB_INTERN_CREATED || ires == SYMTAB_INTERN_EXISTING);
+        uint64_t weight = 0;
+        const char *eq = (ps->weights ? memchr(head, '=', head_len) : NULL);
+        if (eq != NULL) {
+            if (!parse_weight(eq + 1, head + head_len, &weight)) {
+                fprintf(stderr, "bad weight: %.*s\n", (int)head_len, head);
+                return false;
+            }
+            head_len = eq - head;
+        }
 
         size_t used = 0;
         for (;;) {
-            const char *succ = strtok(NULL, " \t");
-            if (succ == NULL) { break; }
-            if (succ[0] == '\0') { continue; }
-
-            /* get symbol for succ and append id */
-            struct symtab_symbol *sym_succ = NULL;
-            ires = symtab_intern(env.s, strlen(succ), (uint8_t *)succ,
-                &sym_succ);
-            assert(ires == SYMTAB_INTERN_CREATED || ires == SYMTAB_INTERN_EXISTING);
-
-            if (used == (1LLU << env.line_ids_ceil)) {
-                const uint8_t nceil = env.line_ids_ceil + 1;
-                uint32_t *nline_ids = realloc(env.line_ids,
-                    (1LLU << nceil) * sizeof(*nline_ids));
-                if (nline_ids == NULL) {
-                    res = EXIT_FAILURE;
-                    goto cleanup;
+            while (p < end && (*p == ' ' || *p == '\t')) { p++; }
+            if (p == end || *p == '\n') { break; }
+            const char *succ = p;
+            p = scan(p, end, &succ_delims);
+            if (!push_line_name(ps, used, succ, p - succ)) { return false; }
+            used++;
+        }
+        if (p < end) { p++; }   /* newline */
+
+        if (ps->chunk != NULL) {
+            if (!record_line(ps, head, head_len, used)) { return false; }
+        } else if (!hopscotch_add_named(ps->t, head, head_len,
+                used, ps->line_names, ps->line_lens)) {
+            return false;
+        }
+        uint32_t head_id;
+        if (eq != NULL && (!hopscotch_intern(ps->t, head, head_len, &head_id)
+                || !(ps->chunk != NULL
+                    ? record_weight(ps->chunk, head_id, weight)
+                    : hopscotch_set_weight(ps->t, head_id, weight)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Add HEAD with COUNT successors, all interned into ps->t already. */
+static bool add_ids(struct parser *ps, uint32_t head,
+        size_t count, const uint32_t *succ) {
+    struct chunk *c = ps->chunk;
+    if (c == NULL) { return hopscotch_add(ps->t, head, count, succ); }
+
+    const size_t need = c->rec_count + 2 + count;
+    uint32_t *nrecs = grow_array(c->graph, c->recs, &c->rec_ceil2,
+        need, sizeof(*nrecs));
+    if (nrecs == NULL) {
+        c->error = HOPSCOTCH_ERROR_MEMORY;
+        return false;
+    }
+    c->recs = nrecs;
+    uint32_t *rec = &c->recs[c->rec_count];
+    rec[0] = head;
+    rec[1] = (uint32_t)count;
+    if (count > 0) { memcpy(&rec[2], succ, count * sizeof(*succ)); }
+    c->rec_count = need;
+    return true;
+}
+
+static bool push_id(struct parser *ps, uint32_t id) {
+    uint32_t *nids = grow_array(NULL, ps->ids, &ps->id_ceil2,
+        ps->id_count + 1, sizeof(*nids));
+    if (nids == NULL) { return false; }
+    ps->ids = nids;
+    ps->ids[ps->id_count++] = id;
+    return true;
+}
+
+static bool intern_id(struct parser *ps, const char *name, size_t len) {
+    uint32_t id;
+    return hopscotch_intern(ps->t, name, len, &id) && push_id(ps, id);
+}
+
+static bool push_name_char(struct parser *ps, char c) {
+    char *nbuf = grow_array(NULL, ps->name_buf, &ps->name_ceil2,
+        ps->name_len + 1, sizeof(*nbuf));
+    if (nbuf == NULL) { return false; }
+    ps->name_buf = nbuf;
+    ps->name_buf[ps->name_len++] = c;
+    return true;
+}
+
+static bool end_name(struct parser *ps) {
+    size_t *nends = grow_array(NULL, ps->name_ends, &ps->name_end_ceil2,
+        ps->name_end_count + 1, sizeof(*nends));
+    if (nends == NULL) { return false; }
+    ps->name_ends = nends;
+    ps->name_ends[ps->name_end_count++] = ps->name_len;
+    return true;
+}
+
+/* Add the rules in [p, end), as written by cc -MD:
+ *
+ *     target ...: prereq ... \
+ *         prereq ...
+ *
+ * Each target gets all of its rule's prerequisites. A backslash before
+ * a newline continues the line, "\ ", "\#", and "\:" escape, and "$$"
+ * is '$'. Lines without a ':' are skipped. */
+static bool parse_make(struct parser *ps, const char *p, const char *end) {
+    while (p < end) {
+        ps->name_len = 0;
+        ps->name_end_count = 0;
+        size_t target_count = 0;
+        bool rule = false;
+
+        for (;;) {
+            while (p < end) {
+                if (*p == ' ' || *p == '\t' || *p == '\r') {
+                    p++;
+                } else if (*p == '\\' && end - p > 1 && p[1] == '\n') {
+                    p += 2;
+                } else if (*p == '\\' && end - p > 2
+                    && p[1] == '\r' && p[2] == '\n') {
+                    p += 3;
+                } else {
+                    break;
                 }
-                env.line_ids_ceil = nceil;
-                env.line_ids = nline_ids;
             }
-            env.line_ids[used] = sym_succ->id;
-            used++;
+            if (p == end || *p == '\n') { break; }
+            if (*p == '#') {
+                p = scan(p, end, &line_delims);
+                break;
+            }
+            if (*p == ':' && !rule) {
+                rule = true;
+                target_count = ps->name_end_count;
+                p++;
+                if (p < end && *p == ':') { p++; }
+                continue;
+            }
+            /* Order-only prerequisites are still prerequisites. */
+            if (*p == '|' && rule && (end - p == 1
+                    || p[1] == ' ' || p[1] == '\t' || p[1] == '\n')) {
+                p++;
+                continue;
+            }
+
+            while (p < end) {
+                char c = *p;
+                if (c == ' ' || c == '\t' || c == '\r' || c == '\n'
+                    || (c == ':' && !rule)) {
+                    break;
+                } else if (c == '\\' && end - p > 1 && (p[1] == ' '
+                        || p[1] == '#' || p[1] == ':')) {
+                    c = p[1];
+                    p++;
+                } else if (c == '\\' && end - p > 1
+                    && (p[1] == '\n' || p[1] == '\r')) {
+                    break;
+                } else if (c == '$' && end - p > 1 && p[1] == '$') {
+                    p++;
+                }
+                if (!push_name_char(ps, c)) { return false; }
+                p++;
+            }
+            if (!end_name(ps)) { return false; }
         }
+        if (p < end) { p++; }   /* newline */
+        if (!rule) { continue; }
 
-        if (!hopscotch_add(env.t, sym_head->id, used, env.line_ids)) {
-            res = EXIT_FAILURE;
+        /* Intern targets, then prerequisites, in the order written. */
+        ps->id_count = 0;
+        size_t start = 0;
+        for (size_t i = 0; i < ps->name_end_count; i++) {
+            const size_t name_end = ps->name_ends[i];
+            if (!intern_id(ps, &ps->name_buf[start], name_end - start)) {
+                return false;
+            }
+            start = name_end;
+        }
+        const size_t prereq_count = ps->id_count - target_count;
+        for (size_t i = 0; i < target_count; i++) {
+            if (!add_ids(ps, ps->ids[i], prereq_count,
+                    &ps->ids[target_count])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* A subset of Graphviz DOT: any number of graphs, with node, edge,
+ * attribute, and subgraph statements. Nodes are named by their IDs
+ * (not labels), attributes and ports are skipped, and "a -- b" adds
+ * edges both ways. A subgraph used in an edge stands for every node
+ * mentioned inside it. */
+enum dot_tok {
+    DOT_EOF,
+    DOT_ID,
+    DOT_EDGE,                   /* -> or -- */
+    DOT_PUNCT,                  /* one of {}[];,=: */
+    DOT_ERROR,
+};
+
+struct dot_lexer {
+    struct parser *ps;
+    const char *p;
+    const char *end;
+    size_t line;
+
+    enum dot_tok tok;
+    char punct;
+    bool both_ways;             /* for DOT_EDGE, whether it's -- */
+    bool quoted;                /* quoted IDs are never keywords */
+    const char *id;             /* into the input, or ps->name_buf */
+    size_t id_len;
+};
+
+static bool dot_error(struct dot_lexer *lx) {
+    fprintf(stderr, "%s:%zu: DOT syntax error\n", lx->ps->path, lx->line);
+    return false;
+}
+
+/* Skip whitespace and comments, and return the next byte, or 0 at
+ * the end of input. */
+static char dot_peek(struct dot_lexer *lx) {
+    while (lx->p < lx->end) {
+        const char c = *lx->p;
+        if (c == '\n') {
+            lx->line++;
+            lx->p++;
+        } else if (c == ' ' || c == '\t' || c == '\r') {
+            lx->p++;
+        } else if (c == '#' || (c == '/' && lx->end - lx->p > 1
+                && lx->p[1] == '/')) {
+            lx->p = scan(lx->p, lx->end, &line_delims);
+        } else if (c == '/' && lx->end - lx->p > 1 && lx->p[1] == '*') {
+            lx->p += 2;
+            while (lx->p < lx->end && !(*lx->p == '*'
+                    && lx->end - lx->p > 1 && lx->p[1] == '/')) {
+                if (*lx->p == '\n') { lx->line++; }
+                lx->p++;
+            }
+            lx->p = (lx->p < lx->end ? lx->p + 2 : lx->end);
+        } else {
+            return c;
+        }
+    }
+    return '\0';
+}
+
+static bool dot_id_byte(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+        || (c >= '0' && c <= '9') || c == '_' || c == '.'
+        || (unsigned char)c >= 0x80;
+}
+
+static enum dot_tok dot_next(struct dot_lexer *lx) {
+    const char c = dot_peek(lx);
+    lx->quoted = false;
+    if (lx->p == lx->end) {
+        lx->tok = DOT_EOF;
+    } else if (c == '-' && lx->end - lx->p > 1
+        && (lx->p[1] == '>' || lx->p[1] == '-')) {
+        lx->tok = DOT_EDGE;
+        lx->both_ways = (lx->p[1] == '-');
+        lx->p += 2;
+    } else if (strchr("{}[];,=:", c) != NULL) {
+        lx->tok = DOT_PUNCT;
+        lx->punct = c;
+        lx->p++;
+    } else if (c == '"') {
+        /* Only \" is an escape, and backslash-newline is dropped, so
+         * copy the name only if it has a backslash. */
+        const char *start = ++lx->p;
+        bool copy = false;
+        while (lx->p < lx->end && *lx->p != '"') {
+            if (*lx->p == '\\' && lx->end - lx->p > 1) {
+                copy = true;
+                lx->p++;
+            }
+            if (*lx->p == '\n') { lx->line++; }
+            lx->p++;
+        }
+        if (lx->p == lx->end) { return lx->tok = DOT_ERROR; }
+        lx->tok = DOT_ID;
+        lx->quoted = true;
+        lx->id = start;
+        lx->id_len = lx->p - start;
+        lx->p++;
+        if (copy) {
+            struct parser *ps = lx->ps;
+            ps->name_len = 0;
+            for (const char *s = start; s < start + lx->id_len; s++) {
+                if (*s == '\\' && (s[1] == '"' || s[1] == '\n')) {
+                    s++;
+                    if (*s == '\n') { continue; }
+                }
+                if (!push_name_char(ps, *s)) { return lx->tok = DOT_ERROR; }
+            }
+            lx->id = ps->name_buf;
+            lx->id_len = ps->name_len;
+        }
+    } else if (c == '<') {
+        /* HTML string: the name is what's inside the outer <>. */
+        const char *start = ++lx->p;
+        size_t depth = 1;
+        for (; lx->p < lx->end; lx->p++) {
+            if (*lx->p == '<') {
+                depth++;
+            } else if (*lx->p == '>' && --depth == 0) {
+                break;
+            } else if (*lx->p == '\n') {
+                lx->line++;
+            }
+        }
+        if (lx->p == lx->end) { return lx->tok = DOT_ERROR; }
+        lx->tok = DOT_ID;
+        lx->quoted = true;
+        lx->id = start;
+        lx->id_len = lx->p - start;
+        lx->p++;
+    } else if (dot_id_byte(c) || c == '-') {
+        const char *start = lx->p++;
+        while (lx->p < lx->end && dot_id_byte(*lx->p)) { lx->p++; }
+        lx->tok = DOT_ID;
+        lx->id = start;
+        lx->id_len = lx->p - start;
+    } else {
+        lx->tok = DOT_ERROR;
+    }
+    return lx->tok;
+}
+
+/* Is the current token the (unquoted, case-insensitive) keyword KW? */
+static bool dot_keyword(const struct dot_lexer *lx, const char *kw) {
+    if (lx->tok != DOT_ID || lx->quoted || strlen(kw) != lx->id_len) {
+        return false;
+    }
+    for (size_t i = 0; i < lx->id_len; i++) {
+        char c = lx->id[i];
+        if (c >= 'A' && c <= 'Z') { c += 'a' - 'A'; }
+        if (c != kw[i]) { return false; }
+    }
+    return true;
+}
+
+/* Skip any attribute lists: [a=b, c=d][...] */
+static bool dot_skip_attrs(struct dot_lexer *lx) {
+    while (dot_peek(lx) == '[') {
+        lx->p++;
+        for (;;) {
+            const enum dot_tok tok = dot_next(lx);
+            if (tok == DOT_EOF || tok == DOT_ERROR) { return dot_error(lx); }
+            if (tok == DOT_PUNCT && lx->punct == ']') { break; }
+        }
+    }
+    return true;
+}
+
+static bool dot_stmt_list(struct dot_lexer *lx, bool collect);
+
+/* Parse one side of an edge (or a lone node or subgraph), with its
+ * first token already read, and push the IDs of the nodes it names. */
+static bool dot_operand(struct dot_lexer *lx, bool *lone_node) {
+    *lone_node = false;
+    if (lx->tok == DOT_PUNCT && lx->punct == '{') {
+        return dot_stmt_list(lx, true);
+    } else if (dot_keyword(lx, "subgraph")) {
+        if (dot_peek(lx) != '{' && dot_next(lx) != DOT_ID) {
+            return dot_error(lx);
+        }
+        if (dot_peek(lx) != '{') { return dot_error(lx); }
+        lx->p++;
+        return dot_stmt_list(lx, true);
+    } else if (lx->tok != DOT_ID) {
+        return dot_error(lx);
+    }
+
+    if (!intern_id(lx->ps, lx->id, lx->id_len)) { return false; }
+    *lone_node = true;
+
+    /* Skip a port, and maybe a compass point. */
+    for (int i = 0; i < 2 && dot_peek(lx) == ':'; i++) {
+        lx->p++;
+        if (dot_next(lx) != DOT_ID) { return dot_error(lx); }
+    }
+    return true;
+}
+
+/* Parse a statement, with its first token already read. Afterward,
+ * the IDs of any nodes it mentions are on ps->ids. */
+static bool dot_stmt(struct dot_lexer *lx) {
+    struct parser *ps = lx->ps;
+    if (dot_keyword(lx, "graph") || dot_keyword(lx, "node")
+        || dot_keyword(lx, "edge")) {
+        return dot_skip_attrs(lx);
+    }
+    if (lx->tok == DOT_ID && dot_peek(lx) == '=') {
+        lx->p++;
+        return (dot_next(lx) == DOT_ID ? true : dot_error(lx));
+    }
+
+    size_t left = ps->id_count;
+    bool lone_node;
+    if (!dot_operand(lx, &lone_node)) { return false; }
+    size_t right = ps->id_count;
+
+    while (dot_peek(lx) == '-') {
+        if (dot_next(lx) != DOT_EDGE) { return dot_error(lx); }
+        const bool both_ways = lx->both_ways;
+        dot_next(lx);
+        if (!dot_operand(lx, &lone_node)) { return false; }
+        lone_node = false;
+
+        /* Every node on the left gets every node on the right. */
+        const size_t right_count = ps->id_count - right;
+        for (size_t i = left; i < right; i++) {
+            if (!add_ids(ps, ps->ids[i], right_count, &ps->ids[right])) {
+                return false;
+            }
+        }
+        for (size_t i = right; both_ways && i < ps->id_count; i++) {
+            if (!add_ids(ps, ps->ids[i], right - left, &ps->ids[left])) {
+                return false;
+            }
+        }
+        left = right;
+        right = ps->id_count;
+    }
+
+    if (lone_node && !add_ids(ps, ps->ids[left], 0, NULL)) { return false; }
+    return dot_skip_attrs(lx);
+}
+
+/* Parse statements up to the closing '}'. If COLLECT, keep the IDs
+ * of every node mentioned, for a subgraph used in an edge. */
+static bool dot_stmt_list(struct dot_lexer *lx, bool collect) {
+    const size_t mark = lx->ps->id_count;
+    for (;;) {
+        const enum dot_tok tok = dot_next(lx);
+        if (tok == DOT_PUNCT && lx->punct == '}') { return true; }
+        if (tok == DOT_PUNCT && lx->punct == ';') { continue; }
+        if (tok == DOT_EOF || tok == DOT_ERROR) { return dot_error(lx); }
+        if (!dot_stmt(lx)) { return false; }
+        if (!collect) { lx->ps->id_count = mark; }
+    }
+}
+
+static bool parse_dot(struct parser *ps, const char *p, const char *end) {
+    struct dot_lexer lx = {
+        .ps = ps,
+        .p = p,
+        .end = end,
+        .line = 1,
+    };
+    for (;;) {
+        ps->id_count = 0;
+        if (dot_next(&lx) == DOT_EOF) { return true; }
+        if (dot_keyword(&lx, "strict")) { dot_next(&lx); }
+        if (!dot_keyword(&lx, "graph") && !dot_keyword(&lx, "digraph")) {
+            return dot_error(&lx);
+        }
+        if (dot_peek(&lx) != '{' && dot_next(&lx) != DOT_ID) {
+            return dot_error(&lx);
+        }
+        if (dot_peek(&lx) != '{') { return dot_error(&lx); }
+        lx.p++;
+        if (!dot_stmt_list(&lx, false)) { return false; }
+    }
+}
+
+/* Line-based formats can be read in pieces, and split anywhere
+ * between lines. Others need each input whole. */
+static bool line_based(enum input_format format) {
+    return format == INPUT_ADJ || format == INPUT_EDGES;
+}
+
+static bool parse_input(struct parser *ps, const char *p, const char *end) {
+    switch (ps->format) {
+    case INPUT_ADJ:
+    case INPUT_EDGES:
+        return parse_lines(ps, p, end);
+    case INPUT_MAKE:
+        return parse_make(ps, p, end);
+    case INPUT_DOT:
+        return parse_dot(ps, p, end);
+    default:
+        assert(false);
+        return false;
+    }
+}
+
+static int open_input(const char *path) {
+    const int fd = open(path, O_RDONLY);
+    if (fd == -1) { err(1, "open: %s", path); }
+    return fd;
+}
+
+/* Map FD if it's a non-empty regular file. */
+static bool map_input(int fd, struct span *sp) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)
+        || st.st_size <= 0 || (uintmax_t)st.st_size > SIZE_MAX) {
+        return false;
+    }
+    const size_t size = (size_t)st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) { return false; }
+    (void)posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+    sp->p = map;
+    sp->end = (const char *)map + size;
+    return true;
+}
+
+/* Read FD in large chunks, counting the buffer against the graph's
+ * memory limit. If PS is non-NULL, parse every complete line as it
+ * arrives, keeping the partial one at the end for the next read;
+ * otherwise, read all of it into *OUT, to be freed with free_read. */
+static bool read_input(struct main_env *env, struct parser *ps, int fd,
+        const char *path, struct span *out) {
+    bool ok = false;
+    size_t size = READ_CHUNK;
+    size_t used = 0;
+    if (!hopscotch_charge_memory(env->t, 0, size)) {
+        env->load_error = HOPSCOTCH_ERROR_MEMORY;
+        return false;
+    }
+    char *buf = malloc(size);
+    if (buf == NULL) { goto nomem; }
+
+    for (;;) {
+        if (used == size) {
+            if (!hopscotch_charge_memory(env->t, size, 2*size)) { goto nomem; }
+            char *nbuf = realloc(buf, 2*size);
+            if (nbuf == NULL) {
+                hopscotch_charge_memory(env->t, 2*size, size);
+                goto nomem;
+            }
+            buf = nbuf;
+            size *= 2;
+        }
+
+        const ssize_t got = read(fd, &buf[used], size - used);
+        if (got == -1) {
+            if (errno == EINTR) { continue; }
+            warn("read: %s", path);
+            goto cleanup;
+        } else if (got == 0) {
+            if (ps == NULL) {
+                *out = (struct span) {
+                    .p = buf,
+                    .end = &buf[used],
+                    .path = path,
+                    .charged = size,
+                };
+                return true;
+            }
+            ok = parse_lines(ps, buf, &buf[used]);
             goto cleanup;
+        } else if (ps == NULL) {
+            used += got;
+            continue;
+        }
+
+        /* Only the new bytes can hold the last newline. */
+        size_t done = used + got;
+        while (done > used && buf[done - 1] != '\n') { done--; }
+        if (done == used) { done = 0; }
+        used += got;
+        if (done == 0) { continue; }
+
+        if (!parse_lines(ps, buf, &buf[done])) { goto cleanup; }
+        memmove(buf, &buf[done], used - done);
+        used -= done;
+    }
+
+nomem:
+    env->load_error = HOPSCOTCH_ERROR_MEMORY;
+cleanup:
+    free(buf);
+    hopscotch_charge_memory(env->t, size, 0);
+    return ok;
+}
+
+static void free_read(struct main_env *env, const struct span *sp) {
+    free((void *)sp->p);
+    hopscotch_charge_memory(env->t, sp->charged, 0);
+}
+
+/* Parse each input on this thread, in order. If FDS is non-NULL, any
+ * input with a descriptor other than -1 there is already open. */
+static bool load_serial(struct main_env *env, const int *fds) {
+    struct parser ps = {
+        .t = env->t,
+        .format = env->input,
+        .weights = env->weights,
+    };
+    bool ok = true;
+    for (int i = 0; ok && i < (env->path_count > 0 ? env->path_count : 1); i++) {
+        const char *path = (env->path_count > 0 ? env->paths[i] : "stdin");
+        const bool opened = (fds == NULL || fds[i] == -1);
+        const int fd = (!opened ? fds[i]
+            : env->path_count > 0 ? open_input(path) : STDIN_FILENO);
+        ps.path = path;
+        struct span sp;
+        if (map_input(fd, &sp)) {
+            ok = parse_input(&ps, sp.p, sp.end);
+            munmap((void *)sp.p, sp.end - sp.p);
+        } else if (line_based(ps.format)) {
+            ok = read_input(env, &ps, fd, path, NULL);
+        } else if ((ok = read_input(env, NULL, fd, path, &sp))) {
+            ok = parse_input(&ps, sp.p, sp.end);
+            free_read(env, &sp);
+        }
+        if (opened && fd != STDIN_FILENO) { close(fd); }
+    }
+    free_parser(&ps);
+    return ok;
+}
+
+struct load_env {
+    struct main_env *main;
+    const struct span *spans;
+    size_t chunk_count;
+    struct chunk *chunks;
+    bool adding;                /* parsing first, then adding */
+    size_t next;                /* next chunk to claim */
+
+    /* Signalled as each chunk is parsed, for merge_names. */
+    pthread_mutex_t lock;
+    pthread_cond_t parsed;
+};
+
+static bool parse_chunk(struct load_env *env, struct chunk *c) {
+    c->graph = env->main->t;
+    c->local = hopscotch_new();
+    if (c->local == NULL
+        || (env->main->memory_limit > 0
+            && !hopscotch_share_memory_limit(c->local, c->graph))) {
+        c->error = HOPSCOTCH_ERROR_MEMORY;
+        return false;
+    }
+    struct parser ps = {
+        .t = c->local,
+        .format = env->main->input,
+        .weights = env->main->weights,
+        .chunk = c,
+    };
+    bool ok = true;
+    for (size_t i = 0; ok && i < c->span_count; i++) {
+        const struct span *sp = &env->spans[c->span_first + i];
+        ps.path = sp->path;
+        ok = parse_input(&ps, sp->p, sp->end);
+    }
+    if (!ok && c->error == HOPSCOTCH_ERROR_NONE) {
+        c->error = hopscotch_error(c->local);
+    }
+    free_parser(&ps);
+    return ok;
+}
+
+static bool add_chunk(struct chunk *c) {
+    size_t offset = 0;
+    while (offset < c->rec_count) {
+        uint32_t *rec = &c->recs[offset];
+        const uint32_t succ_count = rec[1];
+        for (uint32_t i = 0; i < succ_count; i++) {
+            rec[2 + i] = c->map[rec[2 + i]];
+        }
+        if (!hopscotch_shard_add(c->shard, c->map[rec[0]],
+                succ_count, &rec[2])) {
+            return false;
         }
+        offset += 2 + succ_count;
+    }
+    return true;
+}
+
+/* Claim chunks until there are none left, as with solve_many. */
+static void *load_worker(void *arg) {
+    struct load_env *env = arg;
+    for (;;) {
+        const size_t i = __atomic_fetch_add(&env->next, 1, __ATOMIC_RELAXED);
+        if (i >= env->chunk_count) { break; }
+        struct chunk *c = &env->chunks[i];
+        if (env->adding) {
+            c->ok = add_chunk(c);
+            continue;
+        }
+
+        const bool ok = parse_chunk(env, c);
+        pthread_mutex_lock(&env->lock);
+        c->ok = ok;
+        c->parsed = true;
+        pthread_cond_broadcast(&env->parsed);
+        pthread_mutex_unlock(&env->lock);
+    }
+    return NULL;
+}
+
+/* Start up to JOBS threads, and return how many started. */
+static size_t start_workers(struct load_env *env, size_t jobs,
+        pthread_t *threads) {
+    if (jobs > env->chunk_count) { jobs = env->chunk_count; }
+    size_t started = 0;
+    for (; started < jobs; started++) {
+        if (0 != pthread_create(&threads[started], NULL, load_worker, env)) {
+            break;
+        }
+    }
+    return started;
+}
+
+/* As each chunk is parsed, intern its names into the graph, in input
+ * order, and create its shard. This is the only serial part, and it
+ * runs on the calling thread while later chunks are still parsing. */
+static bool merge_names(struct load_env *env) {
+    struct hopscotch *t = env->main->t;
+    for (size_t ci = 0; ci < env->chunk_count; ci++) {
+        struct chunk *c = &env->chunks[ci];
+        pthread_mutex_lock(&env->lock);
+        while (!c->parsed) { pthread_cond_wait(&env->parsed, &env->lock); }
+        pthread_mutex_unlock(&env->lock);
+        if (!c->ok) {
+            env->main->load_error = c->error;
+            return false;
+        }
+
+        size_t count = 0;
+        while (hopscotch_name(c->local, count, NULL) != NULL) { count++; }
+        c->shard = hopscotch_shard_new(t);
+        c->map = grow_array(t, NULL, &c->map_ceil2, count, sizeof(c->map[0]));
+        if (c->shard == NULL || c->map == NULL) {
+            env->main->load_error = HOPSCOTCH_ERROR_MEMORY;
+            return false;
+        }
+        for (uint32_t id = 0; id < count; id++) {
+            size_t len;
+            const char *name = hopscotch_name(c->local, id, &len);
+            if (!hopscotch_intern(t, name, len, &c->map[id])) { return false; }
+        }
+        hopscotch_free(c->local);
+        c->local = NULL;
+
+        for (size_t wi = 0; wi < c->weight_count; wi++) {
+            const struct chunk_weight *w = &c->weights[wi];
+            if (!hopscotch_set_weight(t, c->map[w->id], w->weight)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Cut the inputs into about four chunks per job, at line boundaries
+ * (if the format allows), putting small inputs together. */
+static bool split_chunks(struct load_env *env, size_t span_count,
+        struct span *spans, size_t jobs, struct span **out_spans) {
+    const bool splittable = line_based(env->main->input);
+    size_t total = 0;
+    for (size_t i = 0; i < span_count; i++) {
+        total += spans[i].end - spans[i].p;
+    }
+    size_t target = total / (4 * jobs);
+    if (target < MIN_CHUNK_SIZE) { target = MIN_CHUNK_SIZE; }
+
+    /* Each chunk ends at most one extra span. */
+    const size_t max_chunks = total / target + 1;
+    struct span *cut = malloc((span_count + max_chunks) * sizeof(*cut));
+    env->chunks = calloc(max_chunks + span_count, sizeof(*env->chunks));
+    if (cut == NULL || env->chunks == NULL) {
+        free(cut);
+        return false;
+    }
+
+    size_t cut_count = 0;
+    size_t in_chunk = 0;
+    struct chunk *c = &env->chunks[0];
+    for (size_t i = 0; i < span_count; i++) {
+        const char *p = spans[i].p;
+        const char *end = spans[i].end;
+        while (p < end) {
+            const char *q = (splittable && (size_t)(end - p) > target - in_chunk
+                ? p + (target - in_chunk) : end);
+            if (q < end) {
+                q = scan(q, end, &line_delims);
+                if (q < end) { q++; }
+            }
+            cut[cut_count++] = (struct span) {
+                .p = p,
+                .end = q,
+                .path = spans[i].path,
+            };
+            c->span_count++;
+            in_chunk += q - p;
+            p = q;
+            if (in_chunk >= target) {
+                env->chunk_count++;
+                c = &env->chunks[env->chunk_count];
+                c->span_first = cut_count;
+                in_chunk = 0;
+            }
+        }
+    }
+    if (c->span_count > 0) { env->chunk_count++; }
+    env->spans = cut;
+    *out_spans = cut;
+    return true;
+}
+
+static void free_chunks(struct load_env *env) {
+    for (size_t i = 0; i < env->chunk_count; i++) {
+        struct chunk *c = &env->chunks[i];
+        if (c->local != NULL) { hopscotch_free(c->local); }
+        free_array(c->graph, c->map, c->map_ceil2, sizeof(c->map[0]));
+        free_array(c->graph, c->recs, c->rec_ceil2, sizeof(c->recs[0]));
+        free_array(c->graph, c->weights, c->weight_ceil2,
+            sizeof(c->weights[0]));
+    }
+    free(env->chunks);
+}
+
+/* Map (or read) every input, split them into chunks, and parse the
+ * chunks on several threads. Names are then interned into the graph
+ * in input order, and the lines added through per-chunk shards, which
+ * gives the same graph as parsing serially. */
+static bool load_parallel(struct main_env *env) {
+    bool ok = false;
+    const size_t count = (env->path_count > 0 ? env->path_count : 1);
+    struct span *inputs = calloc(count, sizeof(*inputs));
+    bool *mapped = calloc(count, sizeof(*mapped));
+    int *fds = malloc(count * sizeof(*fds));
+    struct span *cut = NULL;
+    struct load_env lenv = {
+        .main = env,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .parsed = PTHREAD_COND_INITIALIZER,
+    };
+    if (inputs == NULL || mapped == NULL || fds == NULL) { goto cleanup; }
+    for (size_t i = 0; i < count; i++) { fds[i] = -1; }
+
+    /* Line-based input that can't be mapped (e.g. a pipe) is kept open,
+     * to be streamed, rather than read whole. */
+    bool streamed = false;
+    for (size_t i = 0; i < count; i++) {
+        const char *path = (env->path_count > 0 ? env->paths[i] : "stdin");
+        const int fd = (env->path_count > 0 ? open_input(path) : STDIN_FILENO);
+        inputs[i].path = path;
+        mapped[i] = map_input(fd, &inputs[i]);
+        if (!mapped[i] && line_based(env->input)) {
+            fds[i] = fd;
+            streamed = true;
+            continue;
+        }
+        const bool got = (mapped[i]
+            || read_input(env, NULL, fd, path, &inputs[i]));
+        if (fd != STDIN_FILENO) { close(fd); }
+        if (!got) { goto cleanup; }
+    }
+
+    /* Splitting it would mean holding all of it in memory, so parse
+     * everything as it arrives, on this thread, instead. */
+    if (streamed) {
+        for (size_t i = 0; i < count; i++) {
+            if (!mapped[i]) { continue; }
+            munmap((void *)inputs[i].p, inputs[i].end - inputs[i].p);
+            inputs[i].p = NULL;
+        }
+        ok = load_serial(env, fds);
+        goto cleanup;
+    }
+
+    if (!split_chunks(&lenv, count, inputs, env->jobs, &cut)) { goto cleanup; }
+
+    if (lenv.chunk_count == 1) {
+        /* Not worth the extra interning. */
+        struct parser ps = {
+            .t = env->t,
+            .format = env->input,
+            .weights = env->weights,
+        };
+        ok = true;
+        for (size_t i = 0; ok && i < lenv.chunks[0].span_count; i++) {
+            ps.path = cut[i].path;
+            ok = parse_input(&ps, cut[i].p, cut[i].end);
+        }
+        free_parser(&ps);
+        goto cleanup;
+    }
+
+    pthread_t threads[MAX_JOBS];
+    size_t started = start_workers(&lenv, env->jobs, threads);
+    if (started == 0) { load_worker(&lenv); }
+    const bool merged = merge_names(&lenv);
+    if (!merged) {              /* stop claiming chunks */
+        __atomic_store_n(&lenv.next, lenv.chunk_count, __ATOMIC_RELAXED);
+    }
+    for (size_t i = 0; i < started; i++) { pthread_join(threads[i], NULL); }
+    if (!merged) { goto cleanup; }
+
+    /* Then add every chunk's lines, with the calling thread helping. */
+    lenv.adding = true;
+    lenv.next = 0;
+    started = start_workers(&lenv, env->jobs - 1, threads);
+    load_worker(&lenv);
+    for (size_t i = 0; i < started; i++) { pthread_join(threads[i], NULL); }
+    ok = true;
+    for (size_t i = 0; i < lenv.chunk_count; i++) {
+        if (!lenv.chunks[i].ok) {
+            /* Adding through a shard only fails for memory. */
+            env->load_error = HOPSCOTCH_ERROR_MEMORY;
+            ok = false;
+        }
+    }
+
+cleanup:
+    free_chunks(&lenv);
+    free(cut);
+    for (size_t i = 0; inputs != NULL && i < count; i++) {
+        if (fds != NULL && fds[i] != -1 && fds[i] != STDIN_FILENO) {
+            close(fds[i]);
+        }
+        if (inputs[i].p == NULL) { continue; }
+        if (mapped[i]) {
+            munmap((void *)inputs[i].p, inputs[i].end - inputs[i].p);
+        } else {
+            free_read(env, &inputs[i]);
+        }
+    }
+    free(inputs);
+    free(mapped);
+    free(fds);
+    pthread_cond_destroy(&lenv.parsed);
+    pthread_mutex_destroy(&lenv.lock);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    int res = EXIT_SUCCESS;
+    struct main_env env = {
+        .jobs = 0,
+    };
+    handle_args(&env, argc, argv);
+    pick_scanner();
+
+    env.t = hopscotch_new();
+    assert(env.t);
+    if (env.memory_limit > 0
+        && !hopscotch_set_memory_limit(env.t, env.memory_limit)) {
+        res = EXIT_FAILURE;
+        goto cleanup;
+    }
+
+    if (!(env.jobs > 1 ? load_parallel(&env) : load_serial(&env, NULL))) {
+        res = EXIT_FAILURE;
+        goto cleanup;
     }
 
     if (!hopscotch_seal(env.t)) {
@@ -241,23 +1847,45 @@ int main(int argc, char **argv) {
         goto cleanup;
     }
 
-    if (env.dot) {
-        const char *indent = "    ";
-        printf("digraph {\n");
-        printf("%sgraph [%s];\n", indent, getenv_attr("HOPSCOTCH_DOT_GRAPH_ATTR"));
-        printf("%snode [%s];\n", indent, getenv_attr("HOPSCOTCH_DOT_NODE_ATTR"));
-        printf("%sedge [%s];\n", indent, getenv_attr("HOPSCOTCH_DOT_EDGE_ATTR"));
+    if (env.renumber && !hopscotch_renumber(env.t, env.order)) {
+        res = EXIT_FAILURE;
+        goto cleanup;
+    }
+
+    if (env.format == FORMAT_DOT) {
+        out_str("digraph {\n");
+        out_str("    graph [");
+        out_str(getenv_attr("HOPSCOTCH_DOT_GRAPH_ATTR"));
+        out_str("];\n    node [");
+        out_str(getenv_attr("HOPSCOTCH_DOT_NODE_ATTR"));
+        out_str("];\n    edge [");
+        out_str(getenv_attr("HOPSCOTCH_DOT_EDGE_ATTR"));
+        out_str("];\n");
+    } else if (env.format == FORMAT_BINARY) {
+        out_bytes(BINARY_MAGIC, 4);
+        out_le32(BINARY_VERSION);
     }
 
-    if (!hopscotch_solve(env.t, 0, print_cb, &env)) {
+    if (env.verify || env.weights || env.reduce) {
+        if (!solve_and_report(&env)) {
+            res = EXIT_FAILURE;
+            goto cleanup;
+        }
+    } else if (!hopscotch_solve(env.t, 0, print_cb, &env)) {
         res = EXIT_FAILURE;
         goto cleanup;
     }
 
-    if (env.dot) { printf("}\n"); }
+    if (env.format == FORMAT_DOT) { out_str("}\n"); }
 
 cleanup:
-    symtab_free(env.s);
+    out_flush();
+    if (res != EXIT_SUCCESS
+        && (hopscotch_error(env.t) == HOPSCOTCH_ERROR_MEMORY
+            || env.load_error == HOPSCOTCH_ERROR_MEMORY)) {
+        fprintf(stderr, "%s\n", env.memory_limit > 0
+            ? "memory limit exceeded" : "out of memory");
+    }
     hopscotch_free(env.t);
     return res;
 }
@@ -0,0 +1,81 @@
+#!/bin/sh
+# Tests for the command-line program. Usage: test_cli.sh [path/to/hopscotch]
+
+HOPSCOTCH=${1:-build/hopscotch}
+TMP=${TMPDIR:-/tmp}/test_cli.$$
+mkdir -p "$TMP" || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+pass=0
+fail=0
+
+check() {
+    if [ "$2" = 0 ]; then
+        pass=$((pass + 1))
+    else
+        echo "FAIL: $1"
+        fail=$((fail + 1))
+    fi
+}
+
+# Group sizes, in order, from TSV output.
+group_sizes() {
+    cut -f 2 | uniq -c
+}
+
+# DOT in, DOT out, and back in again: names with quotes and
+# backslashes must be escaped in labels, and the groups must survive.
+dot_round_trip() {
+    cat > "$TMP/in.dot" <<'HERE'
+digraph {
+    "a\"x" -> b -> "a\"x";
+    "c\\d" -> b;
+    e -> { f "g h" } -> e;
+}
+HERE
+    "$HOPSCOTCH" -i dot -o tsv "$TMP/in.dot" | group_sizes > "$TMP/sizes1" || return 1
+    "$HOPSCOTCH" -i dot -o dot "$TMP/in.dot" > "$TMP/out.dot" || return 1
+    grep -F 'label="a\"x"' "$TMP/out.dot" > /dev/null || return 1
+    grep -F 'label="c\\\\d"' "$TMP/out.dot" > /dev/null || return 1
+    "$HOPSCOTCH" -i dot -o tsv "$TMP/out.dot" | group_sizes > "$TMP/sizes2" || return 1
+    cmp -s "$TMP/sizes1" "$TMP/sizes2"
+}
+dot_round_trip
+check dot_round_trip $?
+
+# A few MB of adjacency lines (a binary tree, with some nodes pointing
+# back to their parent), so -j cuts them into several chunks.
+awk 'BEGIN {
+    n = 200000
+    for (i = 0; i < n; i++) {
+        line = "n" i
+        if (2*i + 1 < n) { line = line " n" (2*i + 1) }
+        if (2*i + 2 < n) { line = line " n" (2*i + 2) }
+        if (i % 3 == 0 && i > 0) { line = line " n" int((i - 1)/2) }
+        print line
+    }
+}' > "$TMP/big.adj" || exit 1
+
+# With -j, every thread's parsing counts against the one -m limit.
+parallel_memory_limit() {
+    "$HOPSCOTCH" -j 4 -o tsv "$TMP/big.adj" > /dev/null || return 1
+    "$HOPSCOTCH" -j 4 -m 8m -o tsv "$TMP/big.adj" > /dev/null 2> "$TMP/err"
+    [ $? = 1 ] || return 1
+    grep -F "memory limit exceeded" "$TMP/err" > /dev/null
+}
+parallel_memory_limit
+check parallel_memory_limit $?
+
+# Piped input is streamed rather than split, and gives the same output.
+parallel_pipe() {
+    "$HOPSCOTCH" -j 1 -o tsv "$TMP/big.adj" > "$TMP/file.tsv" || return 1
+    cat "$TMP/big.adj" | "$HOPSCOTCH" -j 4 -o tsv > "$TMP/pipe.tsv" || return 1
+    cmp -s "$TMP/file.tsv" "$TMP/pipe.tsv" || return 1
+    cat "$TMP/big.adj" | "$HOPSCOTCH" -j 4 -m 8m -o tsv > /dev/null 2>&1
+    [ $? = 1 ]
+}
+parallel_pipe
+check parallel_pipe $?
+
+echo "pass $pass fail $fail"
+[ "$fail" = 0 ]
@@ -1,5 +1,8 @@
 #include "test_hopscotch.h"
 
+#include <pthread.h>
+#include <inttypes.h>
+
 #define MAX_MEMBERS_BUF 16
 
 struct input_group {
@@ -485,6 +488,1771 @@ TEST max_depth_limit(void) {
     PASS();
 }
 
+TEST solve_from_roots(void) {
+    struct hopscotch *t = hopscotch_new();
+
+    struct input_group in[] = {
+        { 'a', "b" },
+        { 'b', "c e f" },
+        { 'c', "d g" },
+        { 'd', "c h" },
+        { 'e', "a f" },
+        { 'f', "g" },
+        { 'g', "f" },
+        { 'h', "d g" },
+        { 'i', "" },
+    };
+
+    struct expected_group exp_c[] = {
+        { 0, "f g", },
+        { 1, "c d h", },
+    };
+
+    struct expected_group exp_all[] = {
+        { 0, "f g", },
+        { 1, "c d h", },
+        { 2, "a b e", },
+        { 3, "i", },
+    };
+
+    struct example_env env;
+    INIT_ENV(env, in, exp_c);
+    ADD_INPUT(env, t);
+
+    /* Only the part of the graph reachable from c. */
+    const uint32_t roots_c[] = { 'c' - 'a' };
+    ASSERT(hopscotch_solve_from(t, 1, roots_c, 0, match_cb, &env));
+    ASSERT(!env.error);
+    ASSERT(env.match);
+
+    /* The same handle can be reused with another root set. */
+    INIT_ENV(env, in, exp_all);
+    const uint32_t roots_all[] = { 'e' - 'a', 'f' - 'a', 'i' - 'a' };
+    ASSERT(hopscotch_solve_from(t, 3, roots_all, 0, match_cb, &env));
+    ASSERT(!env.error);
+    ASSERT(env.match);
+
+    /* Roots must be nodes in the graph. */
+    const uint32_t roots_bad[] = { 'z' - 'a' };
+    ASSERT(!hopscotch_solve_from(t, 1, roots_bad, 0, NULL, NULL));
+    ASSERT_EQ_FMT(HOPSCOTCH_ERROR_MISUSE, hopscotch_error(t), "%d");
+
+    hopscotch_free(t);
+    PASS();
+}
+
+TEST solve_masked_labels(void) {
+    struct hopscotch *t = hopscotch_new();
+    ASSERT(t);
+
+    enum { LABEL_BUILD = 0x01, LABEL_TEST = 0x02 };
+    const uint32_t a = 0, b = 1, c = 2;
+
+    const uint32_t succ_a[] = { b };
+    const uint8_t labels_a[] = { LABEL_BUILD };
+    ASSERT(hopscotch_add_labeled(t, a, 1, succ_a, labels_a));
+
+    const uint32_t succ_b[] = { a, c };
+    const uint8_t labels_b[] = { LABEL_TEST, LABEL_BUILD };
+    ASSERT(hopscotch_add_labeled(t, b, 2, succ_b, labels_b));
+    ASSERT(hopscotch_seal(t));
+
+    struct input_group in[] = { { 'a', "" } };
+    struct expected_group exp_all[] = {
+        { 0, "c", },
+        { 1, "a b", },
+    };
+    struct expected_group exp_build[] = {
+        { 0, "c", },
+        { 1, "b", },
+        { 2, "a", },
+    };
+    struct expected_group exp_test[] = {
+        { 0, "a", },
+        { 1, "b", },
+        { 2, "c", },
+    };
+
+    struct example_env env;
+    INIT_ENV(env, in, exp_all);
+    ASSERT(hopscotch_solve(t, 0, match_cb, &env));
+    ASSERT(!env.error);
+    ASSERT(env.match);
+
+    /* The same sealed graph, solved under different edge masks */
+    INIT_ENV(env, in, exp_build);
+    ASSERT(hopscotch_solve_masked(t, LABEL_BUILD, 0, match_cb, &env));
+    ASSERT(!env.error);
+    ASSERT(env.match);
+
+    INIT_ENV(env, in, exp_test);
+    ASSERT(hopscotch_solve_masked(t, LABEL_TEST, 0, match_cb, &env));
+    ASSERT(!env.error);
+    ASSERT(env.match);
+
+    INIT_ENV(env, in, exp_all);
+    ASSERT(hopscotch_solve_masked(t, LABEL_BUILD | LABEL_TEST, 0, match_cb, &env));
+    ASSERT(!env.error);
+    ASSERT(env.match);
+
+    hopscotch_free(t);
+    PASS();
+}
+
+static void
+sort_ids(size_t count, uint32_t *ids) {
+    for (size_t i = 1; i < count; i++) {
+        for (size_t j = i; j > 0 && ids[j - 1] > ids[j]; j--) {
+            const uint32_t tmp = ids[j];
+            ids[j] = ids[j - 1];
+            ids[j - 1] = tmp;
+        }
+    }
+}
+
+static bool
+impact_matches(struct hopscotch *t, const char *changed, const char *exp) {
+    uint32_t changed_ids[MAX_MEMBERS_BUF];
+    size_t changed_count = strlen(changed);
+    for (size_t i = 0; i < changed_count; i++) {
+        changed_ids[i] = changed[i] - 'a';
+    }
+
+    size_t affected_count = 0;
+    const uint32_t *affected = NULL;
+    if (!hopscotch_impact(t, changed_count, changed_ids,
+            &affected_count, &affected)) {
+        return false;
+    }
+    if (affected_count != strlen(exp)) { return false; }
+
+    uint32_t ids[MAX_MEMBERS_BUF];
+    memcpy(ids, affected, affected_count * sizeof(ids[0]));
+    sort_ids(affected_count, ids);
+    for (size_t i = 0; i < affected_count; i++) {
+        if (ids[i] != (uint32_t)(exp[i] - 'a')) { return false; }
+    }
+    return true;
+}
+
+TEST impact_of_changes(void) {
+    struct hopscotch *t = hopscotch_new();
+
+    struct input_group in[] = {
+        { 'a', "b" },
+        { 'b', "c e f" },
+        { 'c', "d g" },
+        { 'd', "c h" },
+        { 'e', "a f" },
+        { 'f', "g" },
+        { 'g', "f" },
+        { 'h', "d g" },
+        { 'i', "" },
+        { 'j', "a" },
+    };
+    struct expected_group exp[] = { { 0, "" } };
+
+    struct example_env env;
+    INIT_ENV(env, in, exp);
+    ADD_INPUT(env, t);
+
+    ASSERT(impact_matches(t, "g", "abcdefghj"));
+    ASSERT(impact_matches(t, "d", "abcdehj"));
+    ASSERT(impact_matches(t, "e", "abej"));
+    ASSERT(impact_matches(t, "j", "j"));
+    ASSERT(impact_matches(t, "ij", "ij"));
+    ASSERT(impact_matches(t, "", ""));
+
+    hopscotch_free(t);
+    PASS();
+}
+
+TEST reset_and_reuse(void) {
+    struct hopscotch *t = hopscotch_new();
+    ASSERT(t);
+
+    /* A larger, labeled graph first, so the second one reuses
+     * (and must not see) its nodes and labels. */
+    struct input_group in_big[] = {
+        { 'a', "b" },
+        { 'b', "c e f" },
+        { 'c', "d g" },
+        { 'd', "c h" },
+        { 'e', "a f" },
+        { 'f', "g" },
+        { 'g', "f" },
+        { 'h', "d g" },
+        { 'z', "" },
+    };
+    struct expected_group exp_big[] = { { 0, "" } };
+    struct example_env env;
+    INIT_ENV(env, in_big, exp_big);
+    ADD_INPUT(env, t);
+    const uint32_t succ_b[] = { 0 };
+    const uint8_t labels_b[] = { 0x02 };
+    hopscotch_reset(t);
+    ASSERT(hopscotch_add_labeled(t, 1, 1, succ_b, labels_b));
+    ASSERT(hopscotch_seal(t));
+    ASSERT(impact_matches(t, "a", "ab"));
+
+    for (size_t round = 0; round < 3; round++) {
+        hopscotch_reset(t);
+        ASSERT_EQ_FMT(HOPSCOTCH_ERROR_NONE, hopscotch_error(t), "%d");
+
+        struct input_group in[] = {
+            { 'a', "b" },
+            { 'b', "a" },
+            { 'c', "a" },
+        };
+        struct expected_group exp[] = {
+            { 0, "a b", },
+            { 1, "c", },
+        };
+        INIT_ENV(env, in, exp);
+        ADD_INPUT(env, t);
+        ASSERT(hopscotch_solve(t, 0, match_cb, &env));
+        ASSERT(!env.error);
+        ASSERT(env.match);
+
+        /* Edges from the previous graph's labels are gone. */
+        ASSERT(hopscotch_solve_masked(t, 0x02, 0, NULL, NULL));
+        ASSERT(impact_matches(t, "a", "abc"));
+    }
+
+    hopscotch_free(t);
+    PASS();
+}
+
+#define SHARD_TEST_NODES 1000
+#define SHARD_TEST_THREADS 4
+
+struct group_log {
+    uint32_t group_count;
+    uint32_t node_group[SHARD_TEST_NODES];
+};
+
+static void
+group_log_cb(uint32_t group_id, size_t count, const uint32_t *group,
+    void *udata) {
+    struct group_log *log = udata;
+    for (size_t i = 0; i < count; i++) {
+        log->node_group[group[i]] = group_id;
+    }
+    log->group_count = group_id + 1;
+}
+
+static void
+shard_test_successors(uint32_t id, uint32_t succ[2]) {
+    succ[0] = (id * 7 + 1) % SHARD_TEST_NODES;
+    succ[1] = (id * 13 + 5) % SHARD_TEST_NODES;
+}
+
+struct shard_test_env {
+    struct hopscotch_shard *shard;
+    uint32_t offset;
+    bool ok;
+};
+
+static void *
+shard_test_producer(void *arg) {
+    struct shard_test_env *env = arg;
+    env->ok = true;
+    for (uint32_t id = env->offset; id < SHARD_TEST_NODES;
+         id += SHARD_TEST_THREADS) {
+        uint32_t succ[2];
+        shard_test_successors(id, succ);
+        if (!hopscotch_shard_add(env->shard, id, 2, succ)) {
+            env->ok = false;
+        }
+    }
+    return NULL;
+}
+
+TEST sharded_build_matches_serial(void) {
+    struct hopscotch *serial = hopscotch_new();
+    ASSERT(serial);
+    for (uint32_t id = 0; id < SHARD_TEST_NODES; id++) {
+        uint32_t succ[2];
+        shard_test_successors(id, succ);
+        ASSERT(hopscotch_add(serial, id, 2, succ));
+    }
+    ASSERT(hopscotch_seal(serial));
+
+    struct hopscotch *sharded = hopscotch_new();
+    ASSERT(sharded);
+    struct shard_test_env envs[SHARD_TEST_THREADS];
+    pthread_t threads[SHARD_TEST_THREADS];
+    for (size_t i = 0; i < SHARD_TEST_THREADS; i++) {
+        envs[i] = (struct shard_test_env) {
+            .shard = hopscotch_shard_new(sharded),
+            .offset = i,
+        };
+        ASSERT(envs[i].shard);
+        ASSERT_EQ(0, pthread_create(&threads[i], NULL,
+                shard_test_producer, &envs[i]));
+    }
+    for (size_t i = 0; i < SHARD_TEST_THREADS; i++) {
+        ASSERT_EQ(0, pthread_join(threads[i], NULL));
+        ASSERT(envs[i].ok);
+    }
+    ASSERT(hopscotch_seal(sharded));
+
+    static struct group_log exp, got;
+    memset(&exp, 0x00, sizeof(exp));
+    memset(&got, 0x00, sizeof(got));
+    ASSERT(hopscotch_solve(serial, 0, group_log_cb, &exp));
+    ASSERT(hopscotch_solve(sharded, 0, group_log_cb, &got));
+
+    ASSERT_EQ_FMT(exp.group_count, got.group_count, "%u");
+    ASSERT_EQ(0, memcmp(exp.node_group, got.node_group,
+            sizeof(exp.node_group)));
+
+    hopscotch_free(serial);
+    hopscotch_free(sharded);
+    PASS();
+}
+
+struct solver_test_env {
+    struct hopscotch *t;
+    struct group_log log;
+    bool ok;
+};
+
+static void *
+solver_test_worker(void *arg) {
+    struct solver_test_env *env = arg;
+    struct hopscotch_solver *s = hopscotch_solver_new(env->t, NULL);
+    env->ok = (s != NULL);
+    if (!env->ok) { return NULL; }
+
+    /* Solving repeatedly with one solver should be fine, too. */
+    for (size_t i = 0; i < 3; i++) {
+        memset(&env->log, 0x00, sizeof(env->log));
+        if (!hopscotch_solver_solve(s, group_log_cb, &env->log)) {
+            env->ok = false;
+        }
+    }
+    hopscotch_solver_free(s);
+    return NULL;
+}
+
+TEST concurrent_solvers(void) {
+    struct hopscotch *t = hopscotch_new();
+    ASSERT(t);
+    for (uint32_t id = 0; id < SHARD_TEST_NODES; id++) {
+        uint32_t succ[2];
+        shard_test_successors(id, succ);
+        ASSERT(hopscotch_add(t, id, 2, succ));
+    }
+
+    /* Solvers can only be created for sealed graphs. */
+    ASSERT_EQ(NULL, hopscotch_solver_new(t, NULL));
+    ASSERT(hopscotch_seal(t));
+
+    static struct group_log exp;
+    memset(&exp, 0x00, sizeof(exp));
+    ASSERT(hopscotch_solve(t, 0, group_log_cb, &exp));
+
+    static struct solver_test_env envs[SHARD_TEST_THREADS];
+    pthread_t threads[SHARD_TEST_THREADS];
+    for (size_t i = 0; i < SHARD_TEST_THREADS; i++) {
+        envs[i].t = t;
+        ASSERT_EQ(0, pthread_create(&threads[i], NULL,
+                solver_test_worker, &envs[i]));
+    }
+    for (size_t i = 0; i < SHARD_TEST_THREADS; i++) {
+        ASSERT_EQ(0, pthread_join(threads[i], NULL));
+        ASSERT(envs[i].ok);
+        ASSERT_EQ_FMT(exp.group_count, envs[i].log.group_count, "%u");
+        ASSERT_EQ(0, memcmp(exp.node_group, envs[i].log.node_group,
+                sizeof(exp.node_group)));
+    }
+
+    hopscotch_free(t);
+    PASS();
+}
+
+#define MANY_TEST_GRAPHS 24
+
+static struct hopscotch *
+many_test_graph(uint32_t k) {
+    struct hopscotch *t = hopscotch_new();
+    if (t == NULL) { return NULL; }
+    const uint32_t node_count = 40 * k + 10;
+    for (uint32_t id = 0; id < node_count; id++) {
+        const uint32_t succ[2] = {
+            (id * 7 + k) % node_count,
+            (id * 13 + 5) % node_count,
+        };
+        if (!hopscotch_add(t, id, (id % 5 == 0 ? 1 : 2), succ)) {
+            hopscotch_free(t);
+            return NULL;
+        }
+    }
+    return t;
+}
+
+static void
+many_log_cb(size_t graph_index, uint32_t group_id, size_t count,
+    const uint32_t *group, void *udata) {
+    struct group_log *logs = udata;
+    group_log_cb(group_id, count, group, &logs[graph_index]);
+}
+
+TEST solve_many_graphs(void) {
+    struct hopscotch *graphs[MANY_TEST_GRAPHS];
+    static struct group_log exp[MANY_TEST_GRAPHS];
+    static struct group_log got[MANY_TEST_GRAPHS];
+    memset(exp, 0x00, sizeof(exp));
+
+    for (uint32_t k = 0; k < MANY_TEST_GRAPHS; k++) {
+        graphs[k] = many_test_graph(k);
+        ASSERT(graphs[k]);
+        ASSERT(hopscotch_seal(graphs[k]));
+        ASSERT(hopscotch_solve(graphs[k], 0, group_log_cb, &exp[k]));
+    }
+
+    /* Should match solving each graph alone, however many threads. */
+    const size_t thread_counts[] = { 1, 3, SHARD_TEST_THREADS, 0, 100 };
+    for (size_t i = 0; i < sizeof(thread_counts)/sizeof(thread_counts[0]); i++) {
+        memset(got, 0x00, sizeof(got));
+        ASSERT(hopscotch_solve_many(MANY_TEST_GRAPHS, graphs,
+                thread_counts[i], many_log_cb, got));
+        ASSERT_EQ(0, memcmp(exp, got, sizeof(exp)));
+    }
+
+    /* An unsealed graph fails, but doesn't stop the others. */
+    struct hopscotch *unsealed = many_test_graph(3);
+    ASSERT(unsealed);
+    struct hopscotch *mixed[] = { graphs[0], unsealed, graphs[2] };
+    memset(got, 0x00, sizeof(got));
+    ASSERT(!hopscotch_solve_many(3, mixed, 2, many_log_cb, got));
+    ASSERT_EQ_FMT(HOPSCOTCH_ERROR_MISUSE, hopscotch_error(unsealed), "%d");
+    ASSERT_EQ(0, memcmp(&exp[0], &got[0], sizeof(exp[0])));
+    ASSERT_EQ(0, memcmp(&exp[2], &got[2], sizeof(exp[2])));
+    hopscotch_free(unsealed);
+
+    for (uint32_t k = 0; k < MANY_TEST_GRAPHS; k++) {
+        hopscotch_free(graphs[k]);
+    }
+    PASS();
+}
+
+static bool
+result_matches_log(const struct hopscotch_result *res,
+    const struct group_log *log, size_t id_limit) {
+    if (res->group_count != log->group_count) { return false; }
+    for (uint32_t g = 0; g < res->group_count; g++) {
+        if (res->group_offsets[g] >= res->group_offsets[g + 1]) { return false; }
+        for (uint32_t mi = res->group_offsets[g];
+             mi < res->group_offsets[g + 1]; mi++) {
+            const uint32_t id = res->members[mi];
+            if (log->node_group[id] != g) { return false; }
+            if (res->node_group[id] != g) { return false; }
+            if (mi > res->group_offsets[g] && res->members[mi - 1] >= id) {
+                return false;   /* members are sorted */
+            }
+        }
+    }
+    if (res->group_offsets[res->group_count] != res->node_count) { return false; }
+    return res->id_limit == id_limit;
+}
+
+TEST solve_into_result(void) {
+    struct hopscotch *t = many_test_graph(7);
+    ASSERT(t);
+    /* Leave a gap in the IDs, and add a disconnected node. */
+    const uint32_t far_id = SHARD_TEST_NODES - 1;
+    ASSERT(hopscotch_add(t, far_id, 0, NULL));
+    ASSERT(hopscotch_seal(t));
+
+    static struct group_log exp;
+    memset(&exp, 0x00, sizeof(exp));
+    ASSERT(hopscotch_solve(t, 0, group_log_cb, &exp));
+
+    size_t id_limit, node_count;
+    ASSERT(hopscotch_result_size(t, &id_limit, &node_count));
+    ASSERT_EQ_FMT((size_t)far_id + 1, id_limit, "%zu");
+    ASSERT_EQ_FMT((size_t)(40 * 7 + 10 + 1), node_count, "%zu");
+
+    /* Buffers allocated by the library, reused on the second call. */
+    struct hopscotch_result res = { .id_limit = 0 };
+    for (size_t i = 0; i < 2; i++) {
+        ASSERT(hopscotch_solve_into(t, &res));
+        ASSERT(result_matches_log(&res, &exp, id_limit));
+        ASSERT_EQ_FMT(HOPSCOTCH_NO_GROUP, res.node_group[far_id - 1], "%u");
+    }
+    hopscotch_result_free(&res);
+    ASSERT_EQ(NULL, res.members);
+
+    /* Caller-provided buffers. */
+    static uint32_t node_group[SHARD_TEST_NODES];
+    static uint32_t group_offsets[40 * 7 + 10 + 2];
+    static uint32_t members[40 * 7 + 10 + 1];
+    struct hopscotch_result own = {
+        .node_group = node_group,
+        .group_offsets = group_offsets,
+        .members = members,
+    };
+    struct hopscotch_solver *s = hopscotch_solver_new(t, NULL);
+    ASSERT(s);
+    ASSERT(hopscotch_solver_solve_into(s, &own));
+    ASSERT(result_matches_log(&own, &exp, id_limit));
+    ASSERT_EQ(members, own.members);
+    hopscotch_result_free(&own);
+    ASSERT_EQ(members, own.members);
+    hopscotch_solver_free(s);
+
+    hopscotch_free(t);
+    PASS();
+}
+
+TEST verify_results(void) {
+    struct hopscotch *t = hopscotch_new();
+    ASSERT(t);
+    struct input_group in[] = {
+        { 'a', "b" },
+        { 'b', "c e f" },
+        { 'c', "d g" },
+        { 'd', "c h" },
+        { 'e', "a f" },
+        { 'f', "g" },
+        { 'g', "f" },
+        { 'h', "d g" },
+        { 'i', "" },
+    };
+    struct expected_group exp[] = { { 0, "" } };
+    struct example_env env;
+    INIT_ENV(env, in, exp);
+    ADD_INPUT(env, t);
+
+    struct hopscotch_result res = { .id_limit = 0 };
+    ASSERT(hopscotch_solve_into(t, &res));
+    ASSERT_EQ_FMT(HOPSCOTCH_VERIFY_OK, hopscotch_verify(t, &res), "%d");
+
+    /* Groups: i, fg, cdh, abe -- swapping the first two is still
+     * in a valid order, swapping the last two isn't. */
+    ASSERT_EQ_FMT(4U, res.group_count, "%u");
+    uint32_t *m = res.members;
+    uint32_t *ng = res.node_group;
+    const uint32_t a = 0, c = 2, d = 3, f = 5, g = 6, h = 7, i = 8;
+    ASSERT(m[0] == i && m[1] == f && m[2] == g);
+    m[0] = f; m[1] = g; m[2] = i;
+    ng[f] = 0; ng[g] = 0; ng[i] = 1;
+    res.group_offsets[1] = 2;
+    ASSERT_EQ_FMT(HOPSCOTCH_VERIFY_OK, hopscotch_verify(t, &res), "%d");
+
+    /* Move a into c's group: out of order, since a -> b. */
+    ASSERT(m[3] == c && m[6] == a);
+    ng[a] = 2;
+    ASSERT_EQ_FMT(HOPSCOTCH_VERIFY_BAD_MEMBERS, hopscotch_verify(t, &res), "%d");
+    ng[a] = 3;
+
+    /* Merge fg and i: not strongly connected. */
+    ng[i] = 0;
+    res.group_offsets[1] = 3;
+    ASSERT_EQ_FMT(HOPSCOTCH_VERIFY_BAD_MEMBERS, hopscotch_verify(t, &res), "%d");
+    for (uint32_t gi = 1; gi < 4; gi++) {
+        res.group_offsets[gi] = res.group_offsets[gi + 1];
+    }
+    res.group_count = 3;
+    for (uint32_t mi = 3; mi < 9; mi++) { ng[m[mi]]--; }
+    ASSERT_EQ_FMT(HOPSCOTCH_VERIFY_NOT_CONNECTED, hopscotch_verify(t, &res), "%d");
+
+    /* Back to the solver's result, then swap cdh and abe. */
+    ASSERT(hopscotch_solve_into(t, &res));
+    ASSERT(m == res.members);
+    ASSERT(m[3] == c && m[4] == d && m[5] == h);
+    memmove(&m[3], &m[6], 3 * sizeof(m[0]));
+    m[6] = c; m[7] = d; m[8] = h;
+    for (uint32_t mi = 3; mi < 9; mi++) { ng[m[mi]] = (mi < 6 ? 2 : 3); }
+    ASSERT_EQ_FMT(HOPSCOTCH_VERIFY_BAD_ORDER, hopscotch_verify(t, &res), "%d");
+
+    /* A node left out. */
+    ASSERT(hopscotch_solve_into(t, &res));
+    res.node_count--;
+    ASSERT_EQ_FMT(HOPSCOTCH_VERIFY_BAD_MEMBERS, hopscotch_verify(t, &res), "%d");
+
+    hopscotch_result_free(&res);
+    hopscotch_free(t);
+    PASS();
+}
+
+TEST member_orders(void) {
+    /* Big enough for a group that gets radix sorted. */
+    struct hopscotch *t = many_test_graph(20);
+    ASSERT(t);
+    ASSERT(hopscotch_seal(t));
+
+    static struct group_log exp;
+    memset(&exp, 0x00, sizeof(exp));
+    ASSERT(hopscotch_solve(t, 0, group_log_cb, &exp));
+
+    const enum hopscotch_member_order orders[] = {
+        HOPSCOTCH_MEMBERS_SORTED,
+        HOPSCOTCH_MEMBERS_STACK,
+        HOPSCOTCH_MEMBERS_DISCOVERY,
+    };
+    struct hopscotch_result res[3];
+    memset(res, 0x00, sizeof(res));
+    for (size_t i = 0; i < 3; i++) {
+        struct hopscotch_solver_config config = { .member_order = orders[i] };
+        struct hopscotch_solver *s = hopscotch_solver_new(t, &config);
+        ASSERT(s);
+        ASSERT(hopscotch_solver_solve_into(s, &res[i]));
+        hopscotch_solver_free(s);
+        ASSERT_EQ(0, memcmp(exp.node_group, res[i].node_group,
+                res[i].id_limit * sizeof(res[i].node_group[0])));
+    }
+
+    bool has_large_group = false;
+    for (uint32_t g = 0; g < res[0].group_count; g++) {
+        const uint32_t start = res[0].group_offsets[g];
+        const uint32_t end = res[0].group_offsets[g + 1];
+        if (end - start > 32) { has_large_group = true; }
+        for (uint32_t mi = start; mi < end; mi++) {
+            if (mi > start) { ASSERT(res[0].members[mi - 1] < res[0].members[mi]); }
+            /* Discovery order is stack order, reversed. */
+            ASSERT_EQ_FMT(res[1].members[mi],
+                res[2].members[start + end - 1 - mi], "%u");
+        }
+    }
+    ASSERT(has_large_group);
+
+    for (size_t i = 0; i < 3; i++) { hopscotch_result_free(&res[i]); }
+    hopscotch_free(t);
+    PASS();
+}
+
+static bool
+results_equal(const struct hopscotch_result *a,
+    const struct hopscotch_result *b) {
+    return a->group_count == b->group_count
+        && a->node_count == b->node_count
+        && 0 == memcmp(a->group_offsets, b->group_offsets,
+            (a->group_count + 1) * sizeof(a->group_offsets[0]))
+        && 0 == memcmp(a->members, b->members,
+            a->node_count * sizeof(a->members[0]));
+}
+
+TEST pearce_engine_matches(void) {
+    for (uint32_t k = 0; k < MANY_TEST_GRAPHS; k += 3) {
+        struct hopscotch *t = many_test_graph(k);
+        ASSERT(t);
+        ASSERT(hopscotch_add(t, SHARD_TEST_NODES - 1, 0, NULL));
+        ASSERT(hopscotch_seal(t));
+
+        struct hopscotch_solver_config config = {
+            .engine = HOPSCOTCH_ENGINE_PEARCE,
+        };
+        struct hopscotch_solver *tarjan = hopscotch_solver_new(t, NULL);
+        struct hopscotch_solver *pearce = hopscotch_solver_new(t, &config);
+        ASSERT(tarjan && pearce);
+        ASSERT(hopscotch_solver_memory(pearce)
+            < hopscotch_solver_memory(tarjan));
+
+        /* Solve twice, to check the state is reset afterward. */
+        struct hopscotch_result exp = { .id_limit = 0 };
+        struct hopscotch_result got = { .id_limit = 0 };
+        ASSERT(hopscotch_solver_solve_into(tarjan, &exp));
+        for (size_t i = 0; i < 2; i++) {
+            ASSERT(hopscotch_solver_solve_into(pearce, &got));
+            ASSERT(results_equal(&exp, &got));
+            ASSERT_EQ(HOPSCOTCH_VERIFY_OK, hopscotch_verify(t, &got));
+        }
+
+        /* Same for solving from roots. */
+        static struct group_log exp_log, got_log;
+        memset(&exp_log, 0x00, sizeof(exp_log));
+        memset(&got_log, 0x00, sizeof(got_log));
+        const uint32_t roots[] = { k, 3 };
+        ASSERT(hopscotch_solver_solve_from(tarjan, 2, roots,
+                group_log_cb, &exp_log));
+        ASSERT(hopscotch_solver_solve_from(pearce, 2, roots,
+                group_log_cb, &got_log));
+        ASSERT_EQ(0, memcmp(&exp_log, &got_log, sizeof(exp_log)));
+
+        /* And iterating. */
+        struct hopscotch_iter *it = hopscotch_iter_new(t, &config);
+        ASSERT(it);
+        uint32_t group_id;
+        size_t count;
+        const uint32_t *members;
+        memset(&got_log, 0x00, sizeof(got_log));
+        while (hopscotch_iter_next(it, &group_id, &count, &members)) {
+            group_log_cb(group_id, count, members, &got_log);
+        }
+        hopscotch_iter_free(it);
+        ASSERT_EQ(got.group_count, got_log.group_count);
+
+        hopscotch_result_free(&exp);
+        hopscotch_result_free(&got);
+        hopscotch_solver_free(tarjan);
+        hopscotch_solver_free(pearce);
+        hopscotch_free(t);
+    }
+    PASS();
+}
+
+/* Compressing can change the order groups are found in, but not the
+ * groups themselves. */
+static bool
+same_partition(const struct hopscotch_result *a,
+    const struct hopscotch_result *b) {
+    if (a->group_count != b->group_count) { return false; }
+    if (a->node_count != b->node_count) { return false; }
+    for (uint32_t g = 0; g < a->group_count; g++) {
+        const uint32_t start = a->group_offsets[g];
+        const uint32_t h = b->node_group[a->members[start]];
+        const uint32_t size = a->group_offsets[g + 1] - start;
+        if (b->group_offsets[h + 1] - b->group_offsets[h] != size) { return false; }
+        for (uint32_t mi = start; mi < a->group_offsets[g + 1]; mi++) {
+            if (b->node_group[a->members[mi]] != h) { return false; }
+        }
+    }
+    return true;
+}
+
+TEST compressed_successors(void) {
+    const enum hopscotch_engine engines[] = {
+        HOPSCOTCH_ENGINE_TARJAN, HOPSCOTCH_ENGINE_PEARCE,
+    };
+    for (uint32_t k = 0; k < MANY_TEST_GRAPHS; k += 5) {
+        struct hopscotch *t = many_test_graph(k);
+        struct hopscotch *packed = many_test_graph(k);
+        ASSERT(t && packed);
+        ASSERT(!hopscotch_compress(packed));    /* not sealed yet */
+        ASSERT_EQ_FMT(HOPSCOTCH_ERROR_MISUSE, hopscotch_error(packed), "%d");
+        ASSERT(hopscotch_seal(t));
+        ASSERT(hopscotch_seal(packed));
+        const size_t before = hopscotch_memory(packed);
+        ASSERT(hopscotch_compress(packed));
+        ASSERT(hopscotch_compress(packed));     /* no-op */
+        ASSERT(hopscotch_memory(packed) < before);
+
+        /* Successors come back sorted and without duplicates. */
+        const uint32_t node_count = 40 * k + 10;
+        for (uint32_t id = 0; id < node_count; id++) {
+            size_t count;
+            const uint32_t *succ;
+            ASSERT(hopscotch_get_successors(packed, id, &count, &succ));
+            const uint32_t a = (id * 7 + k) % node_count;
+            const uint32_t b = (id * 13 + 5) % node_count;
+            if (id % 5 == 0 || a == b) {
+                ASSERT_EQ(1, count);
+                ASSERT_EQ(a, succ[0]);
+            } else {
+                ASSERT_EQ(2, count);
+                ASSERT_EQ(a < b ? a : b, succ[0]);
+                ASSERT_EQ(a < b ? b : a, succ[1]);
+            }
+        }
+
+        for (size_t ei = 0; ei < 2; ei++) {
+            struct hopscotch_solver_config config = { .engine = engines[ei] };
+            struct hopscotch_solver *s = hopscotch_solver_new(t, &config);
+            struct hopscotch_solver *ps = hopscotch_solver_new(packed, &config);
+            ASSERT(s && ps);
+            struct hopscotch_result exp = { .id_limit = 0 };
+            struct hopscotch_result got = { .id_limit = 0 };
+            ASSERT(hopscotch_solver_solve_into(s, &exp));
+            ASSERT(hopscotch_solver_solve_into(ps, &got));
+            ASSERT(same_partition(&exp, &got));
+            ASSERT_EQ(HOPSCOTCH_VERIFY_OK, hopscotch_verify(packed, &got));
+            hopscotch_result_free(&exp);
+            hopscotch_result_free(&got);
+            hopscotch_solver_free(s);
+            hopscotch_solver_free(ps);
+        }
+        hopscotch_free(t);
+        hopscotch_free(packed);
+    }
+    PASS();
+}
+
+TEST solver_successors(void) {
+    /* Each solver decodes into its own buffer, so one solver's
+     * successors survive another's calls. */
+    const uint32_t k = 5;
+    const uint32_t node_count = 40 * k + 10;
+    struct hopscotch *t = many_test_graph(k);
+    ASSERT(t);
+    ASSERT(hopscotch_seal(t));
+    ASSERT(hopscotch_renumber(t, HOPSCOTCH_ORDER_RCM));
+    ASSERT(hopscotch_compress(t));
+    struct hopscotch_solver *s1 = hopscotch_solver_new(t, NULL);
+    struct hopscotch_solver *s2 = hopscotch_solver_new(t, NULL);
+    ASSERT(s1 && s2);
+
+    for (uint32_t id = 1; id < node_count; id++) {
+        size_t count1, count2, count;
+        const uint32_t *succ1, *succ2, *succ;
+        ASSERT(hopscotch_solver_get_successors(s1, id, &count1, &succ1));
+        ASSERT(hopscotch_solver_get_successors(s2, id - 1, &count2, &succ2));
+        ASSERT(hopscotch_get_successors(t, id - 1, &count, &succ));
+        const uint32_t a = (id * 7 + k) % node_count;
+        const uint32_t b = (id * 13 + 5) % node_count;
+        ASSERT_EQ(id % 5 == 0 || a == b ? 1 : 2, count1);
+        ASSERT(succ1[0] == a || succ1[0] == b);
+        if (count1 == 2) { ASSERT(succ1[1] == (succ1[0] == a ? b : a)); }
+
+        ASSERT_EQ(count, count2);
+        for (size_t i = 0; i < count; i++) { ASSERT_EQ(succ[i], succ2[i]); }
+    }
+    hopscotch_solver_free(s1);
+    hopscotch_solver_free(s2);
+    hopscotch_free(t);
+    PASS();
+}
+
+TEST compressed_labels(void) {
+    /* a -> b twice, with different labels, and b -> a. */
+    struct hopscotch *t = hopscotch_new();
+    ASSERT(t);
+    const uint32_t a = 1000, b = 3;
+    const uint32_t succ_a[] = { b, b };
+    const uint8_t labels_a[] = { 0x01, 0x02 };
+    const uint32_t succ_b[] = { a };
+    const uint8_t labels_b[] = { 0x02 };
+    for (size_t round = 0; round < 2; round++) {
+        ASSERT(hopscotch_add_labeled(t, a, 2, succ_a, labels_a));
+        ASSERT(hopscotch_add_labeled(t, b, 1, succ_b, labels_b));
+        ASSERT(hopscotch_seal(t));
+        ASSERT(hopscotch_compress(t));
+
+        size_t count;
+        const uint32_t *succ;
+        ASSERT(hopscotch_get_successors(t, a, &count, &succ));
+        ASSERT_EQ(1, count);
+        ASSERT_EQ(b, succ[0]);
+
+        /* The merged edge keeps both labels. */
+        const uint8_t masks[] = { 0x01, 0x02 };
+        const uint32_t exp_groups[] = { 2, 1 };
+        for (size_t i = 0; i < 2; i++) {
+            struct hopscotch_solver_config config = { .label_mask = masks[i] };
+            struct hopscotch_solver *s = hopscotch_solver_new(t, &config);
+            ASSERT(s);
+            struct hopscotch_result res = { .id_limit = 0 };
+            ASSERT(hopscotch_solver_solve_into(s, &res));
+            ASSERT_EQ(exp_groups[i], res.group_count);
+            hopscotch_result_free(&res);
+            hopscotch_solver_free(s);
+        }
+
+        /* The graph can be rebuilt after a reset. */
+        hopscotch_reset(t);
+    }
+    hopscotch_free(t);
+    PASS();
+}
+
+static bool
+sorted_ids_equal(size_t count, const uint32_t *a, const uint32_t *b) {
+    uint32_t sa[SHARD_TEST_NODES], sb[SHARD_TEST_NODES];
+    if (count > SHARD_TEST_NODES) { return false; }
+    memcpy(sa, a, count * sizeof(sa[0]));
+    memcpy(sb, b, count * sizeof(sb[0]));
+    for (size_t i = 1; i < count; i++) {    /* insertion sort both */
+        for (size_t j = i; j > 0 && sa[j - 1] > sa[j]; j--) {
+            const uint32_t tmp = sa[j]; sa[j] = sa[j - 1]; sa[j - 1] = tmp;
+        }
+        for (size_t j = i; j > 0 && sb[j - 1] > sb[j]; j--) {
+            const uint32_t tmp = sb[j]; sb[j] = sb[j - 1]; sb[j - 1] = tmp;
+        }
+    }
+    return 0 == memcmp(sa, sb, count * sizeof(sa[0]));
+}
+
+TEST renumbered_nodes(void) {
+    const enum hopscotch_node_order orders[] = {
+        HOPSCOTCH_ORDER_BFS, HOPSCOTCH_ORDER_DFS,
+        HOPSCOTCH_ORDER_RCM, HOPSCOTCH_ORDER_DEGREE,
+    };
+    for (size_t oi = 0; oi < sizeof(orders)/sizeof(orders[0]); oi++) {
+        for (uint32_t k = 1; k < MANY_TEST_GRAPHS; k += 7) {
+            struct hopscotch *t = many_test_graph(k);
+            struct hopscotch *r = many_test_graph(k);
+            ASSERT(t && r);
+            ASSERT(!hopscotch_renumber(r, orders[oi]));     /* unsealed */
+            ASSERT(hopscotch_seal(t));
+            ASSERT(hopscotch_seal(r));
+            ASSERT(hopscotch_renumber(r, orders[oi]));
+
+            /* Same groups, with sorted members, in the caller's IDs. */
+            struct hopscotch_result exp = { .id_limit = 0 };
+            struct hopscotch_result got = { .id_limit = 0 };
+            ASSERT(hopscotch_solve_into(t, &exp));
+            ASSERT(hopscotch_solve_into(r, &got));
+            ASSERT(same_partition(&exp, &got));
+            ASSERT_EQ(HOPSCOTCH_VERIFY_OK, hopscotch_verify(r, &got));
+            for (uint32_t g = 0; g < got.group_count; g++) {
+                for (uint32_t mi = got.group_offsets[g] + 1;
+                     mi < got.group_offsets[g + 1]; mi++) {
+                    ASSERT(got.members[mi - 1] < got.members[mi]);
+                }
+            }
+
+            /* Successors, roots, and impact queries are mapped too. */
+            const uint32_t node_count = 40 * k + 10;
+            for (uint32_t id = 0; id < node_count; id++) {
+                size_t ecount, gcount;
+                const uint32_t *esucc, *gsucc;
+                ASSERT(hopscotch_get_successors(t, id, &ecount, &esucc));
+                ASSERT(hopscotch_get_successors(r, id, &gcount, &gsucc));
+                ASSERT_EQ(ecount, gcount);
+                ASSERT(sorted_ids_equal(ecount, esucc, gsucc));
+            }
+
+            static struct group_log exp_log, got_log;
+            memset(&exp_log, 0x00, sizeof(exp_log));
+            memset(&got_log, 0x00, sizeof(got_log));
+            const uint32_t roots[] = { k, 3 };
+            ASSERT(hopscotch_solve_from(t, 2, roots, 0,
+                    group_log_cb, &exp_log));
+            ASSERT(hopscotch_solve_from(r, 2, roots, 0,
+                    group_log_cb, &got_log));
+            ASSERT_EQ(exp_log.group_count, got_log.group_count);
+
+            size_t eaffected, gaffected;
+            const uint32_t *eids, *gids;
+            ASSERT(hopscotch_impact(t, 2, roots, &eaffected, &eids));
+            ASSERT(hopscotch_impact(r, 2, roots, &gaffected, &gids));
+            ASSERT_EQ(eaffected, gaffected);
+            ASSERT(sorted_ids_equal(eaffected, eids, gids));
+
+            /* Renumbering again composes, and compressing still works,
+             * but renumbering after compressing doesn't. */
+            ASSERT(hopscotch_renumber(r, HOPSCOTCH_ORDER_DFS));
+            ASSERT(hopscotch_compress(r));
+            ASSERT(!hopscotch_renumber(r, orders[oi]));
+            ASSERT(hopscotch_solve_into(r, &got));
+            ASSERT(same_partition(&exp, &got));
+            ASSERT_EQ(HOPSCOTCH_VERIFY_OK, hopscotch_verify(r, &got));
+
+            hopscotch_result_free(&exp);
+            hopscotch_result_free(&got);
+            hopscotch_free(t);
+            hopscotch_free(r);
+        }
+    }
+    PASS();
+}
+
+TEST critical_path(void) {
+    /* a depends on b and c, which both depend on the cycle d <-> e. */
+    enum { A, B, C, D, E, NODES };
+    const uint64_t weights[NODES] = { 1, 10, 2, 3, 4 };
+    const uint32_t succ_a[] = { B, C };
+    const uint32_t succ_b[] = { D };
+    const uint32_t succ_c[] = { D };
+    const uint32_t succ_d[] = { E };
+    const uint32_t succ_e[] = { D };
+
+    for (size_t renumber = 0; renumber < 2; renumber++) {
+        struct hopscotch *t = hopscotch_new();
+        ASSERT(t);
+        ASSERT(hopscotch_set_weight(t, E, weights[E]));  /* before adding */
+        ASSERT(hopscotch_add(t, A, 2, succ_a));
+        ASSERT(hopscotch_add(t, B, 1, succ_b));
+        ASSERT(hopscotch_add(t, C, 1, succ_c));
+        ASSERT(hopscotch_add(t, D, 1, succ_d));
+        ASSERT(hopscotch_add(t, E, 1, succ_e));
+        ASSERT(hopscotch_seal(t));
+        for (uint32_t id = A; id < E; id++) {
+            ASSERT(hopscotch_set_weight(t, id, weights[id]));
+        }
+        if (renumber) { ASSERT(hopscotch_renumber(t, HOPSCOTCH_ORDER_RCM)); }
+
+        struct hopscotch_result res = { .id_limit = 0 };
+        ASSERT(hopscotch_solve_into(t, &res));
+        ASSERT_EQ(4, res.group_count);
+
+        struct hopscotch_critical_path cp;
+        ASSERT(hopscotch_critical_path(t, &res, &cp));
+        ASSERT_EQ(4, cp.group_count);
+        ASSERT_EQ_FMT((uint64_t)7, cp.finish[res.node_group[D]], "%" PRIu64);
+        ASSERT_EQ_FMT((uint64_t)17, cp.finish[res.node_group[B]], "%" PRIu64);
+        ASSERT_EQ_FMT((uint64_t)9, cp.finish[res.node_group[C]], "%" PRIu64);
+        ASSERT_EQ_FMT((uint64_t)18, cp.finish[res.node_group[A]], "%" PRIu64);
+        ASSERT_EQ_FMT((uint64_t)18, cp.total, "%" PRIu64);
+        ASSERT_EQ(3, cp.path_length);
+        ASSERT_EQ(res.node_group[D], cp.path[0]);
+        ASSERT_EQ(res.node_group[B], cp.path[1]);
+        ASSERT_EQ(res.node_group[A], cp.path[2]);
+        hopscotch_critical_path_free(&cp);
+
+        /* After a reset, weights go back to 0. */
+        hopscotch_reset(t);
+        ASSERT(hopscotch_add(t, A, 1, succ_a));
+        ASSERT(hopscotch_seal(t));
+        ASSERT(hopscotch_solve_into(t, &res));
+        ASSERT(hopscotch_critical_path(t, &res, &cp));
+        ASSERT_EQ_FMT((uint64_t)0, cp.total, "%" PRIu64);
+        hopscotch_critical_path_free(&cp);
+
+        hopscotch_result_free(&res);
+        hopscotch_free(t);
+    }
+    PASS();
+}
+
+struct execute_log {
+    uint32_t node_count;
+    uint32_t k;
+    const uint32_t *node_group;    /* from solving normally */
+    uint8_t done[SHARD_TEST_NODES];  /* atomic */
+    uint32_t calls;                 /* atomic */
+    uint32_t early;                 /* atomic, ran before a dependency */
+};
+
+static void
+execute_log_cb(uint32_t group_id, size_t count, const uint32_t *group,
+    void *udata) {
+    (void)group_id;
+    struct execute_log *log = udata;
+    const uint32_t n = log->node_count;
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t id = group[i];
+        const uint32_t succ[2] = {
+            (id * 7 + log->k) % n,
+            (id * 13 + 5) % n,
+        };
+        for (size_t si = 0; si < (id % 5 == 0 ? 1 : 2); si++) {
+            const uint32_t v = succ[si];
+            if (log->node_group[v] == log->node_group[id]) { continue; }
+            if (!__atomic_load_n(&log->done[v], __ATOMIC_ACQUIRE)) {
+                __atomic_add_fetch(&log->early, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (__atomic_exchange_n(&log->done[group[i]], 1, __ATOMIC_RELEASE)) {
+            __atomic_add_fetch(&log->early, 1, __ATOMIC_RELAXED); /* twice */
+        }
+    }
+    __atomic_add_fetch(&log->calls, 1, __ATOMIC_RELAXED);
+}
+
+TEST execute_groups(void) {
+    const size_t thread_counts[] = { 1, 3, SHARD_TEST_THREADS, 0, 1000 };
+    for (uint32_t k = 0; k < MANY_TEST_GRAPHS; k += 4) {
+        struct hopscotch *t = many_test_graph(k);
+        ASSERT(t);
+        ASSERT(hopscotch_seal(t));
+        struct hopscotch_result res = { .id_limit = 0 };
+        ASSERT(hopscotch_solve_into(t, &res));
+
+        for (size_t i = 0; i < sizeof(thread_counts)/sizeof(thread_counts[0]); i++) {
+            static struct execute_log log;
+            memset(&log, 0x00, sizeof(log));
+            log.node_count = 40 * k + 10;
+            log.k = k;
+            log.node_group = res.node_group;
+            ASSERT(hopscotch_execute(t, thread_counts[i], execute_log_cb, &log));
+            ASSERT_EQ(res.group_count, log.calls);
+            ASSERT_EQ(0, log.early);
+            for (uint32_t id = 0; id < log.node_count; id++) {
+                ASSERT(log.done[id]);
+            }
+        }
+        hopscotch_result_free(&res);
+        hopscotch_free(t);
+    }
+
+    /* Unsealed graphs can't be executed. */
+    struct hopscotch *t = hopscotch_new();
+    ASSERT(t);
+    ASSERT(!hopscotch_execute(t, 1, execute_log_cb, NULL));
+    ASSERT_EQ_FMT(HOPSCOTCH_ERROR_MISUSE, hopscotch_error(t), "%d");
+    hopscotch_free(t);
+    PASS();
+}
+
+static void check_sorted_cb(uint32_t group_id,
+        size_t count, const uint32_t *group, void *udata) {
+    (void)group_id;
+    size_t *unsorted = udata;
+    for (size_t i = 1; i < count; i++) {
+        if (group[i - 1] >= group[i]) {
+            __atomic_add_fetch(unsorted, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+TEST execute_sorted_after_impact(void) {
+    /* The condensation is shared, so a solver with another member
+     * order building it first mustn't change execute's groups. */
+    struct hopscotch *t = many_test_graph(20);
+    ASSERT(t);
+    ASSERT(hopscotch_seal(t));
+    struct hopscotch_solver_config config = {
+        .member_order = HOPSCOTCH_MEMBERS_STACK,
+    };
+    struct hopscotch_solver *s = hopscotch_solver_new(t, &config);
+    ASSERT(s);
+    const uint32_t changed[] = { 0 };
+    size_t affected_count;
+    const uint32_t *affected;
+    ASSERT(hopscotch_solver_impact(s, 1, changed, &affected_count, &affected));
+
+    size_t unsorted = 0;
+    ASSERT(hopscotch_execute(t, 2, check_sorted_cb, &unsorted));
+    ASSERT_EQ_FMT((size_t)0, unsorted, "%zu");
+    hopscotch_solver_free(s);
+    hopscotch_free(t);
+    PASS();
+}
+
+TEST reduce_small(void) {
+    /* a -> c and a -> d are implied by a -> b -> c <-> d. */
+    enum { A, B, C, D, E };
+    const uint32_t succ_a[] = { B, C, D };
+    const uint32_t succ_b[] = { C };
+    const uint32_t succ_c[] = { D };
+    const uint32_t succ_d[] = { C };
+    const uint32_t succ_e[] = { A };
+    struct hopscotch *t = hopscotch_new();
+    ASSERT(t);
+    ASSERT(hopscotch_add(t, A, 3, succ_a));
+    ASSERT(hopscotch_add(t, B, 1, succ_b));
+    ASSERT(hopscotch_add(t, C, 1, succ_c));
+    ASSERT(hopscotch_add(t, D, 1, succ_d));
+    ASSERT(hopscotch_add(t, E, 1, succ_e));
+    ASSERT(hopscotch_seal(t));
+
+    struct hopscotch_result res = { .id_limit = 0 };
+    ASSERT(hopscotch_solve_into(t, &res));
+    struct hopscotch_reduction red;
+    ASSERT(hopscotch_reduce(t, &res, &red));
+    ASSERT_EQ(4, red.group_count);
+    ASSERT_EQ(1, red.removed);  /* c and d are one group */
+
+    const uint32_t ga = res.node_group[A];
+    ASSERT_EQ(1, red.offsets[ga + 1] - red.offsets[ga]);
+    ASSERT_EQ(res.node_group[B], red.edges[red.offsets[ga]]);
+    const uint32_t gc = res.node_group[C];
+    ASSERT_EQ(0, red.offsets[gc + 1] - red.offsets[gc]);
+    hopscotch_reduction_free(&red);
+    hopscotch_result_free(&res);
+    hopscotch_free(t);
+    PASS();
+}
+
+#define REDUCE_TEST_GROUPS SHARD_TEST_NODES
+
+TEST reduce_matches_closure(void) {
+    static bool reach[REDUCE_TEST_GROUPS][REDUCE_TEST_GROUPS];
+    static bool edge[REDUCE_TEST_GROUPS][REDUCE_TEST_GROUPS];
+    for (uint32_t k = 1; k < MANY_TEST_GRAPHS; k += 5) {
+        struct hopscotch *t = many_test_graph(k);
+        ASSERT(t);
+        ASSERT(hopscotch_seal(t));
+        struct hopscotch_result res = { .id_limit = 0 };
+        ASSERT(hopscotch_solve_into(t, &res));
+        const uint32_t gc = res.group_count;
+        ASSERT(gc <= REDUCE_TEST_GROUPS);
+
+        /* Brute force: every group's edges and transitive closure. */
+        memset(reach, 0x00, sizeof(reach));
+        memset(edge, 0x00, sizeof(edge));
+        for (uint32_t id = 0; id < res.id_limit; id++) {
+            size_t count;
+            const uint32_t *succ;
+            ASSERT(hopscotch_get_successors(t, id, &count, &succ));
+            for (size_t si = 0; si < count; si++) {
+                const uint32_t g = res.node_group[id];
+                const uint32_t h = res.node_group[succ[si]];
+                if (h != g) { edge[g][h] = true; }
+            }
+        }
+        for (uint32_t g = 0; g < gc; g++) {
+            for (uint32_t h = 0; h < g; h++) {
+                if (!edge[g][h]) { continue; }
+                reach[g][h] = true;
+                for (uint32_t x = 0; x < h; x++) {
+                    if (reach[h][x]) { reach[g][x] = true; }
+                }
+            }
+        }
+
+        struct hopscotch_reduction red;
+        ASSERT(hopscotch_reduce(t, &res, &red));
+        size_t kept = 0, total = 0;
+        for (uint32_t g = 0; g < gc; g++) {
+            for (uint32_t h = 0; h < g; h++) {
+                if (!edge[g][h]) { continue; }
+                total++;
+                bool implied = false;
+                for (uint32_t x = h + 1; x < g; x++) {
+                    if (edge[g][x] && reach[x][h]) { implied = true; }
+                }
+                bool found = false;
+                for (uint32_t ei = red.offsets[g]; ei < red.offsets[g + 1]; ei++) {
+                    if (red.edges[ei] == h) { found = true; }
+                }
+                ASSERT_EQ(!implied, found);
+                if (found) { kept++; }
+            }
+        }
+        ASSERT_EQ(kept, red.offsets[gc]);
+        ASSERT_EQ(total - kept, red.removed);
+        hopscotch_reduction_free(&red);
+        hopscotch_result_free(&res);
+        hopscotch_free(t);
+    }
+    PASS();
+}
+
+/* Like many_test_graph, but with every ID reversed. */
+static struct hopscotch *
+reversed_test_graph(uint32_t k) {
+    struct hopscotch *t = hopscotch_new();
+    if (t == NULL) { return NULL; }
+    const uint32_t node_count = 40 * k + 10;
+    const uint32_t last = node_count - 1;
+    for (uint32_t id = 0; id < node_count; id++) {
+        const uint32_t succ[2] = {
+            last - (id * 7 + k) % node_count,
+            last - (id * 13 + 5) % node_count,
+        };
+        if (!hopscotch_add(t, last - id, (id % 5 == 0 ? 1 : 2), succ)) {
+            hopscotch_free(t);
+            return NULL;
+        }
+    }
+    return t;
+}
+
+TEST fingerprint_groups(void) {
+    static uint64_t hashes[SHARD_TEST_NODES], rhashes[SHARD_TEST_NODES];
+    static uint64_t fps[SHARD_TEST_NODES], rfps[SHARD_TEST_NODES];
+    static uint64_t changed_fps[SHARD_TEST_NODES];
+    static bool affected[SHARD_TEST_NODES];
+    for (uint32_t k = 2; k < MANY_TEST_GRAPHS; k += 6) {
+        const uint32_t node_count = 40 * k + 10;
+        struct hopscotch *t = many_test_graph(k);
+        struct hopscotch *r = reversed_test_graph(k);
+        ASSERT(t && r);
+        ASSERT(hopscotch_seal(t));
+        ASSERT(hopscotch_seal(r));
+        for (uint32_t id = 0; id < node_count; id++) {
+            hashes[id] = 0x1234567 * (uint64_t)id + k;
+            rhashes[node_count - 1 - id] = hashes[id];
+        }
+
+        struct hopscotch_result res = { .id_limit = 0 };
+        struct hopscotch_result rres = { .id_limit = 0 };
+        ASSERT(hopscotch_solve_into(t, &res));
+        ASSERT(hopscotch_solve_into(r, &rres));
+        ASSERT(hopscotch_fingerprint(t, &res, hashes, fps));
+        ASSERT(hopscotch_fingerprint(r, &rres, rhashes, rfps));
+
+        /* The same content gets the same fingerprints, whatever the IDs. */
+        for (uint32_t id = 0; id < node_count; id++) {
+            ASSERT_EQ_FMT(fps[res.node_group[id]],
+                rfps[rres.node_group[node_count - 1 - id]], "%" PRIx64);
+        }
+
+        /* Changing one node changes exactly the groups that depend on it. */
+        const uint32_t changed = k;
+        size_t affected_count;
+        const uint32_t *affected_ids;
+        ASSERT(hopscotch_impact(t, 1, &changed, &affected_count, &affected_ids));
+        memset(affected, 0x00, sizeof(affected));
+        for (size_t i = 0; i < affected_count; i++) {
+            affected[res.node_group[affected_ids[i]]] = true;
+        }
+        hashes[changed]++;
+        ASSERT(hopscotch_fingerprint(t, &res, hashes, changed_fps));
+        for (uint32_t g = 0; g < res.group_count; g++) {
+            ASSERT_EQ(affected[g], fps[g] != changed_fps[g]);
+        }
+
+        hopscotch_result_free(&res);
+        hopscotch_result_free(&rres);
+        hopscotch_free(t);
+        hopscotch_free(r);
+    }
+    PASS();
+}
+
+struct test_payload {
+    uint32_t id;
+    uint16_t owner;
+};
+
+TEST node_payloads(void) {
+    struct hopscotch *t = many_test_graph(5);
+    ASSERT(t);
+    ASSERT(hopscotch_set_payload_size(t, sizeof(struct test_payload)));
+    const uint32_t node_count = 40 * 5 + 10;
+    ASSERT(hopscotch_payload(t, 0) == NULL);    /* none set yet */
+    for (uint32_t id = 1; id < node_count; id++) {  /* skip 0 */
+        const struct test_payload p = { .id = id, .owner = id % 7 };
+        ASSERT(hopscotch_set_payload(t, id, &p));
+    }
+    ASSERT(!hopscotch_set_payload_size(t, 4));  /* too late */
+    ASSERT(hopscotch_seal(t));
+    ASSERT(hopscotch_renumber(t, HOPSCOTCH_ORDER_BFS));
+
+    const struct test_payload *p = hopscotch_payload(t, 17);
+    ASSERT(p);
+    ASSERT_EQ(17, p->id);
+    p = hopscotch_payload(t, 0);
+    ASSERT(p);
+    ASSERT_EQ(0, p->id);
+    ASSERT_EQ(0, p->owner);
+
+    /* Gathered into member order. */
+    struct hopscotch_result res = { .id_limit = 0 };
+    ASSERT(hopscotch_solve_into(t, &res));
+    static struct test_payload gathered[SHARD_TEST_NODES];
+    ASSERT(hopscotch_gather_payloads(t, &res, gathered));
+    for (size_t i = 0; i < res.node_count; i++) {
+        ASSERT_EQ(res.members[i], gathered[i].id);
+    }
+
+    /* And for each group from an iterator. */
+    struct hopscotch_iter *it = hopscotch_iter_new(t, NULL);
+    ASSERT(it);
+    size_t count, seen = 0;
+    const uint32_t *members;
+    while (hopscotch_iter_next(it, NULL, &count, &members)) {
+        const struct test_payload *ps = hopscotch_iter_payloads(it);
+        ASSERT(ps);
+        for (size_t i = 0; i < count; i++) {
+            ASSERT_EQ(members[i], ps[i].id);
+            ASSERT_EQ(members[i] % 7, ps[i].owner);
+        }
+        seen += count;
+    }
+    ASSERT_EQ(node_count, seen);
+    hopscotch_iter_free(it);
+
+    /* A reset clears them, but keeps the size. */
+    hopscotch_reset(t);
+    p = hopscotch_payload(t, 17);
+    ASSERT(p);
+    ASSERT_EQ(0, p->id);
+    hopscotch_result_free(&res);
+    hopscotch_free(t);
+
+    /* By default, payloads are pointer-sized. */
+    t = hopscotch_new();
+    ASSERT(t);
+    const char *name = "name";
+    ASSERT(hopscotch_set_payload(t, 3, &name));
+    const char *const *slot = hopscotch_payload(t, 3);
+    ASSERT(slot);
+    ASSERT_EQ(name, *slot);
+    hopscotch_free(t);
+    PASS();
+}
+
+TEST iterate_groups(void) {
+    struct hopscotch *t = many_test_graph(9);
+    ASSERT(t);
+    ASSERT(hopscotch_add(t, SHARD_TEST_NODES - 1, 0, NULL));
+    ASSERT(hopscotch_iter_new(t, NULL) == NULL); /* not sealed yet */
+    ASSERT(hopscotch_seal(t));
+
+    static struct group_log exp, got;
+    memset(&exp, 0x00, sizeof(exp));
+    memset(&got, 0x00, sizeof(got));
+    ASSERT(hopscotch_solve(t, 0, group_log_cb, &exp));
+
+    struct hopscotch_iter *it = hopscotch_iter_new(t, NULL);
+    ASSERT(it);
+    uint32_t group_id;
+    size_t count;
+    const uint32_t *members;
+    uint32_t expected_id = 0;
+    while (hopscotch_iter_next(it, &group_id, &count, &members)) {
+        ASSERT_EQ_FMT(expected_id, group_id, "%u");
+        expected_id++;
+        group_log_cb(group_id, count, members, &got);
+    }
+    ASSERT_EQ_FMT(HOPSCOTCH_ERROR_NONE, hopscotch_iter_error(it), "%d");
+    ASSERT(!hopscotch_iter_next(it, &group_id, &count, &members));
+    hopscotch_iter_free(it);
+    ASSERT_EQ(0, memcmp(&exp, &got, sizeof(exp)));
+
+    /* Stopping early is fine. */
+    it = hopscotch_iter_new(t, NULL);
+    ASSERT(it);
+    ASSERT(hopscotch_iter_next(it, &group_id, &count, &members));
+    ASSERT_EQ_FMT(0U, group_id, "%u");
+    hopscotch_iter_free(it);
+
+    /* Errors stop the iteration. */
+    struct hopscotch_solver_config config = { .max_depth = 2 };
+    it = hopscotch_iter_new(t, &config);
+    ASSERT(it);
+    while (hopscotch_iter_next(it, NULL, NULL, NULL)) {}
+    ASSERT_EQ_FMT(HOPSCOTCH_ERROR_RECURSION_DEPTH,
+        hopscotch_iter_error(it), "%d");
+    hopscotch_iter_free(it);
+
+    hopscotch_free(t);
+    PASS();
+}
+
+TEST add_to_disconnected_node(void) {
+    struct hopscotch *t = hopscotch_new();
+
+    /* a is first added without successors, then gets one. */
+    struct input_group in[] = {
+        { 'a', "" },
+        { 'a', "b" },
+    };
+
+    struct expected_group exp[] = {
+        { 0, "b", },
+        { 1, "a", },
+    };
+
+    HOPSCOTCH_TEST();
+    PASS();
+}
+
+TEST named_nodes(void) {
+    struct hopscotch *t = hopscotch_new();
+    ASSERT(t);
+
+    /* a -> b -> c -> a, and c -> "" (the empty name) */
+    const char *a_succ[] = { "b" };
+    const size_t a_lens[] = { 1 };
+    const char *c_succ[] = { "a", "", "b" };
+    const size_t c_lens[] = { 1, 0, 1 };
+    ASSERT(hopscotch_add_named(t, "a", 1, 1, a_succ, a_lens));
+    ASSERT(hopscotch_add_named(t, "b", 1, 1, (const char *[]){ "c" }, a_lens));
+    ASSERT(hopscotch_add_named(t, "c", 1, 3, c_succ, c_lens));
+
+    /* IDs are assigned in the order first seen. */
+    uint32_t id;
+    ASSERT(hopscotch_intern(t, "a", 1, &id));
+    ASSERT_EQ(0, id);
+    ASSERT(hopscotch_intern(t, "c", 1, &id));
+    ASSERT_EQ(2, id);
+    ASSERT(hopscotch_intern(t, "", 0, &id));
+    ASSERT_EQ(3, id);
+    ASSERT(hopscotch_intern(t, "ab", 2, &id));    /* only a prefix matches */
+    ASSERT_EQ(4, id);
+    ASSERT(hopscotch_seal(t));
+
+    size_t len;
+    ASSERT_STR_EQ("c", hopscotch_name(t, 2, &len));
+    ASSERT_EQ(1, len);
+    ASSERT_STR_EQ("", hopscotch_name(t, 3, &len));
+    ASSERT_EQ(0, len);
+    ASSERT_EQ(NULL, hopscotch_name(t, 5, NULL));
+    ASSERT(!hopscotch_add_named(t, "d", 1, 0, NULL, NULL));    /* sealed */
+
+    struct hopscotch_result res = { .id_limit = 0 };
+    ASSERT(hopscotch_solve_into(t, &res));
+    ASSERT_EQ(2, res.group_count);
+    ASSERT_EQ(res.node_group[0], res.node_group[2]);
+    ASSERT(res.node_group[3] < res.node_group[0]);
+    hopscotch_result_free(&res);
+
+    /* Enough names to grow the index several times, with the same IDs
+     * afterward. */
+    hopscotch_reset(t);
+    ASSERT_EQ(NULL, hopscotch_name(t, 0, NULL));
+    char buf[32];
+    for (uint32_t i = 0; i < 5000; i++) {
+        const int len = snprintf(buf, sizeof(buf), "node_%u", i);
+        ASSERT(hopscotch_add_named(t, buf, len, 0, NULL, NULL));
+    }
+    for (uint32_t i = 0; i < 5000; i++) {
+        const int len = snprintf(buf, sizeof(buf), "node_%u", i);
+        ASSERT(hopscotch_intern(t, buf, len, &id));
+        ASSERT_EQ(i, id);
+        ASSERT_STR_EQ(buf, hopscotch_name(t, i, NULL));
+    }
+    hopscotch_free(t);
+    PASS();
+}
+
+/* The smallest limit a handle accepts is the number of bytes it's
+ * using, so find that by bisection, then remove the limit. */
+static size_t
+memory_in_use(struct hopscotch *t) {
+    size_t lo = 1, hi = (size_t)1 << 40;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo)/2;
+        if (hopscotch_set_memory_limit(t, mid)) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    hopscotch_set_memory_limit(t, 0);
+    return lo;
+}
+
+TEST memory_limit(void) {
+    struct hopscotch *t = hopscotch_new();
+    ASSERT(t);
+    ASSERT(!hopscotch_set_memory_limit(t, 1));  /* already using more */
+    ASSERT_EQ(HOPSCOTCH_ERROR_MEMORY, hopscotch_error(t));
+    ASSERT(hopscotch_set_memory_limit(t, 64 * 1024));
+    const uint32_t succ[] = { 1 };
+    ASSERT(!hopscotch_add(t, 1 << 20, 1, succ));    /* too many nodes */
+    ASSERT_EQ(HOPSCOTCH_ERROR_MEMORY, hopscotch_error(t));
+    ASSERT(hopscotch_add(t, 0, 1, succ));           /* still usable */
+    hopscotch_free(t);
+
+    const uint32_t k = 5, node_count = 40 * k + 10;
+    t = many_test_graph(k);
+    ASSERT(t);
+    ASSERT(hopscotch_seal(t));
+    struct hopscotch_result res = { .id_limit = 0 };
+    ASSERT(hopscotch_solve_into(t, &res));
+    const size_t solved = memory_in_use(t);
+
+    /* Everything else gives back what it used. */
+    ASSERT_EQ(HOPSCOTCH_VERIFY_OK, hopscotch_verify(t, &res));
+    struct hopscotch_reduction red;
+    ASSERT(hopscotch_reduce(t, &res, &red));
+    hopscotch_reduction_free(&red);
+    struct hopscotch_critical_path cp;
+    ASSERT(hopscotch_critical_path(t, &res, &cp));
+    hopscotch_critical_path_free(&cp);
+    static uint64_t hashes[SHARD_TEST_NODES], fps[SHARD_TEST_NODES];
+    ASSERT(hopscotch_fingerprint(t, &res, hashes, fps));
+    struct hopscotch_solver *s = hopscotch_solver_new(t, NULL);
+    ASSERT(s);
+    struct hopscotch_result res2 = { .id_limit = 0 };
+    ASSERT(hopscotch_solver_solve_into(s, &res2));
+    hopscotch_result_free(&res2);
+    hopscotch_solver_free(s);
+    ASSERT_EQ(solved, memory_in_use(t));
+
+    /* Renumbering adds the two ID maps. */
+    ASSERT(hopscotch_renumber(t, HOPSCOTCH_ORDER_BFS));
+    ASSERT_EQ(solved + 2 * node_count * sizeof(uint32_t), memory_in_use(t));
+
+    /* Once the condensation is built, running groups fits in a little
+     * more memory, by using fewer threads, but not in none. */
+    const uint32_t changed = 0;
+    size_t affected_count;
+    const uint32_t *affected;
+    ASSERT(hopscotch_impact(t, 1, &changed, &affected_count, &affected));
+    const size_t with_cond = memory_in_use(t);
+    ASSERT(hopscotch_set_memory_limit(t, with_cond + 2048));
+    static struct execute_log log;
+    memset(&log, 0x00, sizeof(log));
+    log.node_count = node_count;
+    log.k = k;
+    log.node_group = res.node_group;
+    ASSERT(hopscotch_execute(t, 8, execute_log_cb, &log));
+    ASSERT_EQ(res.group_count, log.calls);
+    ASSERT(hopscotch_set_memory_limit(t, with_cond));
+    ASSERT(!hopscotch_execute(t, 8, execute_log_cb, &log));
+    ASSERT_EQ(HOPSCOTCH_ERROR_MEMORY, hopscotch_error(t));
+    ASSERT(!hopscotch_reduce(t, &res, &red));
+
+    /* Resetting frees the maps and the condensation, but keeps the
+     * rest of the buffers. */
+    hopscotch_reset(t);
+    ASSERT_EQ(solved, memory_in_use(t));
+    hopscotch_result_free(&res);
+    hopscotch_free(t);
+    PASS();
+}
+
+enum limit_op {
+    LIMIT_REDUCE,
+    LIMIT_RENUMBER_BFS,
+    LIMIT_RENUMBER_DFS,
+    LIMIT_RENUMBER_RCM,
+    LIMIT_RENUMBER_DEGREE,
+    LIMIT_SUCCESSORS,
+    LIMIT_IMPACT,
+    LIMIT_ITER_PAYLOADS,
+    LIMIT_SHARDS,
+    LIMIT_OP_COUNT,
+};
+
+/* Run OP on a fresh test graph, with a limit of EXTRA bytes past what
+ * the graph was using beforehand. Setup failures come back as
+ * HOPSCOTCH_ERROR_MISUSE, which no OP should fail with otherwise. */
+static enum hopscotch_error
+run_limited(enum limit_op op, size_t extra) {
+    const uint32_t k = 5, node_count = 40 * k + 10;
+    struct hopscotch *t = (op == LIMIT_SHARDS ? hopscotch_new()
+        : many_test_graph(k));
+    if (t == NULL) { return HOPSCOTCH_ERROR_MISUSE; }
+    struct hopscotch_result res = { .id_limit = 0 };
+    enum hopscotch_error err = HOPSCOTCH_ERROR_MISUSE;
+    if (op != LIMIT_SHARDS && (!hopscotch_seal(t)
+            || (op == LIMIT_SUCCESSORS && !hopscotch_compress(t))
+            || (op == LIMIT_REDUCE && !hopscotch_solve_into(t, &res)))) {
+        goto done;
+    }
+    if (!hopscotch_set_memory_limit(t, memory_in_use(t) + extra)) { goto done; }
+
+    err = HOPSCOTCH_ERROR_NONE;
+    const enum hopscotch_node_order orders[] = {
+        [LIMIT_RENUMBER_BFS] = HOPSCOTCH_ORDER_BFS,
+        [LIMIT_RENUMBER_DFS] = HOPSCOTCH_ORDER_DFS,
+        [LIMIT_RENUMBER_RCM] = HOPSCOTCH_ORDER_RCM,
+        [LIMIT_RENUMBER_DEGREE] = HOPSCOTCH_ORDER_DEGREE,
+    };
+    switch (op) {
+    case LIMIT_REDUCE:
+    {
+        struct hopscotch_reduction red;
+        if (!hopscotch_reduce(t, &res, &red)) {
+            err = hopscotch_error(t);
+        } else {
+            hopscotch_reduction_free(&red);
+        }
+        break;
+    }
+    case LIMIT_RENUMBER_BFS:
+    case LIMIT_RENUMBER_DFS:
+    case LIMIT_RENUMBER_RCM:
+    case LIMIT_RENUMBER_DEGREE:
+        if (!hopscotch_renumber(t, orders[op])) { err = hopscotch_error(t); }
+        break;
+    case LIMIT_SUCCESSORS:
+        for (uint32_t id = 0; id < node_count; id++) {
+            size_t count;
+            const uint32_t *succ;
+            if (!hopscotch_get_successors(t, id, &count, &succ)) {
+                err = hopscotch_error(t);
+                break;
+            }
+        }
+        break;
+    case LIMIT_IMPACT:
+    {
+        const uint32_t changed = 0;
+        size_t affected_count;
+        const uint32_t *affected;
+        if (!hopscotch_impact(t, 1, &changed, &affected_count, &affected)) {
+            err = hopscotch_error(t);
+        }
+        break;
+    }
+    case LIMIT_ITER_PAYLOADS:
+    {
+        /* Creating the iterator can only fail for memory here. */
+        struct hopscotch_iter *it = hopscotch_iter_new(t, NULL);
+        if (it == NULL) {
+            err = HOPSCOTCH_ERROR_MEMORY;
+            break;
+        }
+        uint32_t group_id;
+        size_t count;
+        const uint32_t *members;
+        while (hopscotch_iter_next(it, &group_id, &count, &members)) {
+            if (hopscotch_iter_payloads(it) == NULL) { break; }
+        }
+        err = hopscotch_iter_error(it);
+        hopscotch_iter_free(it);
+        break;
+    }
+    case LIMIT_SHARDS:
+        /* Likewise, creating and adding through shards. */
+        for (uint32_t i = 0; i < 4 && err == HOPSCOTCH_ERROR_NONE; i++) {
+            struct hopscotch_shard *shard = hopscotch_shard_new(t);
+            if (shard == NULL) {
+                err = HOPSCOTCH_ERROR_MEMORY;
+                break;
+            }
+            for (uint32_t id = i; id < node_count; id += 4) {
+                const uint32_t succ[] = { (id * 7 + k) % node_count };
+                if (!hopscotch_shard_add(shard, id, 1, succ)) {
+                    err = HOPSCOTCH_ERROR_MEMORY;
+                    break;
+                }
+            }
+        }
+        if (err == HOPSCOTCH_ERROR_NONE && !hopscotch_seal(t)) {
+            err = hopscotch_error(t);
+        }
+        break;
+    default:
+        assert(false);
+    }
+
+done:
+    hopscotch_result_free(&res);
+    hopscotch_free(t);
+    return err;
+}
+
+TEST shared_memory_limit(void) {
+    struct hopscotch *owner = hopscotch_new();
+    struct hopscotch *t = hopscotch_new();
+    ASSERT(owner);
+    ASSERT(t);
+    ASSERT(!hopscotch_share_memory_limit(owner, owner));
+    ASSERT_EQ(HOPSCOTCH_ERROR_MISUSE, hopscotch_error(owner));
+    const size_t base = memory_in_use(owner);
+    const size_t used = memory_in_use(t);
+    ASSERT(hopscotch_share_memory_limit(t, owner));
+    ASSERT(!hopscotch_share_memory_limit(t, owner));   /* only once */
+    ASSERT_EQ(base + used, memory_in_use(owner));
+
+    /* Charges against either handle come out of the owner's limit. */
+    ASSERT(hopscotch_set_memory_limit(owner, base + used + 4096));
+    ASSERT(hopscotch_charge_memory(owner, 0, 2048));
+    ASSERT(!hopscotch_charge_memory(t, 0, 4096));
+    const uint32_t succ[] = { 1 };
+    ASSERT(!hopscotch_add(t, 1 << 20, 1, succ));
+    ASSERT_EQ(HOPSCOTCH_ERROR_MEMORY, hopscotch_error(t));
+    ASSERT(hopscotch_charge_memory(t, 0, 2048));
+    ASSERT(!hopscotch_charge_memory(owner, 0, 1));
+    ASSERT(hopscotch_charge_memory(t, 2048, 0));
+    ASSERT(hopscotch_charge_memory(owner, 2048, 0));
+
+    /* Freeing the shared handle gives its memory back. */
+    hopscotch_set_memory_limit(owner, 0);
+    hopscotch_free(t);
+    ASSERT_EQ(base, memory_in_use(owner));
+    hopscotch_free(owner);
+    PASS();
+}
+
+TEST memory_limit_peaks(void) {
+    /* Find the smallest limit each operation fits in, then check that
+     * it fails cleanly with one byte less, so nothing it allocates
+     * along the way escapes the limit. */
+    size_t peaks[LIMIT_OP_COUNT];
+    for (int op = 0; op < LIMIT_OP_COUNT; op++) {
+        size_t lo = 0, hi = (size_t)1 << 24;
+        ASSERT_EQ_FMT(HOPSCOTCH_ERROR_NONE, run_limited(op, hi), "%d");
+        while (lo < hi) {
+            const size_t mid = lo + (hi - lo)/2;
+            const enum hopscotch_error err = run_limited(op, mid);
+            ASSERT(err == HOPSCOTCH_ERROR_NONE || err == HOPSCOTCH_ERROR_MEMORY);
+            if (err == HOPSCOTCH_ERROR_NONE) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        peaks[op] = lo;
+        ASSERT(peaks[op] > 0);
+        ASSERT_EQ_FMT(HOPSCOTCH_ERROR_MEMORY, run_limited(op, peaks[op] - 1), "%d");
+    }
+
+    /* Ordering by degree sorts every ID first, and depth-first
+     * ordering needs a stack. */
+    const size_t node_count = 40 * 5 + 10;
+    ASSERT(peaks[LIMIT_RENUMBER_DEGREE]
+        >= peaks[LIMIT_RENUMBER_BFS] + node_count * sizeof(uint64_t));
+    ASSERT(peaks[LIMIT_RENUMBER_RCM]
+        >= peaks[LIMIT_RENUMBER_BFS] + node_count * sizeof(uint64_t));
+    ASSERT(peaks[LIMIT_RENUMBER_DFS] > peaks[LIMIT_RENUMBER_BFS]);
+    PASS();
+}
+
 SUITE(basic) {
     RUN_TEST(bare_api_use);
     RUN_TEST(example_hopscotch_shape);
@@ -499,6 +2267,34 @@ SUITE(basic) {
     RUN_TEST(example_disconnected);
     RUN_TEST(example_disconnected_cycle);
     RUN_TEST(max_depth_limit);
+    RUN_TEST(solve_from_roots);
+    RUN_TEST(solve_masked_labels);
+    RUN_TEST(impact_of_changes);
+    RUN_TEST(reset_and_reuse);
+    RUN_TEST(sharded_build_matches_serial);
+    RUN_TEST(add_to_disconnected_node);
+    RUN_TEST(concurrent_solvers);
+    RUN_TEST(solve_many_graphs);
+    RUN_TEST(solve_into_result);
+    RUN_TEST(verify_results);
+    RUN_TEST(member_orders);
+    RUN_TEST(iterate_groups);
+    RUN_TEST(pearce_engine_matches);
+    RUN_TEST(compressed_successors);
+    RUN_TEST(solver_successors);
+    RUN_TEST(compressed_labels);
+    RUN_TEST(renumbered_nodes);
+    RUN_TEST(critical_path);
+    RUN_TEST(execute_groups);
+    RUN_TEST(execute_sorted_after_impact);
+    RUN_TEST(reduce_small);
+    RUN_TEST(reduce_matches_closure);
+    RUN_TEST(fingerprint_groups);
+    RUN_TEST(node_payloads);
+    RUN_TEST(named_nodes);
+    RUN_TEST(memory_limit);
+    RUN_TEST(memory_limit_peaks);
+    RUN_TEST(shared_memory_limit);
 }
 
 /* Add all the definitions that need to be in the test runner's main file. */
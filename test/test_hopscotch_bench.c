@@ -128,17 +128,497 @@ TEST gen_chain_with_cycle(size_t count) {
     PASS();
 }
 
+static bool
+add_small_graph(struct hopscotch *t, uint64_t state[2]) {
+    const uint32_t max_id = 64;
+    for (uint32_t id = 0; id < max_id; id++) {
+        uint32_t succ[4];
+        const size_t count = x128p_next(state) % 4;
+        for (size_t si = 0; si < count; si++) {
+            succ[si] = ((uint32_t)x128p_next(state)) % max_id;
+        }
+        if (!hopscotch_add(t, id, count, succ)) { return false; }
+    }
+    return hopscotch_seal(t);
+}
+
+TEST gen_many_small(bool reset) {
+    const size_t rounds = 100000;
+    uint64_t state[2] = { 1, 2 };
+    struct hopscotch *t = (reset ? hopscotch_new() : NULL);
+
+    struct timeval pre, post;
+    ASSERT(0 == gettimeofday(&pre, NULL));
+    for (size_t i = 0; i < rounds; i++) {
+        if (reset) {
+            hopscotch_reset(t);
+        } else {
+            t = hopscotch_new();
+            ASSERT(t);
+        }
+        ASSERT(add_small_graph(t, state));
+        ASSERT(hopscotch_solve(t, 0, NULL, NULL));
+        if (!reset) { hopscotch_free(t); }
+    }
+    ASSERT(0 == gettimeofday(&post, NULL));
+    if (reset) { hopscotch_free(t); }
+
+    const uint64_t msec = msec_of_delta(&pre, &post);
+    printf("%zu small graphs, %s -- msec %"PRIu64"\n",
+        rounds, reset ? "reset" : "new/free", msec);
+    PASS();
+}
+
+struct copy_env {
+    uint32_t *offsets;
+    uint32_t *members;
+    uint32_t used;
+};
+
+static void
+copy_groups_cb(uint32_t group_id, size_t count, const uint32_t *group,
+    void *udata) {
+    struct copy_env *env = udata;
+    env->offsets[group_id] = env->used;
+    memcpy(&env->members[env->used], group, count * sizeof(group[0]));
+    env->used += count;
+}
+
+/* Mostly singleton groups, copied out by a callback vs. solve_into. */
+TEST gen_solve_into(bool into) {
+    const uint32_t max_id = 1 << 20;
+    struct hopscotch *t = random_graph(1, max_id, 3, max_id);
+    ASSERT(t);
+    size_t id_limit, node_count;
+    ASSERT(hopscotch_result_size(t, &id_limit, &node_count));
+
+    struct hopscotch_result res = { .id_limit = 0 };
+    struct copy_env env = {
+        .offsets = malloc((node_count + 1) * sizeof(uint32_t)),
+        .members = malloc(node_count * sizeof(uint32_t)),
+    };
+    ASSERT(env.offsets && env.members);
+
+    /* Solve once first, so both are timed with warm buffers. */
+    struct timeval pre, post;
+    for (size_t i = 0; i < 2; i++) {
+        env.used = 0;
+        ASSERT(0 == gettimeofday(&pre, NULL));
+        if (into) {
+            ASSERT(hopscotch_solve_into(t, &res));
+        } else {
+            ASSERT(hopscotch_solve(t, 0, copy_groups_cb, &env));
+        }
+        ASSERT(0 == gettimeofday(&post, NULL));
+    }
+
+    const uint64_t msec = msec_of_delta(&pre, &post);
+    printf("%zu nodes, %s -- msec %"PRIu64"\n",
+        node_count, into ? "solve_into" : "callback", msec);
+
+    if (into) {
+        ASSERT(0 == gettimeofday(&pre, NULL));
+        ASSERT_EQ(HOPSCOTCH_VERIFY_OK, hopscotch_verify(t, &res));
+        ASSERT(0 == gettimeofday(&post, NULL));
+        printf("%zu nodes, verify -- msec %"PRIu64"\n",
+            node_count, msec_of_delta(&pre, &post));
+    }
+
+    free(env.offsets);
+    free(env.members);
+    hopscotch_result_free(&res);
+    hopscotch_free(t);
+    PASS();
+}
+
+/* Time to get the first few groups from an iterator. */
+TEST gen_iter_first(size_t limit) {
+    const uint32_t max_id = 1 << 20;
+    struct hopscotch *t = random_graph(2, max_id, 3, max_id);
+    ASSERT(t);
+
+    struct timeval pre, post;
+    ASSERT(0 == gettimeofday(&pre, NULL));
+    struct hopscotch_iter *it = hopscotch_iter_new(t, NULL);
+    ASSERT(it);
+    size_t groups = 0;
+    while (groups < limit && hopscotch_iter_next(it, NULL, NULL, NULL)) {
+        groups++;
+    }
+    hopscotch_iter_free(it);
+    ASSERT(0 == gettimeofday(&post, NULL));
+
+    const uint64_t msec = msec_of_delta(&pre, &post);
+    printf("iterator, first %zu groups -- msec %"PRIu64"\n", groups, msec);
+    hopscotch_free(t);
+    PASS();
+}
+
+/* One giant group, with each member order. */
+TEST gen_member_order(enum hopscotch_member_order order) {
+    const uint32_t max_id = 1 << 20;
+    struct hopscotch *t = random_graph(3, max_id, 8, max_id);
+    ASSERT(t);
+
+    struct hopscotch_solver_config config = {
+        .max_depth = max_id,
+        .member_order = order,
+    };
+    struct hopscotch_solver *s = hopscotch_solver_new(t, &config);
+    ASSERT(s);
+
+    struct timeval pre, post;
+    ASSERT(0 == gettimeofday(&pre, NULL));
+    ASSERT(hopscotch_solver_solve(s, NULL, NULL));
+    ASSERT(0 == gettimeofday(&post, NULL));
+
+    const uint64_t msec = msec_of_delta(&pre, &post);
+    printf("member order %d -- msec %"PRIu64"\n", order, msec);
+    hopscotch_solver_free(s);
+    hopscotch_free(t);
+    PASS();
+}
+
+/* Time and solver memory for each engine. */
+TEST gen_engine(enum hopscotch_engine engine) {
+    const uint32_t max_id = 1 << 21;
+    struct hopscotch *t = random_graph(4, max_id, 4, max_id);
+    ASSERT(t);
+
+    struct hopscotch_solver_config config = {
+        .max_depth = max_id,
+        .engine = engine,
+    };
+    struct hopscotch_solver *s = hopscotch_solver_new(t, &config);
+    ASSERT(s);
+
+    struct timeval pre, post;
+    ASSERT(0 == gettimeofday(&pre, NULL));
+    ASSERT(hopscotch_solver_solve(s, NULL, NULL));
+    ASSERT(0 == gettimeofday(&post, NULL));
+
+    const uint64_t msec = msec_of_delta(&pre, &post);
+    const size_t bytes = hopscotch_solver_memory(s);
+    printf("engine %s -- msec %"PRIu64", solver %zu bytes (%.2f per node ID)\n",
+        engine == HOPSCOTCH_ENGINE_PEARCE ? "pearce" : "tarjan",
+        msec, bytes, bytes / (double)max_id);
+    hopscotch_solver_free(s);
+    hopscotch_free(t);
+    PASS();
+}
+
+TEST gen_compress(bool compress) {
+    const uint32_t max_id = 1 << 21;
+    struct hopscotch *t = random_graph(4, max_id, 8, max_id);
+    ASSERT(t);
+
+    struct timeval pre, post;
+    uint64_t pack_msec = 0;
+    if (compress) {
+        ASSERT(0 == gettimeofday(&pre, NULL));
+        ASSERT(hopscotch_compress(t));
+        ASSERT(0 == gettimeofday(&post, NULL));
+        pack_msec = msec_of_delta(&pre, &post);
+    }
+
+    struct hopscotch_solver_config config = { .max_depth = max_id };
+    struct hopscotch_solver *s = hopscotch_solver_new(t, &config);
+    ASSERT(s);
+    ASSERT(0 == gettimeofday(&pre, NULL));
+    ASSERT(hopscotch_solver_solve(s, NULL, NULL));
+    ASSERT(0 == gettimeofday(&post, NULL));
+
+    const uint64_t msec = msec_of_delta(&pre, &post);
+    printf("compress %d -- pack msec %"PRIu64", solve msec %"PRIu64
+        ", graph %zu bytes\n",
+        compress, pack_msec, msec, hopscotch_memory(t));
+    hopscotch_solver_free(s);
+    hopscotch_free(t);
+    PASS();
+}
+
+/* A graph where each node's successors are close to it, but whose
+ * IDs are shuffled, as if assigned in an arbitrary first-seen order. */
+static struct hopscotch *
+shuffled_local_graph(uint32_t node_count) {
+    uint64_t state[2] = { 0x5eed, ~0x5eedLLU };
+    uint32_t *ids = malloc(node_count * sizeof(ids[0]));
+    struct hopscotch *t = hopscotch_new();
+    if (ids == NULL || t == NULL) { goto fail; }
+
+    for (uint32_t i = 0; i < node_count; i++) { ids[i] = i; }
+    for (uint32_t i = node_count - 1; i > 0; i--) {
+        const uint32_t j = x128p_next(state) % (i + 1);
+        const uint32_t tmp = ids[i];
+        ids[i] = ids[j];
+        ids[j] = tmp;
+    }
+
+    for (uint32_t p = 0; p < node_count; p++) {
+        uint32_t succ[3];
+        size_t count = 0;
+        if (p + 1 < node_count) { succ[count++] = ids[p + 1]; }
+        if (p + 3 < node_count) { succ[count++] = ids[p + 3]; }
+        if (p % 64 == 63) { succ[count++] = ids[p - 50]; }
+        if (!hopscotch_add(t, ids[p], count, succ)) { goto fail; }
+    }
+    if (!hopscotch_seal(t)) { goto fail; }
+    free(ids);
+    return t;
+
+fail:
+    free(ids);
+    if (t != NULL) { hopscotch_free(t); }
+    return NULL;
+}
+
+/* ORDER is a hopscotch_node_order, or -1 to leave IDs alone. */
+TEST gen_renumber(int order) {
+    const uint32_t node_count = 1 << 21;
+    struct hopscotch *t = shuffled_local_graph(node_count);
+    ASSERT(t);
+
+    static const char *names[] = { "bfs", "dfs", "rcm", "degree" };
+    struct timeval pre, post;
+    uint64_t renumber_msec = 0;
+    if (order >= 0) {
+        ASSERT(0 == gettimeofday(&pre, NULL));
+        ASSERT(hopscotch_renumber(t, (enum hopscotch_node_order)order));
+        ASSERT(0 == gettimeofday(&post, NULL));
+        renumber_msec = msec_of_delta(&pre, &post);
+    }
+
+    struct hopscotch_solver_config config = { .max_depth = node_count };
+    struct hopscotch_solver *s = hopscotch_solver_new(t, &config);
+    ASSERT(s);
+    struct hopscotch_result res = { .id_limit = 0 };
+    ASSERT(hopscotch_solver_solve_into(s, &res));  /* warm up */
+
+    ASSERT(0 == gettimeofday(&pre, NULL));
+    ASSERT(hopscotch_solver_solve_into(s, &res));
+    ASSERT(0 == gettimeofday(&post, NULL));
+
+    const uint64_t msec = msec_of_delta(&pre, &post);
+    printf("renumber %s -- renumber msec %"PRIu64", solve msec %"PRIu64
+        ", %u groups\n", order >= 0 ? names[order] : "none",
+        renumber_msec, msec, res.group_count);
+    hopscotch_result_free(&res);
+    hopscotch_solver_free(s);
+    hopscotch_free(t);
+    PASS();
+}
+
+static void
+execute_work_cb(uint32_t group_id, size_t count, const uint32_t *group,
+    void *udata) {
+    (void)group;
+    /* A little busywork per member, standing in for a real task. */
+    uint64_t state[2] = { group_id, count };
+    uint64_t sum = 0;
+    for (size_t i = 0; i < 64 * count; i++) { sum += x128p_next(state); }
+    __atomic_add_fetch((uint64_t *)udata, sum & 1, __ATOMIC_RELAXED);
+}
+
+TEST gen_execute(size_t nthreads) {
+    const uint32_t max_id = 1 << 18;
+    struct hopscotch *t = random_graph(5, max_id, 3, max_id);
+    ASSERT(t);
+    uint64_t sink = 0;
+    ASSERT(hopscotch_execute(t, 1, execute_work_cb, &sink)); /* warm up */
+
+    struct timeval pre, post;
+    ASSERT(0 == gettimeofday(&pre, NULL));
+    ASSERT(hopscotch_execute(t, nthreads, execute_work_cb, &sink));
+    ASSERT(0 == gettimeofday(&post, NULL));
+
+    const uint64_t msec = msec_of_delta(&pre, &post);
+    printf("execute, %zu threads -- msec %"PRIu64"\n", nthreads, msec);
+    hopscotch_free(t);
+    PASS();
+}
+
+TEST gen_reduce(uint32_t max_id) {
+    struct hopscotch *t = random_graph(6, max_id, 6, max_id);
+    ASSERT(t);
+    struct hopscotch_result res = { .id_limit = 0 };
+    ASSERT(hopscotch_solve_into(t, &res));
+
+    struct timeval pre, post;
+    struct hopscotch_reduction red;
+    ASSERT(0 == gettimeofday(&pre, NULL));
+    ASSERT(hopscotch_reduce(t, &res, &red));
+    ASSERT(0 == gettimeofday(&post, NULL));
+
+    const uint64_t msec = msec_of_delta(&pre, &post);
+    printf("reduce, %u groups -- msec %"PRIu64", kept %u edges, removed %zu\n",
+        res.group_count, msec, red.offsets[red.group_count], red.removed);
+    hopscotch_reduction_free(&red);
+    hopscotch_result_free(&res);
+    hopscotch_free(t);
+    PASS();
+}
+
+TEST gen_payloads(void) {
+    const uint32_t max_id = 1 << 21;
+    struct hopscotch *t = random_graph(7, max_id, 4, max_id);
+    ASSERT(t);
+    ASSERT(hopscotch_set_payload_size(t, sizeof(uint64_t)));
+    for (uint32_t id = 0; id < max_id; id++) {
+        const uint64_t cost = id % 1000;
+        ASSERT(hopscotch_set_payload(t, id, &cost));
+    }
+    struct hopscotch_solver_config config = { .max_depth = max_id };
+    struct hopscotch_solver *s = hopscotch_solver_new(t, &config);
+    ASSERT(s);
+    struct hopscotch_result res = { .id_limit = 0 };
+    ASSERT(hopscotch_solver_solve_into(s, &res));
+    hopscotch_solver_free(s);
+    uint64_t *gathered = malloc(res.node_count * sizeof(gathered[0]));
+    ASSERT(gathered);
+
+    /* Look each member's payload up by ID, vs. gathering them first. */
+    struct timeval pre, post;
+    uint64_t sum = 0, gsum = 0;
+    ASSERT(0 == gettimeofday(&pre, NULL));
+    for (size_t i = 0; i < res.node_count; i++) {
+        const uint64_t *cost = hopscotch_payload(t, res.members[i]);
+        sum += *cost;
+    }
+    ASSERT(0 == gettimeofday(&post, NULL));
+    const uint64_t lookup_msec = msec_of_delta(&pre, &post);
+
+    ASSERT(0 == gettimeofday(&pre, NULL));
+    ASSERT(hopscotch_gather_payloads(t, &res, gathered));
+    for (size_t i = 0; i < res.node_count; i++) { gsum += gathered[i]; }
+    ASSERT(0 == gettimeofday(&post, NULL));
+    ASSERT_EQ(sum, gsum);
+
+    printf("payloads, %zu nodes -- lookup msec %"PRIu64", gather msec %"PRIu64"\n",
+        res.node_count, lookup_msec, msec_of_delta(&pre, &post));
+    free(gathered);
+    hopscotch_result_free(&res);
+    hopscotch_free(t);
+    PASS();
+}
+
+TEST gen_named(void) {
+    const uint32_t max_id = 1 << 20;
+    const size_t succ_count = 4;
+    struct hopscotch *t = hopscotch_new();
+    ASSERT(t);
+    static char names[5][32];
+    const char *succ_names[4];
+    size_t lens[5];
+    for (size_t i = 0; i < succ_count; i++) { succ_names[i] = names[i + 1]; }
+    uint64_t state[2] = { 8, ~8LLU };
+
+    struct timeval pre, post;
+    ASSERT(0 == gettimeofday(&pre, NULL));
+    for (uint32_t id = 0; id < max_id; id++) {
+        lens[0] = snprintf(names[0], sizeof(names[0]), "src/module_%u.c", id);
+        for (size_t i = 1; i <= succ_count; i++) {
+            lens[i] = snprintf(names[i], sizeof(names[i]), "src/module_%u.c",
+                ((uint32_t)x128p_next(state)) % max_id);
+        }
+        ASSERT(hopscotch_add_named(t, names[0], lens[0],
+                succ_count, succ_names, &lens[1]));
+    }
+    ASSERT(0 == gettimeofday(&post, NULL));
+    const uint64_t add_msec = msec_of_delta(&pre, &post);
+
+    ASSERT(hopscotch_seal(t));
+    size_t len, total = 0;
+    ASSERT(0 == gettimeofday(&pre, NULL));
+    for (uint32_t id = 0; id < max_id; id++) {
+        ASSERT(hopscotch_name(t, id, &len));
+        total += len;
+    }
+    ASSERT(0 == gettimeofday(&post, NULL));
+
+    printf("named, %u nodes -- add msec %"PRIu64", name lookup msec %"PRIu64
+        ", memory %zu\n", max_id, add_msec, msec_of_delta(&pre, &post),
+        hopscotch_memory(t));
+    ASSERT(total > 0);
+    hopscotch_free(t);
+    PASS();
+}
+
+#define MANY_BENCH_GRAPHS 1000
+
+static void
+count_groups_cb(size_t graph_index, uint32_t group_id, size_t count,
+    const uint32_t *group, void *udata) {
+    (void)group_id;
+    (void)count;
+    (void)group;
+    size_t *group_counts = udata;
+    group_counts[graph_index]++;
+}
+
+TEST gen_solve_many(size_t nthreads) {
+    static struct hopscotch *graphs[MANY_BENCH_GRAPHS];
+    static size_t group_counts[MANY_BENCH_GRAPHS];
+    for (size_t i = 0; i < MANY_BENCH_GRAPHS; i++) {
+        graphs[i] = random_graph(i, 4096, 8, 4096);
+        ASSERT(graphs[i]);
+    }
+    memset(group_counts, 0x00, sizeof(group_counts));
+
+    struct timeval pre, post;
+    ASSERT(0 == gettimeofday(&pre, NULL));
+    ASSERT(hopscotch_solve_many(MANY_BENCH_GRAPHS, graphs, nthreads,
+            count_groups_cb, group_counts));
+    ASSERT(0 == gettimeofday(&post, NULL));
+
+    const uint64_t msec = msec_of_delta(&pre, &post);
+    printf("solve_many, %d graphs, %zu threads -- msec %"PRIu64"\n",
+        MANY_BENCH_GRAPHS, nthreads, msec);
+
+    for (size_t i = 0; i < MANY_BENCH_GRAPHS; i++) {
+        ASSERT(group_counts[i] > 0);
+        hopscotch_free(graphs[i]);
+    }
+    PASS();
+}
 
 SUITE(bench) {
     RUN_TEST(gen);
+    RUN_TESTp(gen_many_small, false);
+    RUN_TESTp(gen_many_small, true);
+    RUN_TESTp(gen_solve_into, false);
+    RUN_TESTp(gen_solve_into, true);
+    RUN_TESTp(gen_iter_first, 10);
+    RUN_TESTp(gen_iter_first, SIZE_MAX);
+    RUN_TESTp(gen_member_order, HOPSCOTCH_MEMBERS_SORTED);
+    RUN_TESTp(gen_member_order, HOPSCOTCH_MEMBERS_STACK);
+    RUN_TESTp(gen_member_order, HOPSCOTCH_MEMBERS_DISCOVERY);
+    RUN_TESTp(gen_engine, HOPSCOTCH_ENGINE_TARJAN);
+    RUN_TESTp(gen_engine, HOPSCOTCH_ENGINE_PEARCE);
+    RUN_TESTp(gen_compress, false);
+    RUN_TESTp(gen_compress, true);
+    RUN_TESTp(gen_renumber, -1);
+    RUN_TESTp(gen_renumber, HOPSCOTCH_ORDER_BFS);
+    RUN_TESTp(gen_renumber, HOPSCOTCH_ORDER_DFS);
+    RUN_TESTp(gen_renumber, HOPSCOTCH_ORDER_RCM);
+    RUN_TESTp(gen_renumber, HOPSCOTCH_ORDER_DEGREE);
+    for (size_t i = 1; i <= 8; i *= 2) {
+        RUN_TESTp(gen_execute, i);
+    }
+    RUN_TESTp(gen_reduce, 1 << 12);
+    RUN_TESTp(gen_reduce, 1 << 16);
+    RUN_TEST(gen_payloads);
+    RUN_TEST(gen_named);
+    for (size_t i = 1; i <= 8; i *= 2) {
+        RUN_TESTp(gen_solve_many, i);
+    }
 
-    /* Note: a sufficiently deep chain of references can overflow
+    /* Note: a sufficiently deep chain of references used to overflow
      * the stack; on this particular computer, ten million nodes
-     * `a -> b -> c -> ... -> a` will do it.
+     * `a -> b -> c -> ... -> a` would do it.
      *
-     * This could be avoided by restructuring the code to use an
-     * explicit stack, rather than the C call stack. The crash
-     * is currently prevented with a max stack depth parameter. */
+     * The solver now uses an explicit stack, rather than the C call
+     * stack, but its depth is still limited by the max depth
+     * parameter (which defaults to 100,000). */
     for (size_t i = 1; i < 1000000; i *= 10) {
         RUN_TESTp(gen_chain_with_cycle, i);
     }